@@ -8,18 +8,21 @@
 // Version and Constants
 #define VERSION "0.2.7"
 
+typedef struct _FileIndex FileIndex;
+typedef struct _SidebarModel SidebarModel;
+
 // Global UI Widgets (externed for module access)
 extern GtkWidget *window;
 extern GtkWidget *sidebar;
 extern GtkWidget *status_bar;
 extern GtkSourceView *source_view;
 extern GtkSourceBuffer *text_buffer;
-extern GtkTreeStore *tree_store;
+extern SidebarModel *tree_model;
 extern GtkWidget *tree_view;
 extern GtkTreeViewColumn *sidebar_column;
 extern GtkSourceStyleSchemeManager *theme_manager;
 extern GtkTreeRowReference *current_file_row_ref;
-extern GList *file_list;
+extern FileIndex *file_index;
 extern GtkCssProvider *app_css_provider;
 extern GtkWidget *editor_stack;
 extern GtkWidget *welcome_screen;
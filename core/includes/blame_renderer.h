@@ -0,0 +1,26 @@
+#ifndef BLAME_RENDERER_H
+#define BLAME_RENDERER_H
+
+#include "app_state.h"
+#include "git_blame.h"
+
+// Gutter column with the author, age and summary of the commit behind each
+// line. Buffer lines are mapped to lines of the blamed file through the git
+// change hunks, so edits shift the annotations without blaming again.
+
+#define BLAME_TYPE_RENDERER (blame_renderer_get_type())
+G_DECLARE_FINAL_TYPE(BlameRenderer, blame_renderer, BLAME, RENDERER, GtkSourceGutterRendererText)
+
+// Asked for every drawn line whose blame is not known yet; line is in the blamed file
+typedef void (*BlameWantFunc)(guint line, gpointer user_data);
+
+BlameRenderer* blame_renderer_new(BlameWantFunc want, gpointer user_data);
+
+// file may be NULL; a reference is taken
+void blame_renderer_set_file(BlameRenderer *renderer, BlameFile *file);
+
+// hunks are DiffHunk (line_diff.h) against the blamed file; a reference is
+// taken. NULL, while they are not known, blanks the column.
+void blame_renderer_set_hunks(BlameRenderer *renderer, GArray *hunks);
+
+#endif // BLAME_RENDERER_H
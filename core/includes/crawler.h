@@ -0,0 +1,43 @@
+#ifndef CRAWLER_H
+#define CRAWLER_H
+
+#include "app_state.h"
+#include "ignore.h"
+
+// Directory entry produced by a worker thread
+typedef struct {
+    char *name;
+    gboolean is_dir;
+    gboolean is_ignored;  // Matched an ignore rule (only set when the crawler has a matcher)
+    gboolean is_excluded; // Ignored folder, or symlink to a folder already read; not to be walked
+} CrawlEntry;
+
+// One directory read, handed to the main thread in sorted order (folders first)
+typedef struct {
+    char *path;
+    gpointer tag;        // Opaque requester data passed to crawler_queue_dir
+    GPtrArray *entries;  // CrawlEntry*
+    guint cursor;        // Next entry to hand to the consumer
+    gint64 mtime;        // Folder mtime in ns when it was read, 0 if it could not be opened
+    gboolean has_git;    // Holds a .git folder or file, so it is the root of a repository
+    gboolean is_loop;    // Same folder as one of its ancestors (bind mount loop); delivered empty
+} CrawlBatch;
+
+#define STAT_MTIME_NS(st) ((gint64)(st).st_mtim.tv_sec * 1000000000 + (st).st_mtim.tv_nsec)
+
+typedef struct _Crawler Crawler;
+
+typedef void (*CrawlEntryFunc)(Crawler *crawler, CrawlBatch *batch, CrawlEntry *entry, gpointer user_data);
+typedef void (*CrawlBatchFunc)(Crawler *crawler, CrawlBatch *batch, gpointer user_data);
+typedef void (*CrawlDoneFunc)(Crawler *crawler, gpointer user_data);
+
+Crawler* crawler_new(CrawlEntryFunc on_entry, CrawlBatchFunc on_batch_done, CrawlDoneFunc on_finished,
+                     GDestroyNotify tag_free, gpointer user_data);
+void crawler_set_ignore(Crawler *crawler, IgnoreMatcher *matcher);
+void crawler_queue_dir(Crawler *crawler, const char *path, gpointer tag);
+gboolean crawler_is_busy(Crawler *crawler);
+void crawler_destroy(Crawler *crawler);
+
+gboolean crawler_is_listed(const char *name, gboolean is_dir);
+
+#endif // CRAWLER_H
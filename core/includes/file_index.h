@@ -0,0 +1,90 @@
+#ifndef FILE_INDEX_H
+#define FILE_INDEX_H
+
+#include "app_state.h"
+
+// Flat index of every file and folder in the workspace. Entries only store
+// their own name (in a shared string arena) plus the id of their parent, so
+// full paths are rebuilt on demand. Parents always have lower ids than
+// their children.
+
+typedef guint32 FileId;
+
+#define FILE_INDEX_ROOT G_MAXUINT32 // Parent id of top-level entries
+#define FILE_INDEX_NONE (G_MAXUINT32 - 1) // Lookup miss
+
+#define FILE_NODE_DIR      (1 << 0)
+#define FILE_NODE_EXCLUDED (1 << 1) // Folder whose contents are not indexed (symlink or bind mount loop)
+#define FILE_NODE_DELETED  (1 << 2)
+#define FILE_NODE_REPO     (1 << 3) // Folder holding .git: a nested repository or submodule
+#define FILE_NODE_LISTED   (1 << 4) // Folder whose entries have all been added
+#define FILE_NODE_IGNORED  (1 << 5) // Explorer only: ignored, or read on demand below an ignored or excluded folder
+
+// Git decoration for the explorer, never cached: the GIT_STATUS_* bits of the
+// entry itself, and for a folder those of the files below it
+#define FILE_NODE_GIT_OWN_SHIFT   6
+#define FILE_NODE_GIT_BELOW_SHIFT 9
+#define FILE_NODE_GIT_BITS        0x7
+#define FILE_NODE_GIT_MASK        (0x3f << FILE_NODE_GIT_OWN_SHIFT)
+#define FILE_NODE_GIT_OWN(node)   (((node)->flags >> FILE_NODE_GIT_OWN_SHIFT) & FILE_NODE_GIT_BITS)
+#define FILE_NODE_GIT_BELOW(node) (((node)->flags >> FILE_NODE_GIT_BELOW_SHIFT) & FILE_NODE_GIT_BITS)
+
+typedef struct {
+    FileId parent;
+    guint32 name_off;
+    guint16 name_len;
+    guint16 flags;
+} FileNode;
+
+FileIndex* file_index_new(const char *root);
+void file_index_free(FileIndex *index);
+void file_index_reset(FileIndex *index, const char *root);
+
+// Returns the existing id if the entry is already present
+FileId file_index_add(FileIndex *index, FileId parent, const char *name, guint16 flags);
+FileId file_index_lookup(FileIndex *index, const char *path);
+// Removes the entries and everything below them in a single pass
+void file_index_remove(FileIndex *index, const FileId *ids, guint n_ids);
+// Drops removed entries once they dominate; renumbers ids, so no id may be held
+// across it. Returns the old id -> new id map (FILE_INDEX_NONE for dropped
+// entries), or NULL if nothing moved; free with g_free.
+guint32* file_index_compact(FileIndex *index);
+
+guint file_index_get_count(FileIndex *index); // Upper bound for ids, including removed ones
+const FileNode* file_index_get_node(FileIndex *index, FileId id);
+const char* file_index_get_name(FileIndex *index, FileId id);
+gboolean file_index_is_live(FileIndex *index, FileId id);
+void file_index_get_path(FileIndex *index, FileId id, GString *out);
+
+// Live children of a folder (FILE_INDEX_ROOT for the top level), in no
+// particular order; FILE_INDEX_NONE ends the list
+FileId file_index_get_first_child(FileIndex *index, FileId parent);
+FileId file_index_get_next_sibling(FileIndex *index, FileId id);
+
+// One bit per id, for file_index_get_count() ids
+#define FILE_INDEX_BITSET_WORDS(n) (((n) + 31) / 32)
+#define FILE_INDEX_BIT_TEST(bits, id) (((bits)[(id) >> 5] >> ((id) & 31)) & 1)
+#define FILE_INDEX_BIT_SET(bits, id) ((bits)[(id) >> 5] |= 1u << ((id) & 31))
+
+// Sets the bit of every entry whose name contains query (lowercase ASCII) and
+// of all its ancestors, in a single pass; bits must start zeroed. Returns the
+// number of entries marked. FILE_NODE_IGNORED entries are never marked.
+guint file_index_match_subtrees(FileIndex *index, const char *query, guint32 *bits);
+
+// Folder mtime (ns) as of its last read, 0 if never read; FILE_INDEX_ROOT is the root
+gint64 file_index_get_mtime(FileIndex *index, FileId id);
+void file_index_set_mtime(FileIndex *index, FileId id, gint64 mtime);
+
+// Turn one of the flags a crawl learns about a folder (e.g. FILE_NODE_REPO) on or off
+void file_index_set_flag(FileIndex *index, FileId id, guint16 flag, gboolean on);
+// Returns TRUE if the bits changed; not a change the cache needs to save
+gboolean file_index_set_git(FileIndex *index, FileId id, int own_status, int below_status);
+
+// Persistent copy under the user cache dir. A loaded cache is mapped and used
+// in place until the first change.
+char* file_index_cache_path(const char *root);
+gboolean file_index_load(FileIndex *index, const char *root, const char *cache_path);
+gboolean file_index_save(FileIndex *index, const char *cache_path);
+gboolean file_index_is_modified(FileIndex *index);
+
+#endif // FILE_INDEX_H
@@ -0,0 +1,42 @@
+#ifndef GIT_BLAME_H
+#define GIT_BLAME_H
+
+#include "app_state.h"
+
+// Blame of one file at one commit, filled in range by range from
+// `git blame --incremental` runs. Lines are 0-based lines of the file at
+// that commit. Records are applied as the output streams in, so the first
+// lines can be shown long before git is done with the rest.
+
+typedef struct {
+    char *id;            // Full hex id
+    char *author;
+    gint64 author_time;  // Unix seconds
+    char *summary;       // First line of the message
+} BlameCommit;
+
+typedef struct _BlameFile BlameFile;
+
+// Lines [first, first + count) just got their commit
+typedef void (*BlameFunc)(BlameFile *file, guint first, guint count, gpointer user_data);
+
+BlameFile* blame_file_new(const char *work_tree, const char *rel_path, const char *commit_id, guint line_count);
+BlameFile* blame_file_ref(BlameFile *file);
+void blame_file_unref(BlameFile *file);
+guint blame_file_get_line_count(BlameFile *file);
+
+// NULL until a run has covered the line
+const BlameCommit* blame_file_get(BlameFile *file, guint line);
+
+// Narrow [first, last] to its first and last unblamed lines; FALSE if all are known
+gboolean blame_file_find_missing(BlameFile *file, guint *first, guint *last);
+
+// Blame lines [first, last] in the background, reporting each record through
+// func. done is called once the run ends, whether it finished, failed or was
+// cancelled; FALSE if git could not be started, in which case done is not called.
+gboolean blame_file_run(BlameFile *file, guint first, guint last, BlameFunc func, GDestroyNotify done, gpointer user_data);
+
+// Stop a run in progress at the next chunk of output; what it found so far is kept
+void blame_file_cancel(BlameFile *file);
+
+#endif // GIT_BLAME_H
@@ -0,0 +1,20 @@
+#ifndef GIT_GUTTER_H
+#define GIT_GUTTER_H
+
+#include "app_state.h"
+
+// Added/modified/deleted bars for the open file against its HEAD version.
+// The HEAD copy is read once per file or HEAD change; edits are diffed
+// against it in memory, line by line, as they happen.
+
+void init_git_gutter();
+
+// Re-read the open file's HEAD version, e.g. after a file switch or a commit
+void update_git_gutter();
+
+// Show or hide the blame column; it only runs git blame while shown
+void toggle_git_blame();
+
+void cleanup_git_gutter();
+
+#endif // GIT_GUTTER_H
@@ -0,0 +1,44 @@
+#ifndef GIT_INDEX_H
+#define GIT_INDEX_H
+
+#include "app_state.h"
+
+// Reader for .git/index (versions 2 to 4, split index), used to find tracked
+// files whose worktree copy changed without running git. Extensions other
+// than the split-index link (tree cache, untracked cache, ...) are skipped.
+
+typedef struct {
+    char *path;         // Relative to the worktree root
+    guint32 mode;
+    guchar sha[20];
+    gint64 mtime;       // ns
+    gint64 ctime;       // ns
+    guint32 ino;
+    guint32 size;       // Truncated to 32 bits, as git stores it
+    guint16 flags;      // Stage and assume-valid bits of the on-disk flags
+    guint16 ext_flags;  // skip-worktree and intent-to-add (version 3 and later)
+} GitIndexEntry;
+
+typedef struct _GitIndex GitIndex;
+
+// NULL if the index is missing or not understood
+GitIndex* git_index_read(const char *git_dir);
+void git_index_free(GitIndex *index);
+
+guint git_index_get_count(GitIndex *index);
+const GitIndexEntry* git_index_get_entry(GitIndex *index, guint i);
+
+// Content filters (autocrlf, clean filters) make worktree bytes differ from
+// the blobs, so hashing files is only meaningful when none can apply. Runs
+// git config to see the global and system settings; call it off the main thread.
+gboolean git_index_can_hash_worktree(const char *git_dir, const char *work_tree);
+
+// Relative paths of tracked files whose worktree copy differs from the index,
+// mapped to 'M' (modified) or 'D' (deleted). Files are stat'ed in batches and
+// only those whose stat data moved (or that are racily clean) get hashed.
+// examined receives the set of paths that were compared; gitlinks,
+// intent-to-add, skip-worktree, assume-valid and conflicted entries are not,
+// so their status is only known to git. Blocks; run it off the main thread.
+GHashTable* git_index_find_changes(GitIndex *index, const char *work_tree, GHashTable **examined);
+
+#endif // GIT_INDEX_H
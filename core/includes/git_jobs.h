@@ -0,0 +1,38 @@
+#ifndef GIT_JOBS_H
+#define GIT_JOBS_H
+
+#include "app_state.h"
+
+// Every background git job goes through here. At most one job of each kind
+// runs at a time; requests made while one is running collapse into a single
+// rerun once it ends, held back longer the slower the kind has been running.
+
+typedef enum {
+    GIT_JOB_STATUS,   // Full status of the workspace
+    GIT_JOB_PATHS,    // Status of single files, e.g. just saved
+    GIT_JOB_TRACKED,  // In-process check of tracked files against the index
+    GIT_JOB_BLAME,    // Blame of the lines on screen in the open file
+    GIT_JOB_KIND_COUNT
+} GitJobKind;
+
+// Starts a job; every start must be matched by one git_jobs_done() call
+typedef void (*GitJobFunc)(gpointer user_data);
+
+void git_jobs_register(GitJobKind kind, GitJobFunc start, gpointer user_data);
+
+// Start a job of this kind now, or once more after the running one
+void git_jobs_request(GitJobKind kind);
+void git_jobs_done(GitJobKind kind);
+
+// Drop queued reruns, e.g. when the workspace closes; running jobs still end with git_jobs_done()
+void git_jobs_reset();
+
+// base_s, stretched so that polling never keeps git busy for more than a small share of the time
+guint git_jobs_backoff_s(GitJobKind kind, guint base_s);
+
+// Spawn `git -C folder --no-optional-locks args...` with its stdout on a pipe.
+// The flag keeps git from taking index.lock to refresh stat data, so jobs
+// never race the user's own git commands for it.
+gboolean git_jobs_spawn(const char *folder, const char * const *args, GPid *pid, gint *standard_output, GError **error);
+
+#endif // GIT_JOBS_H
@@ -0,0 +1,26 @@
+#ifndef GIT_POOL_H
+#define GIT_POOL_H
+
+#include "app_state.h"
+
+// Long-lived git helpers for one work tree. Each runs a batch-mode git command
+// (`git cat-file --batch`) fed one request per line over its pipes, so a query
+// costs a pipe round-trip instead of a fork/exec. Helpers start on first use,
+// are respawned if they die, and exit when the pool is restarted or freed.
+
+typedef struct _GitPool GitPool;
+
+GitPool* git_pool_new(const char *work_tree);
+GitPool* git_pool_ref(GitPool *pool);
+void git_pool_unref(GitPool *pool);
+const char* git_pool_get_work_tree(GitPool *pool);
+
+// Stop every helper; the next request starts fresh ones (e.g. after HEAD moved)
+void git_pool_restart(GitPool *pool);
+
+// Contents of an object by any name cat-file accepts ("HEAD:path", an id, ...),
+// NUL terminated; NULL if git has no such object. type, if given, receives
+// "blob", "tree", ... Blocks on the helper, so call it off the main thread.
+guchar* git_pool_cat_file(GitPool *pool, const char *object, gsize *len, char **type);
+
+#endif // GIT_POOL_H
@@ -0,0 +1,39 @@
+#ifndef GIT_REPO_H
+#define GIT_REPO_H
+
+#include "app_state.h"
+
+// Read-only access to a repository's files, without running git: HEAD,
+// loose and packed refs, the branch's upstream from config, and commit
+// objects (loose or packed) to count how far HEAD and its upstream diverged.
+
+typedef struct {
+    char *branch;       // Branch name, or the short commit id when HEAD is detached
+    gboolean detached;
+    char *upstream;     // "remote/branch", NULL when the branch tracks nothing
+    int ahead;          // Commits on HEAD not on the upstream, -1 if unknown
+    int behind;         // Commits on the upstream not on HEAD, -1 if unknown
+} GitHeadInfo;
+
+// The repository may sit above folder, and .git may be a file pointing
+// elsewhere (worktrees, submodules). Returns NULL outside a repository.
+// work_tree, if given, receives the folder holding .git.
+char* git_repo_find_dir(const char *folder, char **work_tree);
+
+// Folder holding refs, objects and config; differs from git_dir for linked worktrees
+char* git_repo_common_dir(const char *git_dir);
+
+// Fills info from git_dir. Walking history for ahead/behind can take a
+// while on large repositories, so call it off the main thread.
+gboolean git_repo_read_head(const char *git_dir, GitHeadInfo *info);
+void git_head_info_clear(GitHeadInfo *info);
+
+// Hex id of the commit HEAD points at; NULL on a branch with no commits yet
+char* git_repo_head_id(const char *git_dir);
+
+// Contents of rel_path (relative to the work tree) in the HEAD commit, NUL
+// terminated; NULL if HEAD has no such file. Reads objects, so call it off
+// the main thread.
+guchar* git_repo_read_head_file(const char *git_dir, const char *rel_path, gsize *len);
+
+#endif // GIT_REPO_H
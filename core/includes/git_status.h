@@ -0,0 +1,35 @@
+#ifndef GIT_STATUS_H
+#define GIT_STATUS_H
+
+#include <glib.h>
+
+// Incremental parser for `git status --porcelain=v2 -z`. Output is fed in
+// whatever chunks the pipe delivers; complete records are reported straight
+// from the fed buffer and only a record split across chunks is copied.
+
+// The two porcelain columns, X (index) and Y (worktree), ' ' when unchanged.
+// Unmerged paths keep git's two-letter codes (UU, AA, DU, ...). 0 is clean.
+typedef guint16 GitFileStatus;
+
+#define GIT_FILE_STATUS(x, y) ((GitFileStatus)(((guchar)(x) << 8) | (guchar)(y)))
+#define GIT_FILE_STATUS_INDEX(status) ((char)((status) >> 8))
+#define GIT_FILE_STATUS_WORKTREE(status) ((char)((status) & 0xFF))
+#define GIT_FILE_CLEAN 0
+#define GIT_FILE_UNTRACKED GIT_FILE_STATUS('?', '?')
+#define GIT_FILE_IGNORED GIT_FILE_STATUS('!', '!')
+
+gboolean git_file_status_is_unmerged(GitFileStatus status);
+
+// path is relative to the work tree and NUL terminated; it only lives for the call.
+// Renames and copies are reported under their new path.
+typedef void (*GitStatusFunc)(const char *path, gsize path_len, GitFileStatus status, gpointer user_data);
+
+typedef struct _GitStatusParser GitStatusParser;
+
+GitStatusParser* git_status_parser_new(GitStatusFunc func, gpointer user_data);
+void git_status_parser_feed(GitStatusParser *parser, const char *data, gsize len);
+// FALSE if the output stopped mid-record or had records the parser did not understand
+gboolean git_status_parser_finish(GitStatusParser *parser);
+void git_status_parser_free(GitStatusParser *parser);
+
+#endif // GIT_STATUS_H
@@ -0,0 +1,18 @@
+#ifndef GUTTER_RENDERER_H
+#define GUTTER_RENDERER_H
+
+#include "app_state.h"
+
+// Gutter column painting git change bars. It holds the hunk ranges of the
+// open file and only looks at them for the lines being drawn, so a refresh
+// swaps one array instead of touching per-line marks.
+
+#define GUTTER_TYPE_RENDERER (gutter_renderer_get_type())
+G_DECLARE_FINAL_TYPE(GutterRenderer, gutter_renderer, GUTTER, RENDERER, GtkSourceGutterRenderer)
+
+GutterRenderer* gutter_renderer_new();
+
+// hunks are DiffHunk (line_diff.h) in order; a reference is taken. NULL clears the column.
+void gutter_renderer_set_hunks(GutterRenderer *renderer, GArray *hunks);
+
+#endif // GUTTER_RENDERER_H
@@ -0,0 +1,30 @@
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include "app_state.h"
+
+// gitignore-style exclusion for a workspace. Sources, lowest precedence first:
+// built-in defaults (only outside git repositories), the repository's
+// info/exclude, every .gitignore from its work tree down to the folder (the
+// root may sit below the work tree), then the workspace override file.
+#define IGNORE_OVERRIDE_FILE ".caecodeignore"
+
+typedef struct _IgnoreMatcher IgnoreMatcher;
+// Rules that apply inside one folder, resolved once per folder read
+typedef struct _IgnoreScope IgnoreScope;
+
+IgnoreMatcher* ignore_matcher_new(const char *root);
+IgnoreMatcher* ignore_matcher_ref(IgnoreMatcher *matcher);
+void ignore_matcher_unref(IgnoreMatcher *matcher);
+
+// Read a folder's .gitignore; dir_fd may be -1. Safe to call from any thread.
+void ignore_matcher_load_dir(IgnoreMatcher *matcher, int dir_fd, const char *dir_path);
+// Loads any .gitignore on the way that no crawl has read yet
+gboolean ignore_matcher_is_ignored(IgnoreMatcher *matcher, const char *path, gboolean is_dir);
+gboolean ignore_matcher_is_rules_file(IgnoreMatcher *matcher, const char *path);
+
+IgnoreScope* ignore_matcher_scope(IgnoreMatcher *matcher, const char *dir_path);
+gboolean ignore_scope_match(IgnoreScope *scope, const char *name, gboolean is_dir);
+void ignore_scope_free(IgnoreScope *scope);
+
+#endif // IGNORE_H
@@ -0,0 +1,35 @@
+#ifndef LINE_DIFF_H
+#define LINE_DIFF_H
+
+#include <glib.h>
+
+// Line-based diff for the git gutter. Lines are interned into small integer
+// ids first, so the diff itself only compares integers.
+
+#define LINE_ID_NONE G_MAXUINT
+
+typedef struct _LineTable LineTable;
+
+LineTable* line_table_new();
+void line_table_free(LineTable *table);
+guint line_table_size(LineTable *table);
+
+// Same text, same id. A trailing '\r' is ignored so CRLF files match their lines.
+guint line_table_intern(LineTable *table, const char *line, gsize len);
+
+// Append the id of every line of text to ids; n newlines make n + 1 lines
+void line_table_split(LineTable *table, const char *text, gsize len, GArray *ids);
+
+// A run of old lines replaced by a run of new lines; 0-based, either count may be 0
+typedef struct {
+    guint old_start;
+    guint old_count;
+    guint new_start;
+    guint new_count;
+} DiffHunk;
+
+// Myers diff; returns the hunks (DiffHunk) in order. Regions too different to
+// be worth a minimal diff come out as a single replacement.
+GArray* line_diff(const guint *old_ids, guint old_n, const guint *new_ids, guint new_n);
+
+#endif // LINE_DIFF_H
@@ -2,15 +2,24 @@
 #define SIDEBAR_H
 
 #include "app_state.h"
+#include "git_pool.h"
 
 void init_sidebar();
+GtkWidget* create_sidebar_filter();
 void open_folder(const char *path);
 void reload_sidebar();
 void close_folder();
 void collapse_all_folders();
 void update_git_status();
+void update_git_status_for_path(const char *path);
 const char* get_git_status_letter(const char *path);
 const char* get_git_branch();
+// New reference to the workspace's git helpers, NULL outside a repository
+GitPool* get_git_pool();
+
+// Saves made by the editor are not reported back as workspace changes
+void expect_self_write(const char *path);
+void confirm_self_write(const char *path, gboolean written);
 
 void cleanup_sidebar();
 
@@ -0,0 +1,72 @@
+#ifndef SIDEBAR_MODEL_H
+#define SIDEBAR_MODEL_H
+
+#include "app_state.h"
+#include "file_index.h"
+
+// Explorer tree model over the workspace FileIndex. Each row is an index
+// entry: the iter holds its FileId, and the rows of a folder are read from
+// the index the first time the view asks for them, then only updated when
+// sidebar_model_refresh() is called for that folder. The path, icon, color
+// and git letter columns are computed when a row is drawn, the last two from
+// the entry's git bits. A visible mask narrows the same rows down while the
+// explorer is filtered.
+
+// Columns
+enum {
+    SIDEBAR_COL_ICON,   // Icon name
+    SIDEBAR_COL_NAME,   // Display name, " *" appended when unsaved
+    SIDEBAR_COL_PATH,   // Full path, NULL for the loading row
+    SIDEBAR_COL_COLOR,  // Git foreground color
+    SIDEBAR_COL_STATUS, // Git status letter
+    SIDEBAR_N_COLUMNS
+};
+
+typedef enum {
+    SIDEBAR_ROW_FILE,
+    SIDEBAR_ROW_DIR,
+    SIDEBAR_ROW_LOADING // Only row of a folder whose entries are not in the index yet
+} SidebarRowKind;
+
+// Bitmasks for Git status
+#define GIT_STATUS_NONE 0
+#define GIT_STATUS_MODIFIED 1
+#define GIT_STATUS_ADDED 2
+#define GIT_STATUS_UNTRACKED 4
+
+#define SIDEBAR_TYPE_MODEL (sidebar_model_get_type())
+G_DECLARE_FINAL_TYPE(SidebarModel, sidebar_model, SIDEBAR, MODEL, GObject)
+
+// The index is borrowed and must outlive the model
+SidebarModel* sidebar_model_new(FileIndex *index);
+
+// Brings the rows of a folder (FILE_INDEX_ROOT for the top level) in line with
+// the index after entries were added to or removed from it, or its
+// FILE_NODE_LISTED flag changed. Only the rows that differ are signalled.
+void sidebar_model_refresh(SidebarModel *model, FileId parent);
+// Drops every row and the visible mask; call it before the index is reset
+void sidebar_model_clear(SidebarModel *model);
+// Follows a file_index_compact() that returned remap for n_old ids
+void sidebar_model_remap(SidebarModel *model, const guint32 *remap, guint n_old);
+
+// Setters only signal a change when the value actually differs. Git status
+// is kept in the entry's FILE_NODE_GIT_* bits, which the color and status
+// columns are drawn from.
+void sidebar_model_set_git(SidebarModel *model, FileId id, int own_status, int below_status);
+void sidebar_model_set_unsaved(SidebarModel *model, FileId id, gboolean unsaved);
+// Redraws the shown rows below a folder, whose color follows an untracked folder
+void sidebar_model_subtree_changed(SidebarModel *model, FileId id);
+
+SidebarRowKind sidebar_model_get_kind(SidebarModel *model, GtkTreeIter *iter);
+// The row's entry; for the loading row, the folder being read
+FileId sidebar_model_get_id(SidebarModel *model, GtkTreeIter *iter);
+char* sidebar_model_get_path(SidebarModel *model, GtkTreeIter *iter);
+// Row of an entry whose ancestors are all shown
+gboolean sidebar_model_lookup_id(SidebarModel *model, FileId id, GtkTreeIter *iter);
+
+// Shows only the entries whose bit is set in visible, which it takes over,
+// or every entry again for NULL; n_ids is the number of ids the bits cover.
+// Only rows whose bit flipped are deleted or inserted.
+void sidebar_model_set_visible(SidebarModel *model, guint32 *visible, guint n_ids);
+
+#endif // SIDEBAR_MODEL_H
@@ -0,0 +1,31 @@
+#ifndef STAT_BATCH_H
+#define STAT_BATCH_H
+
+#include <glib.h>
+#include <sys/types.h>
+
+// Batched metadata lookups. Requests go to the kernel through io_uring (one
+// submission per ring full of statx calls) when it is available, and are
+// spread over a small thread pool of plain stat calls otherwise.
+
+typedef struct {
+    // In
+    int dir_fd;         // Directory fd that path is relative to, AT_FDCWD for absolute paths
+    const char *path;   // Must stay valid until stat_batch_run returns
+    gboolean nofollow;  // Describe a symlink itself rather than its target
+
+    // Out
+    int error;          // 0 on success, errno otherwise
+    mode_t mode;
+    dev_t dev;
+    ino_t ino;
+    gint64 size;
+    gint64 mtime;       // ns
+    gint64 ctime;       // ns
+} StatRequest;
+
+// Fill in every request. Blocks, so only call it off the main thread or for a handful of paths.
+// Safe to call from several threads at once.
+void stat_batch_run(StatRequest *requests, guint n);
+
+#endif // STAT_BATCH_H
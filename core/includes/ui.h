@@ -9,6 +9,8 @@ void update_status_with_unsaved_mark(gboolean is_same);
 void update_status_with_relative_path();
 void update_path_bar();
 void update_advanced_status_bar();
+// Standing message next to the branch, e.g. a watch limit warning; NULL clears it
+void set_status_notice(const char *notice);
 void ui_refresh_terminal_paths(const char *path);
 
 #endif // UI_H
@@ -0,0 +1,27 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include "app_state.h"
+#include "ignore.h"
+
+typedef struct _Watcher Watcher;
+
+// A path was created, deleted or moved somewhere under the workspace (or, for
+// the optional write callback, a file opened for writing was closed)
+typedef void (*WatchChangeFunc)(Watcher *watcher, const char *path, gpointer user_data);
+// Events were lost (queue overflow); everything under path must be re-read
+typedef void (*WatchRescanFunc)(Watcher *watcher, const char *path, gpointer user_data);
+// Watch use is close to max_user_watches, or (exhausted) ran out of it, in
+// which case folders beyond this point are not watched. Each is reported once.
+typedef void (*WatchLimitFunc)(Watcher *watcher, guint used, guint max, gboolean exhausted, gpointer user_data);
+
+// root and ignore may be NULL; on_write and on_limit are optional
+Watcher* watcher_new(const char *root, IgnoreMatcher *ignore, WatchChangeFunc on_change, WatchChangeFunc on_write,
+                     WatchRescanFunc on_rescan, WatchLimitFunc on_limit, gpointer user_data);
+void watcher_add_root(Watcher *watcher, const char *root);
+void watcher_destroy(Watcher *watcher);
+
+guint watcher_get_watch_count(Watcher *watcher);
+guint watcher_get_max_watches();
+
+#endif // WATCHER_H
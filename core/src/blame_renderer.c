@@ -0,0 +1,140 @@
+#include "blame_renderer.h"
+#include "line_diff.h"
+
+#define BLAME_WIDTH_CHARS 40   // Column width; longer annotations are cut
+#define BLAME_AUTHOR_CHARS 16
+
+struct _BlameRenderer {
+    GtkSourceGutterRendererText parent;
+    BlameFile *file;
+    GArray *hunks;        // DiffHunk, by new_start
+    BlameWantFunc want;
+    gpointer want_data;
+};
+
+G_DEFINE_TYPE(BlameRenderer, blame_renderer, GTK_SOURCE_TYPE_GUTTER_RENDERER_TEXT)
+
+// Line of the blamed file a buffer line came from; FALSE for lines added or changed since
+static gboolean blamed_line(BlameRenderer *renderer, guint line, guint *out) {
+    if (!renderer->file || !renderer->hunks) return FALSE;
+
+    // Last hunk starting at or before line
+    guint lo = 0, hi = renderer->hunks->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (g_array_index(renderer->hunks, DiffHunk, mid).new_start <= line) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) {
+        *out = line;
+    } else {
+        const DiffHunk *hunk = &g_array_index(renderer->hunks, DiffHunk, lo - 1);
+        if (line < hunk->new_start + hunk->new_count) return FALSE;
+        *out = line - (hunk->new_start + hunk->new_count) + hunk->old_start + hunk->old_count;
+    }
+    return *out < blame_file_get_line_count(renderer->file);
+}
+
+static const BlameCommit* line_commit(BlameRenderer *renderer, guint line, gboolean want) {
+    guint blamed;
+    if (!blamed_line(renderer, line, &blamed)) return NULL;
+    const BlameCommit *commit = blame_file_get(renderer->file, blamed);
+    if (!commit && want && renderer->want) renderer->want(blamed, renderer->want_data);
+    return commit;
+}
+
+static char* format_age(gint64 time) {
+    static const struct { gint64 seconds; const char *unit; } units[] = {
+        { 365 * 24 * 3600, "year" }, { 30 * 24 * 3600, "month" }, { 7 * 24 * 3600, "week" },
+        { 24 * 3600, "day" }, { 3600, "hour" }, { 60, "minute" }
+    };
+    gint64 age = g_get_real_time() / G_USEC_PER_SEC - time;
+    for (guint i = 0; i < G_N_ELEMENTS(units); i++) {
+        gint64 n = age / units[i].seconds;
+        if (n > 0) return g_strdup_printf("%" G_GINT64_FORMAT " %s%s ago", n, units[i].unit, n > 1 ? "s" : "");
+    }
+    return g_strdup("just now");
+}
+
+static char* format_commit(const BlameCommit *commit) {
+    char *author = g_utf8_substring(commit->author ? commit->author : "", 0, BLAME_AUTHOR_CHARS);
+    char *age = format_age(commit->author_time);
+    char *full = g_strdup_printf("%s, %s  %s", author, age, commit->summary ? commit->summary : "");
+    char *text = g_utf8_strlen(full, -1) > BLAME_WIDTH_CHARS ? g_utf8_substring(full, 0, BLAME_WIDTH_CHARS) : g_strdup(full);
+    g_free(full);
+    g_free(age);
+    g_free(author);
+    return text;
+}
+
+static void blame_renderer_query_data(GtkSourceGutterRenderer *base, GtkTextIter *start, GtkTextIter *end,
+                                      GtkSourceGutterRendererState state) {
+    BlameRenderer *renderer = BLAME_RENDERER(base);
+    GtkSourceGutterRendererText *text_renderer = GTK_SOURCE_GUTTER_RENDERER_TEXT(base);
+    guint line = gtk_text_iter_get_line(start);
+    const BlameCommit *commit = line_commit(renderer, line, TRUE);
+
+    // A run of lines from one commit is only labelled on its first line
+    if (!commit || (line > 0 && line_commit(renderer, line - 1, FALSE) == commit)) {
+        gtk_source_gutter_renderer_text_set_text(text_renderer, "", -1);
+        return;
+    }
+    char *text = format_commit(commit);
+    gtk_source_gutter_renderer_text_set_text(text_renderer, text, -1);
+    g_free(text);
+}
+
+// Text can only be measured once the renderer is in a view
+static void blame_renderer_change_view(GtkSourceGutterRenderer *base, GtkTextView *old_view) {
+    GtkSourceGutterRendererClass *parent = GTK_SOURCE_GUTTER_RENDERER_CLASS(blame_renderer_parent_class);
+    if (parent->change_view) parent->change_view(base, old_view);
+    if (!gtk_source_gutter_renderer_get_view(base)) return;
+
+    char *widest = g_strnfill(BLAME_WIDTH_CHARS, '0');
+    gint width = 0;
+    gtk_source_gutter_renderer_text_measure(GTK_SOURCE_GUTTER_RENDERER_TEXT(base), widest, &width, NULL);
+    g_free(widest);
+    gtk_source_gutter_renderer_set_size(base, width);
+}
+
+static void blame_renderer_finalize(GObject *object) {
+    BlameRenderer *renderer = BLAME_RENDERER(object);
+    blame_file_unref(renderer->file);
+    if (renderer->hunks) g_array_unref(renderer->hunks);
+    G_OBJECT_CLASS(blame_renderer_parent_class)->finalize(object);
+}
+
+static void blame_renderer_class_init(BlameRendererClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = blame_renderer_finalize;
+    GTK_SOURCE_GUTTER_RENDERER_CLASS(klass)->query_data = blame_renderer_query_data;
+    GTK_SOURCE_GUTTER_RENDERER_CLASS(klass)->change_view = blame_renderer_change_view;
+}
+
+static void blame_renderer_init(BlameRenderer *renderer) {
+}
+
+BlameRenderer* blame_renderer_new(BlameWantFunc want, gpointer user_data) {
+    BlameRenderer *renderer = g_object_new(BLAME_TYPE_RENDERER, NULL);
+    renderer->want = want;
+    renderer->want_data = user_data;
+
+    GtkSourceGutterRenderer *base = GTK_SOURCE_GUTTER_RENDERER(renderer);
+    gtk_source_gutter_renderer_set_alignment(base, 0.0, 0.5);
+    gtk_source_gutter_renderer_set_padding(base, 6, -1);
+    return renderer;
+}
+
+void blame_renderer_set_file(BlameRenderer *renderer, BlameFile *file) {
+    if (file == renderer->file) return;
+    if (file) blame_file_ref(file);
+    blame_file_unref(renderer->file);
+    renderer->file = file;
+    gtk_source_gutter_renderer_queue_draw(GTK_SOURCE_GUTTER_RENDERER(renderer));
+}
+
+void blame_renderer_set_hunks(BlameRenderer *renderer, GArray *hunks) {
+    if (hunks) g_array_ref(hunks);
+    if (renderer->hunks) g_array_unref(renderer->hunks);
+    renderer->hunks = hunks;
+    gtk_source_gutter_renderer_queue_draw(GTK_SOURCE_GUTTER_RENDERER(renderer));
+}
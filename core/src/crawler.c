@@ -0,0 +1,373 @@
+#include "crawler.h"
+#include "ignore.h"
+#include "stat_batch.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <string.h>
+#include <unistd.h>
+
+// Main-thread time allowed per idle dispatch, so redraws and input keep flowing
+#define CRAWL_FRAME_BUDGET_US 4000
+#define CRAWL_MAX_THREADS 4
+#define CRAWL_DENTS_BUF_SIZE 32768
+
+// Record layout returned by getdents64
+struct linux_dirent64 {
+    guint64 d_ino;
+    gint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} DirId;
+
+typedef struct {
+    char *path;
+    gpointer tag;
+} CrawlJob;
+
+struct _Crawler {
+    GThreadPool *pool;
+    GAsyncQueue *results;
+    CrawlBatch *current;
+    guint pending;          // Directories queued but not yet consumed (main thread only)
+    gint cancelled;         // Read by workers
+    gint drain_scheduled;
+    gatomicrefcount ref_count;
+    GHashTable *visited;    // DirId* of every folder read, to spot symlinks back into them
+    GHashTable *read_paths; // Path of every folder read -> its DirId*, to spot loops
+    GMutex visited_lock;    // Guards both
+    IgnoreMatcher *ignore;  // Optional; flags ignored entries
+
+    CrawlEntryFunc on_entry;
+    CrawlBatchFunc on_batch_done;
+    CrawlDoneFunc on_finished;
+    GDestroyNotify tag_free;
+    gpointer user_data;
+};
+
+// Hidden folders are never listed; hidden files are
+gboolean crawler_is_listed(const char *name, gboolean is_dir) {
+    return !(is_dir && name[0] == '.');
+}
+
+static guint dir_id_hash(gconstpointer key) {
+    const DirId *id = (const DirId *)key;
+    return (guint)(id->ino ^ (id->ino >> 32) ^ (id->dev * 31));
+}
+
+static gboolean dir_id_equal(gconstpointer a, gconstpointer b) {
+    const DirId *ia = (const DirId *)a;
+    const DirId *ib = (const DirId *)b;
+    return ia->ino == ib->ino && ia->dev == ib->dev;
+}
+
+// Record a folder about to be read. FALSE if it is the very folder one of
+// the ancestors on its own path was read as: a bind mount or other loop that
+// getdents64 reports as a plain folder. A folder that can also be reached
+// under some other path (a symlink to a sibling) is not a loop. Parents are
+// always read before their folders are queued, so the chain is complete
+// from wherever the walk started.
+static gboolean claim_visited(Crawler *crawler, dev_t dev, ino_t ino, const char *path) {
+    DirId key = { dev, ino };
+    char *ancestor = g_strdup(path);
+    gboolean loop = FALSE;
+    g_mutex_lock(&crawler->visited_lock);
+    for (char *slash = strrchr(ancestor, '/'); !loop && slash && slash > ancestor; slash = strrchr(ancestor, '/')) {
+        *slash = '\0';
+        const DirId *seen = g_hash_table_lookup(crawler->read_paths, ancestor);
+        loop = seen && dir_id_equal(seen, &key);
+    }
+    if (!loop) {
+        DirId *id = g_new(DirId, 1);
+        *id = key;
+        g_hash_table_replace(crawler->read_paths, g_strdup(path), id);
+        id = g_new(DirId, 1);
+        *id = key;
+        g_hash_table_add(crawler->visited, id);
+    }
+    g_mutex_unlock(&crawler->visited_lock);
+    g_free(ancestor);
+    return !loop;
+}
+
+static gboolean was_visited(Crawler *crawler, dev_t dev, ino_t ino) {
+    DirId id = { dev, ino };
+    g_mutex_lock(&crawler->visited_lock);
+    gboolean found = g_hash_table_contains(crawler->visited, &id);
+    g_mutex_unlock(&crawler->visited_lock);
+    return found;
+}
+
+static Crawler* crawler_ref(Crawler *crawler) {
+    g_atomic_ref_count_inc(&crawler->ref_count);
+    return crawler;
+}
+
+static void crawler_free_batch(Crawler *crawler, CrawlBatch *batch) {
+    if (batch->tag && crawler->tag_free) crawler->tag_free(batch->tag);
+    g_ptr_array_free(batch->entries, TRUE);
+    g_free(batch->path);
+    g_free(batch);
+}
+
+static void crawler_unref(gpointer data) {
+    Crawler *crawler = (Crawler *)data;
+    if (!g_atomic_ref_count_dec(&crawler->ref_count)) return;
+
+    CrawlBatch *batch;
+    if (crawler->current) crawler_free_batch(crawler, crawler->current);
+    while ((batch = g_async_queue_try_pop(crawler->results))) {
+        crawler_free_batch(crawler, batch);
+    }
+    g_async_queue_unref(crawler->results);
+    g_hash_table_destroy(crawler->visited);
+    g_hash_table_destroy(crawler->read_paths);
+    if (crawler->ignore) ignore_matcher_unref(crawler->ignore);
+    g_mutex_clear(&crawler->visited_lock);
+    g_free(crawler);
+}
+
+static void free_entry(gpointer data) {
+    CrawlEntry *entry = (CrawlEntry *)data;
+    g_free(entry->name);
+    g_free(entry);
+}
+
+static gint compare_entries(gconstpointer a, gconstpointer b) {
+    const CrawlEntry *ea = *(const CrawlEntry **)a;
+    const CrawlEntry *eb = *(const CrawlEntry **)b;
+    if (ea->is_dir != eb->is_dir) return ea->is_dir ? -1 : 1;
+    return g_ascii_strcasecmp(ea->name, eb->name);
+}
+
+static gboolean crawler_drain(gpointer data);
+
+// open() fails with ENAMETOOLONG past PATH_MAX, so walk such paths one component at a time
+static int open_dir(const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0 || errno != ENAMETOOLONG || path[0] != '/') return fd;
+
+    fd = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    gchar **parts = g_strsplit(path + 1, "/", -1);
+    for (int i = 0; fd >= 0 && parts[i]; i++) {
+        if (parts[i][0] == '\0') continue;
+        int next = openat(fd, parts[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        close(fd);
+        fd = next;
+    }
+    g_strfreev(parts);
+    return fd;
+}
+
+static void read_entries(Crawler *crawler, int fd, GPtrArray *entries, gboolean *has_gitignore, gboolean *has_git) {
+    char *buf = g_malloc(CRAWL_DENTS_BUF_SIZE);
+    GArray *unknown = g_array_new(FALSE, FALSE, sizeof(guint)); // Entries whose type needs a stat
+    GArray *links = g_array_new(FALSE, FALSE, sizeof(gboolean));
+    long len;
+
+    while ((len = syscall(SYS_getdents64, fd, buf, CRAWL_DENTS_BUF_SIZE)) > 0) {
+        for (long pos = 0; pos < len; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + pos);
+            pos += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            // Never listed as a folder, but it marks a nested repository or submodule
+            if (strcmp(name, ".git") == 0) *has_git = TRUE;
+
+            // d_type answers most entries without a stat; symlinks and
+            // filesystems that report DT_UNKNOWN are stat'ed together below
+            gboolean is_dir = d->d_type == DT_DIR;
+            if (d->d_type == DT_UNKNOWN || d->d_type == DT_LNK) {
+                gboolean is_link = d->d_type == DT_LNK;
+                g_array_append_val(unknown, entries->len);
+                g_array_append_val(links, is_link);
+            } else {
+                if (!crawler_is_listed(name, is_dir)) continue;
+                if (strcmp(name, ".gitignore") == 0) *has_gitignore = TRUE;
+            }
+
+            CrawlEntry *ce = g_new0(CrawlEntry, 1);
+            ce->name = g_strdup(name);
+            ce->is_dir = is_dir;
+            g_ptr_array_add(entries, ce);
+        }
+    }
+    g_free(buf);
+
+    if (unknown->len > 0) {
+        StatRequest *requests = g_new0(StatRequest, unknown->len);
+        for (guint i = 0; i < unknown->len; i++) {
+            CrawlEntry *ce = g_ptr_array_index(entries, g_array_index(unknown, guint, i));
+            requests[i].dir_fd = fd;
+            requests[i].path = ce->name;
+        }
+        stat_batch_run(requests, unknown->len);
+
+        // Backwards, so removing an entry never moves one still to be resolved
+        for (guint i = unknown->len; i-- > 0; ) {
+            guint index = g_array_index(unknown, guint, i);
+            CrawlEntry *ce = g_ptr_array_index(entries, index);
+            gboolean listed = requests[i].error == 0; // Dangling symlinks are left out
+            if (listed) {
+                ce->is_dir = S_ISDIR(requests[i].mode);
+                // A symlink back into a folder already read would recurse forever
+                ce->is_excluded = ce->is_dir && g_array_index(links, gboolean, i) &&
+                                  was_visited(crawler, requests[i].dev, requests[i].ino);
+                listed = crawler_is_listed(ce->name, ce->is_dir);
+            }
+            if (!listed) {
+                g_ptr_array_remove_index_fast(entries, index);
+                continue;
+            }
+            if (strcmp(ce->name, ".gitignore") == 0) *has_gitignore = TRUE;
+        }
+        g_free(requests);
+    }
+    g_array_free(unknown, TRUE);
+    g_array_free(links, TRUE);
+}
+
+// Rules of this folder's own .gitignore apply to its entries, so it is loaded first
+static void apply_ignore_rules(Crawler *crawler, int fd, CrawlBatch *batch, gboolean has_gitignore) {
+    if (has_gitignore) ignore_matcher_load_dir(crawler->ignore, fd, batch->path);
+
+    IgnoreScope *scope = ignore_matcher_scope(crawler->ignore, batch->path);
+    for (guint i = 0; i < batch->entries->len; i++) {
+        CrawlEntry *entry = g_ptr_array_index(batch->entries, i);
+        entry->is_ignored = ignore_scope_match(scope, entry->name, entry->is_dir);
+        if (entry->is_ignored && entry->is_dir) entry->is_excluded = TRUE;
+    }
+    ignore_scope_free(scope);
+}
+
+// Worker thread: read one directory and hand the sorted batch to the main loop
+static void crawl_worker(gpointer job_data, gpointer pool_data) {
+    CrawlJob *job = (CrawlJob *)job_data;
+    Crawler *crawler = (Crawler *)pool_data;
+
+    CrawlBatch *batch = g_new0(CrawlBatch, 1);
+    batch->path = job->path;
+    batch->tag = job->tag;
+    batch->entries = g_ptr_array_new_with_free_func(free_entry);
+    g_free(job);
+
+    int fd = g_atomic_int_get(&crawler->cancelled) ? -1 : open_dir(batch->path);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            batch->is_loop = !claim_visited(crawler, st.st_dev, st.st_ino, batch->path);
+            batch->mtime = STAT_MTIME_NS(st);
+        }
+
+        if (!batch->is_loop) {
+            gboolean has_gitignore = FALSE;
+            read_entries(crawler, fd, batch->entries, &has_gitignore, &batch->has_git);
+            if (crawler->ignore) apply_ignore_rules(crawler, fd, batch, has_gitignore);
+            g_ptr_array_sort(batch->entries, compare_entries);
+        }
+        close(fd);
+    }
+
+    // Always deliver a batch (even an empty one) so the main thread can account for it
+    g_async_queue_push(crawler->results, batch);
+    if (g_atomic_int_compare_and_exchange(&crawler->drain_scheduled, 0, 1)) {
+        g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, crawler_drain, crawler_ref(crawler), crawler_unref);
+    }
+    crawler_unref(crawler);
+}
+
+// Main thread: feed batches to the consumer until the frame budget is spent
+static gboolean crawler_drain(gpointer data) {
+    Crawler *crawler = (Crawler *)data;
+    gint64 deadline = g_get_monotonic_time() + CRAWL_FRAME_BUDGET_US;
+    guint handled = 0;
+
+    while (!g_atomic_int_get(&crawler->cancelled)) {
+        if (!crawler->current) {
+            crawler->current = g_async_queue_try_pop(crawler->results);
+            if (!crawler->current) {
+                g_atomic_int_set(&crawler->drain_scheduled, 0);
+                // A worker may have pushed right before the flag was cleared
+                if (g_async_queue_length(crawler->results) > 0 &&
+                    g_atomic_int_compare_and_exchange(&crawler->drain_scheduled, 0, 1)) {
+                    continue;
+                }
+                return G_SOURCE_REMOVE;
+            }
+        }
+
+        CrawlBatch *batch = crawler->current;
+        while (batch->cursor < batch->entries->len) {
+            CrawlEntry *entry = g_ptr_array_index(batch->entries, batch->cursor++);
+            crawler->on_entry(crawler, batch, entry, crawler->user_data);
+            if (g_atomic_int_get(&crawler->cancelled)) return G_SOURCE_REMOVE;
+            if ((++handled & 31) == 0 && g_get_monotonic_time() >= deadline) return G_SOURCE_CONTINUE;
+        }
+
+        if (crawler->on_batch_done) crawler->on_batch_done(crawler, batch, crawler->user_data);
+        crawler->current = NULL;
+        crawler_free_batch(crawler, batch);
+        crawler->pending--;
+
+        if (crawler->pending == 0 && crawler->on_finished) {
+            crawler->on_finished(crawler, crawler->user_data);
+        }
+        if (g_get_monotonic_time() >= deadline) return G_SOURCE_CONTINUE;
+    }
+    return G_SOURCE_REMOVE;
+}
+
+Crawler* crawler_new(CrawlEntryFunc on_entry, CrawlBatchFunc on_batch_done, CrawlDoneFunc on_finished,
+                     GDestroyNotify tag_free, gpointer user_data) {
+    Crawler *crawler = g_new0(Crawler, 1);
+    g_atomic_ref_count_init(&crawler->ref_count);
+    crawler->results = g_async_queue_new();
+    crawler->visited = g_hash_table_new_full(dir_id_hash, dir_id_equal, g_free, NULL);
+    crawler->read_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    g_mutex_init(&crawler->visited_lock);
+    crawler->on_entry = on_entry;
+    crawler->on_batch_done = on_batch_done;
+    crawler->on_finished = on_finished;
+    crawler->tag_free = tag_free;
+    crawler->user_data = user_data;
+
+    gint threads = CLAMP((gint)g_get_num_processors(), 1, CRAWL_MAX_THREADS);
+    crawler->pool = g_thread_pool_new(crawl_worker, crawler, threads, FALSE, NULL);
+    return crawler;
+}
+
+// Must be called before the first folder is queued
+void crawler_set_ignore(Crawler *crawler, IgnoreMatcher *matcher) {
+    crawler->ignore = ignore_matcher_ref(matcher);
+}
+
+void crawler_queue_dir(Crawler *crawler, const char *path, gpointer tag) {
+    CrawlJob *job = g_new0(CrawlJob, 1);
+    job->path = g_strdup(path);
+    job->tag = tag;
+    crawler->pending++;
+    crawler_ref(crawler); // Held by the job until the worker is done with it
+    g_thread_pool_push(crawler->pool, job, NULL);
+}
+
+gboolean crawler_is_busy(Crawler *crawler) {
+    return crawler && crawler->pending > 0;
+}
+
+void crawler_destroy(Crawler *crawler) {
+    if (!crawler) return;
+    g_atomic_int_set(&crawler->cancelled, 1);
+    // Queued jobs still run, but see the flag and return immediately
+    g_thread_pool_free(crawler->pool, FALSE, FALSE);
+    crawler->pool = NULL;
+    crawler_unref(crawler);
+}
@@ -3,7 +3,7 @@
 #include "sidebar.h"
 #include "ui.h"
 #include "file_ops.h"
-#include <gio/gunixinputstream.h>
+#include "git_gutter.h"
 
 static guint autosave_timeout_id = 0;
 
@@ -15,105 +15,7 @@ static gboolean on_autosave_timer(gpointer data) {
     return FALSE;
 }
 
-static GdkPixbuf *create_color_bar_pixbuf(const char *color_str) {
-    GdkRGBA rgba;
-    gdk_rgba_parse(&rgba, color_str);
-    GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, 3, 24);
-    // Fill with RBGA: R << 24 | G << 16 | B << 8 | A
-    guint32 pixel = ((guint8)(rgba.red * 255) << 24) |
-                    ((guint8)(rgba.green * 255) << 16) |
-                    ((guint8)(rgba.blue * 255) << 8) |
-                    ((guint8)(rgba.alpha * 255));
-    gdk_pixbuf_fill(pixbuf, pixel);
-    return pixbuf;
-}
-
-static void on_git_gutter_child_watch(GPid pid, gint status, gpointer user_data) {
-    g_spawn_close_pid(pid);
-}
-
-static void on_git_gutter_spliced(GObject *source, GAsyncResult *res, gpointer user_data) {
-    GOutputStream *out = G_OUTPUT_STREAM(source);
-    GError *splice_err = NULL;
-    if (g_output_stream_splice_finish(out, res, &splice_err) >= 0) {
-        gsize size = g_memory_output_stream_get_data_size(G_MEMORY_OUTPUT_STREAM(out));
-        if (size > 0) {
-            char *output = g_strndup(g_memory_output_stream_get_data(G_MEMORY_OUTPUT_STREAM(out)), size);
-            char **lines = g_strsplit(output, "\n", -1);
-            
-            gboolean is_diff = (g_strstr_len(output, size, "diff --git") != NULL);
-            if (!is_diff && size < 50) { 
-            }
-            
-            for (int i = 0; lines[i]; i++) {
-                if (g_str_has_prefix(lines[i], "@@")) {
-                    int old_line, old_count, new_line, new_count;
-                    old_count = 1; new_count = 1; 
-    
-                    if (sscanf(lines[i], "@@ -%d,%d +%d,%d @@", &old_line, &old_count, &new_line, &new_count) >= 2 ||
-                        sscanf(lines[i], "@@ -%d +%d,%d @@", &old_line, &new_line, &new_count) >= 2 ||
-                        sscanf(lines[i], "@@ -%d,%d +%d @@", &old_line, &old_count, &new_line) >= 2 ||
-                        sscanf(lines[i], "@@ -%d +%d @@", &old_line, &new_line) >= 2) {
-                        
-                        const char *category = (old_count == 0) ? "git-added" : "git-modified";
-                        if (new_count == 0 && old_count > 0) category = "git-deleted";
-    
-                        int start_line = (new_line > 0) ? new_line - 1 : 0;
-                        int count = (new_count > 0) ? new_count : 1;
-    
-                        for (int j = 0; j < count; j++) {
-                            GtkTextIter iter;
-                            gtk_text_buffer_get_iter_at_line(GTK_TEXT_BUFFER(text_buffer), &iter, start_line + j);
-                            gtk_source_buffer_create_source_mark(text_buffer, NULL, category, &iter);
-                        }
-                    }
-                }
-            }
-            g_strfreev(lines);
-            g_free(output);
-        }
-    }
-    if (splice_err) g_error_free(splice_err);
-    g_object_unref(out);
-}
-
-void update_git_gutter() {
-    if (strlen(current_file) == 0 || strlen(current_folder) == 0) return;
-
-    // Clear existing git marks
-    GtkTextIter start, end;
-    gtk_text_buffer_get_bounds(GTK_TEXT_BUFFER(text_buffer), &start, &end);
-    gtk_source_buffer_remove_source_marks(text_buffer, &start, &end, "git-added");
-    gtk_source_buffer_remove_source_marks(text_buffer, &start, &end, "git-modified");
-    gtk_source_buffer_remove_source_marks(text_buffer, &start, &end, "git-deleted");
-
-    char *diff_cmd[] = { "git", "-C", current_folder, "diff", "-U0", "HEAD", "--", current_file, NULL };
-    gint standard_output;
-    GPid pid;
-    GError *err = NULL;
-
-    if (g_spawn_async_with_pipes(current_folder, diff_cmd, NULL, G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH, NULL, NULL, &pid, NULL, &standard_output, NULL, &err)) {
-        GInputStream *stream = g_unix_input_stream_new(standard_output, TRUE);
-        GOutputStream *mem_stream = g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
-        
-        g_output_stream_splice_async(mem_stream, stream, G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET, 
-            G_PRIORITY_DEFAULT, NULL, on_git_gutter_spliced, NULL);
-            
-        g_object_unref(stream);
-        g_child_watch_add(pid, on_git_gutter_child_watch, NULL);
-    } else {
-        if (err) g_error_free(err);
-    }
-}
-
 static const char *themes[] = { "caecode-dark", "caecode-light" };
-static guint gutter_timeout_id = 0;
-
-static gboolean debounced_gutter_update(gpointer data) {
-    gutter_timeout_id = 0;
-    update_git_gutter();
-    return FALSE;
-}
 
 static gboolean is_system_dark_mode() {
     gboolean prefer_dark = FALSE;
@@ -180,6 +82,7 @@ void apply_theme(int index) {
             "#sidebar-title { font-size: 9pt; font-weight: bold; color: %s; opacity: 0.6; }"
             "#sidebar-header button { opacity: 0.6; }"
             "#sidebar-header button:hover { opacity: 1.0; }"
+            "#sidebar-filter { font-size: 9pt; min-height: 26px; }"
             "#path-bar { background-color: %s; border-bottom: 1px solid %s; }"
             "#path-label { font-size: 8.5pt; color: %s; opacity: 0.7; }"
             "treeview { padding-bottom: 100px; }"
@@ -280,27 +183,6 @@ void init_editor() {
     // Initial theme setup
     theme_manager = gtk_source_style_scheme_manager_get_default();
     
-    // Configure gutter for git marks
-    gtk_source_view_set_show_line_marks(source_view, TRUE);
-    
-    GtkSourceMarkAttributes *added_attr = gtk_source_mark_attributes_new();
-    GdkPixbuf *added_pb = create_color_bar_pixbuf("#73C991");
-    gtk_source_mark_attributes_set_pixbuf(added_attr, added_pb);
-    g_object_unref(added_pb);
-    gtk_source_view_set_mark_attributes(source_view, "git-added", added_attr, 0);
-
-    GtkSourceMarkAttributes *modified_attr = gtk_source_mark_attributes_new();
-    GdkPixbuf *mod_pb = create_color_bar_pixbuf("#3584e4");
-    gtk_source_mark_attributes_set_pixbuf(modified_attr, mod_pb);
-    g_object_unref(mod_pb);
-    gtk_source_view_set_mark_attributes(source_view, "git-modified", modified_attr, 0);
-
-    GtkSourceMarkAttributes *deleted_attr = gtk_source_mark_attributes_new();
-    GdkPixbuf *del_pb = create_color_bar_pixbuf("#F85149");
-    gtk_source_mark_attributes_set_pixbuf(deleted_attr, del_pb);
-    g_object_unref(del_pb);
-    gtk_source_view_set_mark_attributes(source_view, "git-deleted", deleted_attr, 0);
-    
     // Add local themes path (development)
     char *cwd = g_get_current_dir();
     char *local_theme_path = g_build_filename(cwd, "core", "themes", NULL);
@@ -341,6 +223,7 @@ void init_editor() {
     g_signal_connect(settings, "notify::gtk-theme-name", G_CALLBACK(on_system_theme_changed), NULL);
 
     g_signal_connect(text_buffer, "changed", G_CALLBACK(on_text_changed), NULL);
+    init_git_gutter(); // Marks follow edits on their own
 }
 
 void on_text_changed(GtkTextBuffer *buffer, gpointer user_data) {
@@ -374,10 +257,6 @@ void on_text_changed(GtkTextBuffer *buffer, gpointer user_data) {
     // Real-time Git Status update (Sidebar coloring)
     // Removed because sidebar polling handles directory changes, and typing fires this too often.
 
-    // Debounced gutter update
-    if (gutter_timeout_id > 0) g_source_remove(gutter_timeout_id);
-    gutter_timeout_id = g_timeout_add(300, debounced_gutter_update, NULL);
-
     // Debounced AutoSave (1 second)
     if (autosave_timeout_id > 0) g_source_remove(autosave_timeout_id);
     autosave_timeout_id = g_timeout_add(1000, on_autosave_timer, NULL);
@@ -390,8 +269,5 @@ void cleanup_editor() {
         g_source_remove(autosave_timeout_id);
         autosave_timeout_id = 0;
     }
-    if (gutter_timeout_id > 0) {
-        g_source_remove(gutter_timeout_id);
-        gutter_timeout_id = 0;
-    }
+    cleanup_git_gutter();
 }
@@ -0,0 +1,582 @@
+#include "file_index.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SLOT_EMPTY G_MAXUINT32
+#define SLOT_TOMBSTONE (G_MAXUINT32 - 1)
+#define MIN_SLOTS 1024
+
+// On-disk cache: header, root path, folder mtimes, nodes, then the names
+// arena, each section 8-byte aligned so the file can be used in place
+#define CACHE_MAGIC "CAEIDX\0\0"
+#define CACHE_VERSION 3
+
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 node_size;  // sizeof(FileNode), catches layout changes between builds
+    guint32 n_nodes;
+    guint32 root_len;
+    guint64 names_len;
+    gint64 root_mtime;
+} CacheHeader;
+
+struct _FileIndex {
+    char *root;
+    FileNode *nodes;
+    guint n_nodes;
+    guint nodes_cap;
+    guint n_deleted;
+
+    char *names;        // NUL-terminated names, back to back
+    gsize names_len;
+    gsize names_cap;
+
+    gint64 *mtimes;     // Per node; folder mtime in ns when it was last read, else 0
+    gint64 root_mtime;
+
+    FileId *first_child;  // Per node; child lists, rebuilt on load instead of cached
+    FileId *next_sibling;
+    guint links_cap;
+    FileId root_first_child;
+
+    guint32 *slots;     // Open-addressed (parent, name) -> id table
+    guint n_slots;      // Power of two, kept at most half full
+    guint n_used;       // Live ids plus tombstones
+
+    gpointer map;       // Cache file the arrays above point into, until the first change
+    gsize map_len;
+    gboolean modified;  // Changed since it was last loaded or saved
+};
+
+#define ALIGN8(n) (((n) + 7) & ~(gsize)7)
+
+// A loaded cache is used read-only in place; copy it out before writing to it
+static void unmap_cache(FileIndex *index) {
+    if (!index->map) return;
+
+    index->nodes_cap = MAX(index->n_nodes, 4096);
+    FileNode *nodes = g_new(FileNode, index->nodes_cap);
+    memcpy(nodes, index->nodes, index->n_nodes * sizeof(FileNode));
+    gint64 *mtimes = g_new(gint64, index->nodes_cap);
+    memcpy(mtimes, index->mtimes, index->n_nodes * sizeof(gint64));
+    index->names_cap = MAX(index->names_len, 65536);
+    char *names = g_malloc(index->names_cap);
+    memcpy(names, index->names, index->names_len);
+
+    munmap(index->map, index->map_len);
+    index->map = NULL;
+    index->nodes = nodes;
+    index->mtimes = mtimes;
+    index->names = names;
+}
+
+// Before any change the cache has to save
+static void detach_map(FileIndex *index) {
+    index->modified = TRUE;
+    unmap_cache(index);
+}
+
+static void release_arrays(FileIndex *index) {
+    if (index->map) {
+        munmap(index->map, index->map_len);
+        index->map = NULL;
+        index->nodes = NULL;
+        index->mtimes = NULL;
+        index->names = NULL;
+    }
+    g_clear_pointer(&index->nodes, g_free);
+    g_clear_pointer(&index->mtimes, g_free);
+    g_clear_pointer(&index->names, g_free);
+    g_clear_pointer(&index->first_child, g_free);
+    g_clear_pointer(&index->next_sibling, g_free);
+    index->nodes_cap = 0;
+    index->names_cap = 0;
+    index->links_cap = 0;
+    index->root_first_child = FILE_INDEX_NONE;
+}
+
+static void link_child(FileIndex *index, FileId id) {
+    if (id >= index->links_cap) {
+        index->links_cap = MAX(index->links_cap * 2, MAX(id + 1, 4096));
+        index->first_child = g_renew(FileId, index->first_child, index->links_cap);
+        index->next_sibling = g_renew(FileId, index->next_sibling, index->links_cap);
+    }
+    FileId parent = index->nodes[id].parent;
+    FileId *head = parent == FILE_INDEX_ROOT ? &index->root_first_child : &index->first_child[parent];
+    index->first_child[id] = FILE_INDEX_NONE;
+    index->next_sibling[id] = *head;
+    *head = id;
+}
+
+static void link_children(FileIndex *index) {
+    index->root_first_child = FILE_INDEX_NONE;
+    for (FileId id = 0; id < index->n_nodes; id++) link_child(index, id);
+}
+
+static guint32 hash_entry(FileId parent, const char *name, gsize len) {
+    // FNV-1a over the name, seeded with the parent
+    guint32 h = 2166136261u ^ parent;
+    for (gsize i = 0; i < len; i++) {
+        h ^= (guchar)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static gint64 find_slot(FileIndex *index, FileId parent, const char *name, gsize len) {
+    guint mask = index->n_slots - 1;
+    guint i = hash_entry(parent, name, len) & mask;
+
+    for (;;) {
+        guint32 id = index->slots[i];
+        if (id == SLOT_EMPTY) return -1;
+        if (id != SLOT_TOMBSTONE) {
+            const FileNode *node = &index->nodes[id];
+            if (node->parent == parent && node->name_len == len &&
+                memcmp(index->names + node->name_off, name, len) == 0) {
+                return i;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static void insert_slot(FileIndex *index, FileId id) {
+    const FileNode *node = &index->nodes[id];
+    guint mask = index->n_slots - 1;
+    guint i = hash_entry(node->parent, index->names + node->name_off, node->name_len) & mask;
+
+    while (index->slots[i] != SLOT_EMPTY && index->slots[i] != SLOT_TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    if (index->slots[i] == SLOT_EMPTY) index->n_used++;
+    index->slots[i] = id;
+}
+
+// Rebuild the lookup table sized for the live entries, dropping tombstones
+static void rehash(FileIndex *index, guint extra) {
+    guint needed = (index->n_nodes - index->n_deleted + extra) * 4;
+    guint size = MIN_SLOTS;
+    while (size < needed) size <<= 1;
+
+    g_free(index->slots);
+    index->slots = g_new(guint32, size);
+    memset(index->slots, 0xff, size * sizeof(guint32)); // SLOT_EMPTY
+    index->n_slots = size;
+    index->n_used = 0;
+
+    for (FileId id = 0; id < index->n_nodes; id++) {
+        if (!(index->nodes[id].flags & FILE_NODE_DELETED)) insert_slot(index, id);
+    }
+}
+
+FileIndex* file_index_new(const char *root) {
+    FileIndex *index = g_new0(FileIndex, 1);
+    file_index_reset(index, root);
+    return index;
+}
+
+void file_index_free(FileIndex *index) {
+    if (!index) return;
+    release_arrays(index);
+    g_free(index->root);
+    g_free(index->slots);
+    g_free(index);
+}
+
+void file_index_reset(FileIndex *index, const char *root) {
+    g_free(index->root);
+    index->root = g_strdup(root);
+    index->n_nodes = 0;
+    index->n_deleted = 0;
+    index->names_len = 0;
+    index->root_mtime = 0;
+    index->modified = FALSE;
+
+    // Give back the memory of a previous large workspace
+    release_arrays(index);
+    rehash(index, 0);
+}
+
+FileId file_index_add(FileIndex *index, FileId parent, const char *name, guint16 flags) {
+    if (parent != FILE_INDEX_ROOT && !file_index_is_live(index, parent)) return FILE_INDEX_NONE;
+
+    gsize len = strlen(name);
+    gint64 slot = find_slot(index, parent, name, len);
+    if (slot >= 0) return index->slots[slot];
+
+    detach_map(index);
+    if ((index->n_used + 1) * 2 > index->n_slots) rehash(index, 1);
+
+    if (index->names_len + len + 1 > index->names_cap) {
+        index->names_cap = MAX(index->names_cap * 2, MAX(index->names_len + len + 1, 65536));
+        index->names = g_realloc(index->names, index->names_cap);
+    }
+    if (index->n_nodes == index->nodes_cap) {
+        index->nodes_cap = MAX(index->nodes_cap * 2, 4096);
+        index->nodes = g_renew(FileNode, index->nodes, index->nodes_cap);
+        index->mtimes = g_renew(gint64, index->mtimes, index->nodes_cap);
+    }
+
+    FileId id = index->n_nodes++;
+    FileNode *node = &index->nodes[id];
+    node->parent = parent;
+    node->name_off = (guint32)index->names_len;
+    node->name_len = (guint16)len;
+    node->flags = flags & ~FILE_NODE_DELETED;
+    index->mtimes[id] = 0;
+    memcpy(index->names + index->names_len, name, len + 1);
+    index->names_len += len + 1;
+
+    insert_slot(index, id);
+    link_child(index, id);
+    return id;
+}
+
+FileId file_index_lookup(FileIndex *index, const char *path) {
+    size_t root_len = strlen(index->root);
+    if (strncmp(path, index->root, root_len) != 0 || path[root_len] != '/') return FILE_INDEX_NONE;
+
+    FileId id = FILE_INDEX_ROOT;
+    const char *p = path + root_len;
+    while (*p) {
+        while (*p == '/') p++;
+        const char *end = strchr(p, '/');
+        if (!end) end = p + strlen(p);
+        if (end == p) break;
+
+        gint64 slot = find_slot(index, id, p, end - p);
+        if (slot < 0) return FILE_INDEX_NONE;
+        id = index->slots[slot];
+        p = end;
+    }
+    return id == FILE_INDEX_ROOT ? FILE_INDEX_NONE : id;
+}
+
+static void delete_node(FileIndex *index, FileId id) {
+    FileNode *node = &index->nodes[id];
+    gint64 slot = find_slot(index, node->parent, index->names + node->name_off, node->name_len);
+    if (slot >= 0) index->slots[slot] = SLOT_TOMBSTONE;
+    node->flags |= FILE_NODE_DELETED;
+    index->n_deleted++;
+}
+
+void file_index_remove(FileIndex *index, const FileId *ids, guint n_ids) {
+    if (n_ids == 0) return;
+    detach_map(index);
+
+    FileId first = index->n_nodes;
+    for (guint i = 0; i < n_ids; i++) {
+        if (!file_index_is_live(index, ids[i])) continue;
+        delete_node(index, ids[i]);
+        first = MIN(first, ids[i]);
+    }
+
+    // Children always come after their parent, so one forward pass takes whole subtrees
+    for (FileId id = first + 1; id < index->n_nodes; id++) {
+        FileNode *node = &index->nodes[id];
+        if (!(node->flags & FILE_NODE_DELETED) && node->parent != FILE_INDEX_ROOT &&
+            (index->nodes[node->parent].flags & FILE_NODE_DELETED)) {
+            delete_node(index, id);
+        }
+    }
+}
+
+guint32* file_index_compact(FileIndex *index) {
+    if (index->n_deleted == 0 || index->n_deleted * 2 < index->n_nodes) return NULL;
+    detach_map(index);
+
+    guint32 *remap = g_new(guint32, index->n_nodes);
+    char *names = g_malloc(MAX(index->names_cap, 1));
+    gsize names_len = 0;
+    guint live = 0;
+
+    for (FileId id = 0; id < index->n_nodes; id++) {
+        FileNode node = index->nodes[id];
+        if (node.flags & FILE_NODE_DELETED) {
+            remap[id] = FILE_INDEX_NONE;
+            continue;
+        }
+        memcpy(names + names_len, index->names + node.name_off, node.name_len + 1);
+        node.name_off = (guint32)names_len;
+        names_len += node.name_len + 1;
+        if (node.parent != FILE_INDEX_ROOT) node.parent = remap[node.parent];
+
+        remap[id] = live;
+        index->mtimes[live] = index->mtimes[id];
+        index->nodes[live++] = node;
+    }
+
+    g_free(index->names);
+    index->names = names;
+    index->names_len = names_len;
+    index->n_nodes = live;
+    index->n_deleted = 0;
+    rehash(index, 0);
+    link_children(index);
+    return remap;
+}
+
+guint file_index_get_count(FileIndex *index) {
+    return index ? index->n_nodes : 0;
+}
+
+const FileNode* file_index_get_node(FileIndex *index, FileId id) {
+    return &index->nodes[id];
+}
+
+const char* file_index_get_name(FileIndex *index, FileId id) {
+    return index->names + index->nodes[id].name_off;
+}
+
+gboolean file_index_is_live(FileIndex *index, FileId id) {
+    return id < index->n_nodes && !(index->nodes[id].flags & FILE_NODE_DELETED);
+}
+
+static FileId skip_removed(FileIndex *index, FileId id) {
+    while (id != FILE_INDEX_NONE && (index->nodes[id].flags & FILE_NODE_DELETED)) {
+        id = index->next_sibling[id];
+    }
+    return id;
+}
+
+FileId file_index_get_first_child(FileIndex *index, FileId parent) {
+    if (parent == FILE_INDEX_ROOT) return skip_removed(index, index->root_first_child);
+    if (!file_index_is_live(index, parent)) return FILE_INDEX_NONE;
+    return skip_removed(index, index->first_child[parent]);
+}
+
+FileId file_index_get_next_sibling(FileIndex *index, FileId id) {
+    return skip_removed(index, index->next_sibling[id]);
+}
+
+static void append_components(FileIndex *index, FileId id, GString *out) {
+    const FileNode *node = &index->nodes[id];
+    if (node->parent != FILE_INDEX_ROOT) append_components(index, node->parent, out);
+    if (out->len == 0 || out->str[out->len - 1] != '/') g_string_append_c(out, '/');
+    g_string_append_len(out, index->names + node->name_off, node->name_len);
+}
+
+void file_index_get_path(FileIndex *index, FileId id, GString *out) {
+    g_string_assign(out, index->root);
+    append_components(index, id, out);
+}
+
+static guchar ascii_fold[256]; // Lowercase lookup, filled on first use
+
+static gboolean name_contains(const char *name, gsize len, const char *query, gsize query_len) {
+    if (query_len == 0) return TRUE;
+    if (query_len > len) return FALSE;
+    const guchar *n = (const guchar *)name;
+    const guchar *q = (const guchar *)query;
+    for (gsize i = 0; i + query_len <= len; i++) {
+        if (ascii_fold[n[i]] != q[0]) continue;
+        gsize j = 1;
+        while (j < query_len && ascii_fold[n[i + j]] == q[j]) j++;
+        if (j == query_len) return TRUE;
+    }
+    return FALSE;
+}
+
+guint file_index_match_subtrees(FileIndex *index, const char *query, guint32 *bits) {
+    gsize query_len = strlen(query);
+    guint marked = 0;
+    if (ascii_fold['A'] == 0) {
+        for (int c = 0; c < 256; c++) ascii_fold[c] = g_ascii_tolower(c);
+    }
+
+    // Children always come after their parent, so walking backwards has every
+    // child's bit settled before its parent is looked at
+    for (FileId id = index->n_nodes; id-- > 0;) {
+        const FileNode *node = &index->nodes[id];
+        if (node->flags & (FILE_NODE_DELETED | FILE_NODE_IGNORED)) continue;
+
+        if (!FILE_INDEX_BIT_TEST(bits, id) &&
+            !name_contains(index->names + node->name_off, node->name_len, query, query_len)) {
+            continue;
+        }
+        FILE_INDEX_BIT_SET(bits, id);
+        if (node->parent != FILE_INDEX_ROOT) FILE_INDEX_BIT_SET(bits, node->parent);
+        marked++;
+    }
+    return marked;
+}
+
+gint64 file_index_get_mtime(FileIndex *index, FileId id) {
+    if (id == FILE_INDEX_ROOT) return index->root_mtime;
+    return file_index_is_live(index, id) ? index->mtimes[id] : 0;
+}
+
+void file_index_set_mtime(FileIndex *index, FileId id, gint64 mtime) {
+    if (id == FILE_INDEX_ROOT) {
+        if (index->root_mtime != mtime) index->modified = TRUE;
+        index->root_mtime = mtime;
+        return;
+    }
+    if (!file_index_is_live(index, id) || index->mtimes[id] == mtime) return;
+    detach_map(index);
+    index->mtimes[id] = mtime;
+}
+
+void file_index_set_flag(FileIndex *index, FileId id, guint16 flag, gboolean on) {
+    if (!file_index_is_live(index, id) || ((index->nodes[id].flags & flag) != 0) == on) return;
+    detach_map(index);
+    if (on) index->nodes[id].flags |= flag;
+    else index->nodes[id].flags &= ~flag;
+}
+
+gboolean file_index_set_git(FileIndex *index, FileId id, int own_status, int below_status) {
+    if (!file_index_is_live(index, id)) return FALSE;
+    guint16 bits = (own_status & FILE_NODE_GIT_BITS) << FILE_NODE_GIT_OWN_SHIFT |
+                   (below_status & FILE_NODE_GIT_BITS) << FILE_NODE_GIT_BELOW_SHIFT;
+    if ((index->nodes[id].flags & FILE_NODE_GIT_MASK) == bits) return FALSE;
+    unmap_cache(index);
+    index->nodes[id].flags = (index->nodes[id].flags & ~FILE_NODE_GIT_MASK) | bits;
+    return TRUE;
+}
+
+gboolean file_index_is_modified(FileIndex *index) {
+    return index && index->modified;
+}
+
+char* file_index_cache_path(const char *root) {
+    char *digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, root, -1);
+    char *name = g_strconcat(digest, ".idx", NULL);
+    char *path = g_build_filename(g_get_user_cache_dir(), "caecode", "index", name, NULL);
+    g_free(name);
+    g_free(digest);
+    return path;
+}
+
+static gboolean write_padding(FILE *f, gsize len) {
+    static const char zeros[8] = {0};
+    gsize pad = ALIGN8(len) - len;
+    return pad == 0 || fwrite(zeros, 1, pad, f) == pad;
+}
+
+static gboolean write_padded(FILE *f, const void *data, gsize len) {
+    if (len > 0 && fwrite(data, 1, len, f) != len) return FALSE;
+    return write_padding(f, len);
+}
+
+// Git bits are worked out afresh each session, so they are left out
+static gboolean write_nodes(FILE *f, const FileNode *nodes, guint n_nodes) {
+    FileNode chunk[1024];
+    for (guint i = 0; i < n_nodes; i += G_N_ELEMENTS(chunk)) {
+        guint n = MIN(n_nodes - i, G_N_ELEMENTS(chunk));
+        for (guint j = 0; j < n; j++) {
+            chunk[j] = nodes[i + j];
+            chunk[j].flags &= ~FILE_NODE_GIT_MASK;
+        }
+        if (fwrite(chunk, sizeof(FileNode), n, f) != n) return FALSE;
+    }
+    return write_padding(f, n_nodes * sizeof(FileNode));
+}
+
+gboolean file_index_save(FileIndex *index, const char *cache_path) {
+    if (!index->root || index->root[0] == '\0') return FALSE;
+
+    char *dir = g_path_get_dirname(cache_path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    // Written aside and renamed over, so a reader never maps a half-written file
+    char *tmp_path = g_strconcat(cache_path, ".tmp", NULL);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        g_free(tmp_path);
+        return FALSE;
+    }
+
+    CacheHeader header = {0};
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.node_size = sizeof(FileNode);
+    header.n_nodes = index->n_nodes;
+    header.root_len = strlen(index->root);
+    header.names_len = index->names_len;
+    header.root_mtime = index->root_mtime;
+
+    gboolean ok = write_padded(f, &header, sizeof(header)) &&
+                  write_padded(f, index->root, header.root_len + 1) &&
+                  write_padded(f, index->mtimes, index->n_nodes * sizeof(gint64)) &&
+                  write_nodes(f, index->nodes, index->n_nodes) &&
+                  write_padded(f, index->names, index->names_len);
+    ok = (fclose(f) == 0) && ok;
+    ok = ok && rename(tmp_path, cache_path) == 0;
+    if (!ok) unlink(tmp_path);
+    g_free(tmp_path);
+
+    if (ok) index->modified = FALSE;
+    return ok;
+}
+
+// Reject anything that could make lookups or path building read out of bounds
+static gboolean validate_cache(const guint8 *data, gsize len, const char *root) {
+    if (len < sizeof(CacheHeader)) return FALSE;
+    const CacheHeader *header = (const CacheHeader *)data;
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0) return FALSE;
+    if (header->version != CACHE_VERSION || header->node_size != sizeof(FileNode)) return FALSE;
+    if (header->root_len != strlen(root)) return FALSE;
+
+    gsize root_off = ALIGN8(sizeof(CacheHeader));
+    gsize mtimes_off = root_off + ALIGN8((gsize)header->root_len + 1);
+    gsize nodes_off = mtimes_off + ALIGN8((gsize)header->n_nodes * sizeof(gint64));
+    gsize names_off = nodes_off + ALIGN8((gsize)header->n_nodes * sizeof(FileNode));
+    if (header->names_len > G_MAXUINT32 || names_off + ALIGN8(header->names_len) != len) return FALSE;
+    if (memcmp(data + root_off, root, header->root_len + 1) != 0) return FALSE;
+
+    const FileNode *nodes = (const FileNode *)(data + nodes_off);
+    const char *names = (const char *)(data + names_off);
+    for (FileId id = 0; id < header->n_nodes; id++) {
+        const FileNode *node = &nodes[id];
+        if (node->parent != FILE_INDEX_ROOT && node->parent >= id) return FALSE;
+        if ((guint64)node->name_off + node->name_len >= header->names_len) return FALSE;
+        if (names[node->name_off + node->name_len] != '\0') return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean file_index_load(FileIndex *index, const char *root, const char *cache_path) {
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return FALSE;
+
+    struct stat st;
+    gpointer map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return FALSE;
+
+    if (!validate_cache(map, st.st_size, root)) {
+        munmap(map, st.st_size);
+        return FALSE;
+    }
+
+    file_index_reset(index, root);
+    const CacheHeader *header = (const CacheHeader *)map;
+    gsize mtimes_off = ALIGN8(sizeof(CacheHeader)) + ALIGN8((gsize)header->root_len + 1);
+    gsize nodes_off = mtimes_off + ALIGN8((gsize)header->n_nodes * sizeof(gint64));
+    gsize names_off = nodes_off + ALIGN8((gsize)header->n_nodes * sizeof(FileNode));
+
+    index->map = map;
+    index->map_len = st.st_size;
+    index->mtimes = (gint64 *)((guint8 *)map + mtimes_off);
+    index->nodes = (FileNode *)((guint8 *)map + nodes_off);
+    index->names = (char *)map + names_off;
+    index->n_nodes = header->n_nodes;
+    index->names_len = header->names_len;
+    index->root_mtime = header->root_mtime;
+    for (FileId id = 0; id < index->n_nodes; id++) {
+        if (index->nodes[id].flags & FILE_NODE_DELETED) index->n_deleted++;
+    }
+    rehash(index, 0);
+    link_children(index);
+    return TRUE;
+}
@@ -3,6 +3,7 @@
 #include <sys/stat.h>
 #include "sidebar.h"
 #include "editor.h"
+#include "git_gutter.h"
 #include "ui.h"
 
 typedef struct {
@@ -57,7 +58,6 @@ static void on_file_loaded(GObject *src, GAsyncResult *res, gpointer user_data)
 
     mark_unsaved_file(ctx->path, FALSE);
     update_status_with_unsaved_mark(TRUE);
-    update_git_status();
     update_git_gutter();
     show_editor_view();
 
@@ -79,6 +79,7 @@ static void on_file_saved(GObject *src, GAsyncResult *res, gpointer user_data) {
     SaveCtx *ctx = (SaveCtx *)user_data;
     GError *err = NULL;
     if (!g_file_replace_contents_finish(G_FILE(src), res, NULL, &err)) {
+        confirm_self_write(ctx->path, FALSE);
         if (err) {
             set_status_message(err->message);
             g_error_free(err);
@@ -92,12 +93,12 @@ static void on_file_saved(GObject *src, GAsyncResult *res, gpointer user_data) {
     
     // Use the path from the context to ensure the correct file is marked
     mark_unsaved_file(ctx->path, FALSE);
+    confirm_self_write(ctx->path, TRUE); // Also refreshes the file's git status
     
     // Only update status if the saved file is the currently active one
     if (strcmp(ctx->path, current_file) == 0) {
         update_status_with_unsaved_mark(TRUE);
         update_path_bar();
-        update_git_status();
     }
 
     g_free(ctx->path);
@@ -120,6 +121,7 @@ void save_file() {
     ctx->path = g_strdup(current_file);
     ctx->content = text; // Take ownership of the text buffer string
 
+    expect_self_write(ctx->path);
     GFile *gf = g_file_new_for_path(ctx->path);
     g_file_replace_contents_async(gf,
         ctx->content, strlen(ctx->content),
@@ -0,0 +1,231 @@
+#include "git_blame.h"
+#include "git_jobs.h"
+#include <stdio.h>
+#include <string.h>
+#include <gio/gunixinputstream.h>
+
+#define BLAME_READ_SIZE (16 * 1024)
+
+typedef struct _BlameRun BlameRun;
+
+struct _BlameFile {
+    gint ref_count;
+    char *work_tree;
+    char *rel_path;
+    char *commit_id;
+    guint line_count;
+    BlameCommit **lines;    // Per line, NULL until blamed; owned by commits
+    GHashTable *commits;    // Id -> BlameCommit*
+    BlameRun *run;          // Run in progress, if any
+};
+
+// One `git blame --incremental` being read. Each record is a header line
+// "<id> <orig line> <final line> <count>", commit fields ("author ...",
+// "summary ...") the first time a commit shows up, and "filename ..." last.
+struct _BlameRun {
+    BlameFile *file;
+    GInputStream *stream;
+    GByteArray *carry;      // Start of a line the last chunk cut off
+    BlameCommit *commit;    // Commit of the record being read, NULL between records
+    guint final_line;       // 1-based, as git reports it
+    guint count;
+    gboolean cancelled;
+    BlameFunc func;
+    GDestroyNotify done;
+    gpointer user_data;
+    char buffer[BLAME_READ_SIZE];
+};
+
+static void blame_commit_free(gpointer data) {
+    BlameCommit *commit = (BlameCommit *)data;
+    g_free(commit->id);
+    g_free(commit->author);
+    g_free(commit->summary);
+    g_free(commit);
+}
+
+BlameFile* blame_file_new(const char *work_tree, const char *rel_path, const char *commit_id, guint line_count) {
+    BlameFile *file = g_new0(BlameFile, 1);
+    file->ref_count = 1;
+    file->work_tree = g_strdup(work_tree);
+    file->rel_path = g_strdup(rel_path);
+    file->commit_id = g_strdup(commit_id);
+    file->line_count = line_count;
+    file->lines = g_new0(BlameCommit *, MAX(line_count, 1));
+    file->commits = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, blame_commit_free);
+    return file;
+}
+
+BlameFile* blame_file_ref(BlameFile *file) {
+    file->ref_count++;
+    return file;
+}
+
+// A running blame holds a reference, so this never frees a file mid-run
+void blame_file_unref(BlameFile *file) {
+    if (!file || --file->ref_count > 0) return;
+    g_free(file->work_tree);
+    g_free(file->rel_path);
+    g_free(file->commit_id);
+    g_free(file->lines);
+    g_hash_table_destroy(file->commits);
+    g_free(file);
+}
+
+guint blame_file_get_line_count(BlameFile *file) {
+    return file->line_count;
+}
+
+const BlameCommit* blame_file_get(BlameFile *file, guint line) {
+    return line < file->line_count ? file->lines[line] : NULL;
+}
+
+gboolean blame_file_find_missing(BlameFile *file, guint *first, guint *last) {
+    if (file->line_count == 0 || *first >= file->line_count) return FALSE;
+    guint lo = *first;
+    guint hi = MIN(*last, file->line_count - 1);
+    while (lo <= hi && file->lines[lo]) lo++;
+    if (lo > hi) return FALSE;
+    while (file->lines[hi]) hi--;
+    *first = lo;
+    *last = hi;
+    return TRUE;
+}
+
+// ---- Reading output ----
+
+static gboolean is_hex(const char *p, gsize len) {
+    for (gsize i = 0; i < len; i++) {
+        if (!g_ascii_isxdigit(p[i])) return FALSE;
+    }
+    return TRUE;
+}
+
+static void parse_header(BlameRun *run, const char *line, gsize len) {
+    const char *space = memchr(line, ' ', len);
+    if (!space || !is_hex(line, space - line)) return;
+    char fields[64];
+    gsize fields_len = MIN((gsize)(line + len - space - 1), sizeof(fields) - 1);
+    memcpy(fields, space + 1, fields_len);
+    fields[fields_len] = '\0';
+    guint orig_line;
+    if (sscanf(fields, "%u %u %u", &orig_line, &run->final_line, &run->count) != 3) return;
+
+    char *id = g_strndup(line, space - line);
+    BlameCommit *commit = g_hash_table_lookup(run->file->commits, id);
+    if (commit) {
+        g_free(id);
+    } else {
+        commit = g_new0(BlameCommit, 1);
+        commit->id = id;
+        g_hash_table_insert(run->file->commits, commit->id, commit);
+    }
+    run->commit = commit;
+}
+
+static void finish_record(BlameRun *run) {
+    BlameFile *file = run->file;
+    guint first = run->final_line > 0 ? run->final_line - 1 : 0;
+    guint count = first < file->line_count ? MIN(run->count, file->line_count - first) : 0;
+    for (guint i = first; i < first + count; i++) file->lines[i] = run->commit;
+    run->commit = NULL;
+    if (count > 0) run->func(file, first, count, run->user_data);
+}
+
+static void parse_line(BlameRun *run, const char *line, gsize len) {
+    if (!run->commit) {
+        parse_header(run, line, len);
+        return;
+    }
+    // Fields are only sent the first time a commit appears in a run; earlier runs may have filled them
+    BlameCommit *commit = run->commit;
+    if (len > 7 && memcmp(line, "author ", 7) == 0) {
+        if (!commit->author) commit->author = g_strndup(line + 7, len - 7);
+    } else if (len > 12 && memcmp(line, "author-time ", 12) == 0) {
+        char *value = g_strndup(line + 12, len - 12);
+        commit->author_time = g_ascii_strtoll(value, NULL, 10);
+        g_free(value);
+    } else if (len > 8 && memcmp(line, "summary ", 8) == 0) {
+        if (!commit->summary) commit->summary = g_strndup(line + 8, len - 8);
+    } else if (len >= 8 && memcmp(line, "filename", 8) == 0) {
+        finish_record(run);
+    }
+}
+
+// Complete lines are parsed where they lie; only one cut off by the chunk end is copied
+static void feed(BlameRun *run, const char *data, gsize len) {
+    const char *p = data;
+    const char *end = data + len;
+    const char *nl;
+    if (run->carry->len > 0) {
+        nl = memchr(p, '\n', len);
+        if (!nl) {
+            g_byte_array_append(run->carry, (const guint8 *)p, len);
+            return;
+        }
+        g_byte_array_append(run->carry, (const guint8 *)p, nl - p);
+        parse_line(run, (const char *)run->carry->data, run->carry->len);
+        g_byte_array_set_size(run->carry, 0);
+        p = nl + 1;
+    }
+    while ((nl = memchr(p, '\n', end - p))) {
+        parse_line(run, p, nl - p);
+        p = nl + 1;
+    }
+    if (p < end) g_byte_array_append(run->carry, (const guint8 *)p, end - p);
+}
+
+static void blame_run_free(BlameRun *run) {
+    if (run->file->run == run) run->file->run = NULL;
+    g_input_stream_close(run->stream, NULL, NULL);
+    g_object_unref(run->stream);
+    g_byte_array_free(run->carry, TRUE);
+    if (run->done) run->done(run->user_data);
+    blame_file_unref(run->file);
+    g_free(run);
+}
+
+static void on_blame_read(GObject *source, GAsyncResult *res, gpointer user_data) {
+    BlameRun *run = (BlameRun *)user_data;
+    gssize n = g_input_stream_read_finish(G_INPUT_STREAM(source), res, NULL);
+    if (n <= 0 || run->cancelled) {
+        blame_run_free(run);
+        return;
+    }
+    feed(run, run->buffer, n);
+    g_input_stream_read_async(run->stream, run->buffer, sizeof(run->buffer), G_PRIORITY_DEFAULT, NULL, on_blame_read, run);
+}
+
+static void on_blame_child_watch(GPid pid, gint status, gpointer user_data) {
+    g_spawn_close_pid(pid);
+}
+
+gboolean blame_file_run(BlameFile *file, guint first, guint last, BlameFunc func, GDestroyNotify done, gpointer user_data) {
+    char *range = g_strdup_printf("%u,%u", first + 1, last + 1);
+    const char *args[] = { "blame", "--incremental", "-L", range, file->commit_id, "--", file->rel_path, NULL };
+    gint standard_output;
+    GPid pid;
+    GError *err = NULL;
+    gboolean spawned = git_jobs_spawn(file->work_tree, args, &pid, &standard_output, &err);
+    g_free(range);
+    if (!spawned) {
+        if (err) g_error_free(err);
+        return FALSE;
+    }
+
+    BlameRun *run = g_new0(BlameRun, 1);
+    run->file = blame_file_ref(file);
+    run->stream = g_unix_input_stream_new(standard_output, TRUE);
+    run->carry = g_byte_array_new();
+    run->func = func;
+    run->done = done;
+    run->user_data = user_data;
+    file->run = run;
+    g_input_stream_read_async(run->stream, run->buffer, sizeof(run->buffer), G_PRIORITY_DEFAULT, NULL, on_blame_read, run);
+    g_child_watch_add(pid, on_blame_child_watch, NULL);
+    return TRUE;
+}
+
+void blame_file_cancel(BlameFile *file) {
+    if (file && file->run) file->run->cancelled = TRUE;
+}
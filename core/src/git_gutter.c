@@ -0,0 +1,389 @@
+#include "git_gutter.h"
+#include "git_repo.h"
+#include "git_pool.h"
+#include "sidebar.h"
+#include "line_diff.h"
+#include "gutter_renderer.h"
+#include "git_blame.h"
+#include "blame_renderer.h"
+#include "git_jobs.h"
+#include <string.h>
+
+#define GUTTER_BINARY_PROBE 8000  // Git's own binary check looks this far for a NUL
+#define BLAME_MARGIN_LINES 100    // Blamed beyond the lines on screen, so scrolling finds them ready
+#define BLAME_CACHE_SIZE 16       // Files whose blame is kept after switching away
+
+// HEAD side, NULL while the open file has no HEAD version
+static char *head_path = NULL;      // File the HEAD copy belongs to
+static char *head_text = NULL;
+static gsize head_len = 0;
+static GArray *head_lines = NULL;   // Line ids of head_text
+static gint head_serial = 0;        // Bumped to orphan an in-flight HEAD read
+
+// Buffer side, kept in step with every insert and delete
+static GArray *buffer_lines = NULL; // One id per buffer line, LINE_ID_NONE until re-read
+static LineTable *line_table = NULL;
+
+static GArray *shown_hunks = NULL;  // What the gutter currently shows
+static GutterRenderer *gutter_renderer = NULL;
+static guint gutter_idle_id = 0;
+
+// Blame of the open file's HEAD version, NULL without one
+static BlameFile *blame_file = NULL;
+static BlameRenderer *blame_renderer = NULL;
+static GHashTable *blame_cache = NULL;  // "<commit>:<path>" -> BlameFile*
+static GQueue *blame_cache_order = NULL; // Keys, most recently used first
+static gboolean blame_wanted = FALSE;   // Lines on screen lack blame; blame_want_* is their range
+static guint blame_want_first = 0;
+static guint blame_want_last = 0;
+static guint blame_want_idle_id = 0;
+static guint blame_run_records = 0;     // Records the running blame has delivered
+static gboolean blame_unavailable = FALSE; // Git had no blame for the open file; don't keep asking
+
+static gboolean same_hunks(GArray *a, GArray *b) {
+    if (!a || !b) return a == b;
+    return a->len == b->len && memcmp(a->data, b->data, a->len * sizeof(DiffHunk)) == 0;
+}
+
+static void show_hunks(GArray *hunks) {
+    if (same_hunks(hunks, shown_hunks)) {
+        if (hunks) g_array_unref(hunks);
+        return;
+    }
+    if (shown_hunks) g_array_unref(shown_hunks);
+    shown_hunks = hunks;
+    gutter_renderer_set_hunks(gutter_renderer, hunks);
+    blame_renderer_set_hunks(blame_renderer, hunks);
+}
+
+// Interning every variant of every edited line grows the table without bound;
+// start over once it is mostly garbage
+static void reset_line_table() {
+    line_table_free(line_table);
+    line_table = line_table_new();
+    if (head_lines) {
+        g_array_set_size(head_lines, 0);
+        line_table_split(line_table, head_text, head_len, head_lines);
+    }
+    for (guint i = 0; i < buffer_lines->len; i++) g_array_index(buffer_lines, guint, i) = LINE_ID_NONE;
+}
+
+static void read_stale_lines() {
+    GtkTextBuffer *buffer = GTK_TEXT_BUFFER(text_buffer);
+    for (guint i = 0; i < buffer_lines->len; i++) {
+        if (g_array_index(buffer_lines, guint, i) != LINE_ID_NONE) continue;
+        GtkTextIter start, end;
+        gtk_text_buffer_get_iter_at_line(buffer, &start, i);
+        end = start;
+        if (!gtk_text_iter_ends_line(&end)) gtk_text_iter_forward_to_line_end(&end);
+        char *text = gtk_text_buffer_get_text(buffer, &start, &end, TRUE);
+        g_array_index(buffer_lines, guint, i) = line_table_intern(line_table, text, strlen(text));
+        g_free(text);
+    }
+}
+
+static gboolean refresh_gutter(gpointer data) {
+    gutter_idle_id = 0;
+    if (!head_lines || strlen(current_file) == 0) {
+        show_hunks(NULL);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (line_table_size(line_table) > 4 * (head_lines->len + buffer_lines->len) + 1024) reset_line_table();
+    read_stale_lines();
+    show_hunks(line_diff((const guint *)head_lines->data, head_lines->len,
+                         (const guint *)buffer_lines->data, buffer_lines->len));
+    return G_SOURCE_REMOVE;
+}
+
+// Ahead of redraws, so the bars change in the same frame as the text
+static void schedule_gutter_refresh() {
+    if (gutter_idle_id == 0) gutter_idle_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE, refresh_gutter, NULL, NULL);
+}
+
+// ---- Tracking edits ----
+
+// Both handlers run after the buffer changed. Lines the edit touched get
+// re-read on the next refresh; the ids of all other lines stay valid.
+static void on_insert_text(GtkTextBuffer *buffer, GtkTextIter *location, gchar *text, gint len, gpointer user_data) {
+    guint added = gtk_text_buffer_get_line_count(buffer) - buffer_lines->len;
+    guint first = gtk_text_iter_get_line(location) - added;
+    g_array_index(buffer_lines, guint, first) = LINE_ID_NONE;
+    if (added > 0) {
+        g_array_set_size(buffer_lines, buffer_lines->len + added);
+        guint *ids = (guint *)buffer_lines->data;
+        memmove(ids + first + 1 + added, ids + first + 1, (buffer_lines->len - added - first - 1) * sizeof(guint));
+        for (guint i = first + 1; i <= first + added; i++) ids[i] = LINE_ID_NONE;
+    }
+}
+
+static void on_delete_range(GtkTextBuffer *buffer, GtkTextIter *start, GtkTextIter *end, gpointer user_data) {
+    guint removed = buffer_lines->len - gtk_text_buffer_get_line_count(buffer);
+    guint line = gtk_text_iter_get_line(start);
+    g_array_index(buffer_lines, guint, line) = LINE_ID_NONE;
+    if (removed > 0) g_array_remove_range(buffer_lines, line + 1, removed);
+}
+
+static void on_buffer_changed(GtkTextBuffer *buffer, gpointer user_data) {
+    if (head_lines || shown_hunks) schedule_gutter_refresh();
+}
+
+// ---- Blame ----
+
+static void on_lines_blamed(BlameFile *file, guint first, guint count, gpointer user_data) {
+    blame_run_records++;
+    if (file == blame_file) gtk_source_gutter_renderer_queue_draw(GTK_SOURCE_GUTTER_RENDERER(blame_renderer));
+}
+
+// user_data is the BlameFile the run was for
+static void on_blame_done(gpointer user_data) {
+    if (user_data == blame_file && blame_run_records == 0) blame_unavailable = TRUE;
+    git_jobs_done(GIT_JOB_BLAME);
+}
+
+// Blames the missing lines of what was on screen when the job got its turn
+static void start_blame(gpointer data) {
+    guint first = blame_want_first > BLAME_MARGIN_LINES ? blame_want_first - BLAME_MARGIN_LINES : 0;
+    guint last = blame_want_last + BLAME_MARGIN_LINES;
+    gboolean wanted = blame_wanted;
+    blame_wanted = FALSE;
+
+    blame_run_records = 0;
+    if (!wanted || !blame_file || blame_unavailable || !blame_file_find_missing(blame_file, &first, &last) ||
+        !blame_file_run(blame_file, first, last, on_lines_blamed, on_blame_done, blame_file)) {
+        git_jobs_done(GIT_JOB_BLAME);
+    }
+}
+
+// Lines are collected over a whole redraw before asking for them
+static gboolean request_blame(gpointer data) {
+    blame_want_idle_id = 0;
+    git_jobs_request(GIT_JOB_BLAME);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_blame_wanted(guint line, gpointer user_data) {
+    if (blame_unavailable) return;
+    if (!blame_wanted) {
+        blame_wanted = TRUE;
+        blame_want_first = blame_want_last = line;
+    } else {
+        blame_want_first = MIN(blame_want_first, line);
+        blame_want_last = MAX(blame_want_last, line);
+    }
+    if (blame_want_idle_id == 0) blame_want_idle_id = g_idle_add(request_blame, NULL);
+}
+
+// Lines as git counts them: a final newline does not start another line
+static guint count_git_lines(const char *text, gsize len) {
+    guint lines = 0;
+    for (const char *p = text; (p = memchr(p, '\n', text + len - p)); p++) lines++;
+    if (len > 0 && text[len - 1] != '\n') lines++;
+    return lines;
+}
+
+// Blame depends on the whole history up to the commit, so it is only reused for the same commit
+static void set_blame_file(const char *commit_id, const char *work_tree, const char *rel_path) {
+    BlameFile *next = NULL;
+    if (commit_id) {
+        char *key = g_strconcat(commit_id, ":", head_path, NULL);
+        next = g_hash_table_lookup(blame_cache, key);
+        if (next) {
+            GList *link = g_queue_find_custom(blame_cache_order, key, (GCompareFunc)strcmp);
+            g_queue_unlink(blame_cache_order, link);
+            g_queue_push_head_link(blame_cache_order, link);
+            g_free(key);
+        } else {
+            next = blame_file_new(work_tree, rel_path, commit_id, count_git_lines(head_text, head_len));
+            g_hash_table_insert(blame_cache, key, next);
+            g_queue_push_head(blame_cache_order, key);
+            if (g_queue_get_length(blame_cache_order) > BLAME_CACHE_SIZE) {
+                char *oldest = g_queue_pop_tail(blame_cache_order);
+                g_hash_table_remove(blame_cache, oldest); // Frees the key
+            }
+        }
+    }
+    if (next == blame_file) return;
+
+    blame_file_cancel(blame_file);
+    blame_file = next;
+    blame_wanted = FALSE;
+    blame_unavailable = FALSE;
+    blame_renderer_set_file(blame_renderer, next);
+}
+
+void toggle_git_blame() {
+    GtkSourceGutterRenderer *renderer = GTK_SOURCE_GUTTER_RENDERER(blame_renderer);
+    gtk_source_gutter_renderer_set_visible(renderer, !gtk_source_gutter_renderer_get_visible(renderer));
+}
+
+// ---- HEAD version ----
+
+typedef struct {
+    char *text;
+    gsize len;
+    char *commit_id;  // Commit the text was read from, NULL if unknown
+    char *work_tree;
+    char *rel_path;
+} HeadFile;
+
+static void head_file_free(gpointer data) {
+    HeadFile *file = (HeadFile *)data;
+    if (!file) return;
+    g_free(file->text);
+    g_free(file->commit_id);
+    g_free(file->work_tree);
+    g_free(file->rel_path);
+    g_free(file);
+}
+
+typedef struct {
+    char *path;
+    GitPool *pool;  // May be NULL
+} HeadRead;
+
+static void head_read_free(gpointer data) {
+    HeadRead *read = (HeadRead *)data;
+    g_free(read->path);
+    git_pool_unref(read->pool);
+    g_free(read);
+}
+
+static void read_head_file(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    HeadRead *read = (HeadRead *)task_data;
+    const char *path = read->path;
+    char *dir = g_path_get_dirname(path);
+    char *work_tree = NULL;
+    char *git_dir = git_repo_find_dir(dir, &work_tree);
+    g_free(dir);
+
+    HeadFile *file = NULL;
+    if (git_dir && g_str_has_prefix(path, work_tree) && path[strlen(work_tree)] == '/') {
+        const char *rel_path = path + strlen(work_tree) + 1;
+        gsize len = 0;
+        guchar *data = git_repo_read_head_file(git_dir, rel_path, &len);
+        // Object formats the reader doesn't handle (SHA-256, promisor packs, ...) go through git
+        if (!data && read->pool && strcmp(git_pool_get_work_tree(read->pool), work_tree) == 0) {
+            char *object = g_strconcat("HEAD:", rel_path, NULL);
+            char *type = NULL;
+            data = git_pool_cat_file(read->pool, object, &len, &type);
+            if (data && strcmp(type, "blob") != 0) g_clear_pointer(&data, g_free);
+            g_free(type);
+            g_free(object);
+        }
+        // Git shows no line changes for binary files either
+        if (data && !memchr(data, '\0', MIN(len, GUTTER_BINARY_PROBE))) {
+            file = g_new0(HeadFile, 1);
+            file->text = (char *)data;
+            file->len = len;
+            file->commit_id = git_repo_head_id(git_dir);
+            file->work_tree = g_strdup(work_tree);
+            file->rel_path = g_strdup(rel_path);
+        } else {
+            g_free(data);
+        }
+    }
+    g_free(git_dir);
+    g_free(work_tree);
+    g_task_return_pointer(task, file, head_file_free);
+}
+
+static void set_head_file(const char *path, HeadFile *file) {
+    g_clear_pointer(&head_path, g_free);
+    g_clear_pointer(&head_text, g_free);
+    if (head_lines) g_array_free(head_lines, TRUE);
+    head_lines = NULL;
+    head_len = 0;
+
+    if (file) {
+        head_path = g_strdup(path);
+        head_text = file->text;
+        head_len = file->len;
+        file->text = NULL;
+        head_lines = g_array_new(FALSE, FALSE, sizeof(guint));
+    }
+    reset_line_table();
+    schedule_gutter_refresh();
+    if (file) set_blame_file(file->commit_id, file->work_tree, file->rel_path);
+    else set_blame_file(NULL, NULL, NULL);
+}
+
+static void on_head_file_read(GObject *source, GAsyncResult *result, gpointer user_data) {
+    HeadFile *file = g_task_propagate_pointer(G_TASK(result), NULL);
+    if (GPOINTER_TO_INT(user_data) == head_serial) {
+        HeadRead *read = g_task_get_task_data(G_TASK(result));
+        set_head_file(read->path, file);
+    }
+    head_file_free(file);
+}
+
+void update_git_gutter() {
+    head_serial++;
+    if (strlen(current_file) == 0) {
+        set_head_file(NULL, NULL);
+        return;
+    }
+    // Another file's HEAD copy says nothing about this one; drop it rather than show stale bars
+    if (head_path && strcmp(head_path, current_file) != 0) set_head_file(NULL, NULL);
+
+    GTask *task = g_task_new(NULL, NULL, on_head_file_read, GINT_TO_POINTER(head_serial));
+    HeadRead *read = g_new0(HeadRead, 1);
+    read->path = g_strdup(current_file);
+    read->pool = get_git_pool();
+    g_task_set_task_data(task, read, head_read_free);
+    g_task_run_in_thread(task, read_head_file);
+    g_object_unref(task);
+}
+
+void init_git_gutter() {
+    buffer_lines = g_array_new(FALSE, FALSE, sizeof(guint));
+    g_array_set_size(buffer_lines, gtk_text_buffer_get_line_count(GTK_TEXT_BUFFER(text_buffer)));
+    line_table = line_table_new();
+    reset_line_table();
+
+    g_signal_connect_after(text_buffer, "insert-text", G_CALLBACK(on_insert_text), NULL);
+    g_signal_connect_after(text_buffer, "delete-range", G_CALLBACK(on_delete_range), NULL);
+    g_signal_connect(text_buffer, "changed", G_CALLBACK(on_buffer_changed), NULL);
+
+    // Takes the slot of the line marks column, which only ever showed git changes
+    gutter_renderer = gutter_renderer_new();
+    GtkSourceGutter *gutter = gtk_source_view_get_gutter(source_view, GTK_TEXT_WINDOW_LEFT);
+    gtk_source_gutter_insert(gutter, GTK_SOURCE_GUTTER_RENDERER(gutter_renderer), GTK_SOURCE_VIEW_GUTTER_POSITION_MARKS);
+
+    // Between the line numbers and the change bars; hidden until toggled on, and only blames what it draws
+    blame_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)blame_file_unref);
+    blame_cache_order = g_queue_new();
+    blame_renderer = blame_renderer_new(on_blame_wanted, NULL);
+    gtk_source_gutter_renderer_set_visible(GTK_SOURCE_GUTTER_RENDERER(blame_renderer), FALSE);
+    gtk_source_gutter_insert(gutter, GTK_SOURCE_GUTTER_RENDERER(blame_renderer), GTK_SOURCE_VIEW_GUTTER_POSITION_MARKS - 1);
+    git_jobs_register(GIT_JOB_BLAME, start_blame, NULL);
+}
+
+void cleanup_git_gutter() {
+    head_serial++;
+    if (gutter_idle_id > 0) {
+        g_source_remove(gutter_idle_id);
+        gutter_idle_id = 0;
+    }
+    g_clear_pointer(&head_path, g_free);
+    g_clear_pointer(&head_text, g_free);
+    if (head_lines) g_array_free(head_lines, TRUE);
+    head_lines = NULL;
+    if (shown_hunks) g_array_unref(shown_hunks);
+    shown_hunks = NULL;
+    gutter_renderer = NULL; // Owned by the gutter
+
+    blame_file_cancel(blame_file);
+    blame_file = NULL;
+    blame_renderer = NULL;
+    if (blame_want_idle_id > 0) {
+        g_source_remove(blame_want_idle_id);
+        blame_want_idle_id = 0;
+    }
+    g_clear_pointer(&blame_cache, g_hash_table_destroy);
+    if (blame_cache_order) g_queue_free(blame_cache_order); // Keys belong to blame_cache
+    blame_cache_order = NULL;
+    if (buffer_lines) g_array_free(buffer_lines, TRUE);
+    buffer_lines = NULL;
+    g_clear_pointer(&line_table, line_table_free);
+}
@@ -0,0 +1,512 @@
+#include "git_index.h"
+#include "stat_batch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define GIT_SHA_LEN 20
+#define INDEX_HEADER_LEN 12
+#define INDEX_STAT_LEN 40         // ctime, mtime, dev, ino, mode, uid, gid, size
+#define INDEX_HASH_THREADS 4
+#define INDEX_READ_CHUNK 65536
+
+// On-disk entry flags
+#define CE_VALID 0x8000
+#define CE_EXTENDED 0x4000
+#define CE_STAGEMASK 0x3000
+#define CE_NAMEMASK 0x0FFF
+
+// Extended flags (version 3 and later)
+#define CE_SKIP_WORKTREE 0x4000
+#define CE_INTENT_TO_ADD 0x2000
+
+#define S_IFGITLINK 0160000
+
+struct _GitIndex {
+    GArray *entries;      // GitIndexEntry, sorted by path
+    GStringChunk *names;  // Backing store for entry paths
+    gint64 mtime;         // Of the index file, for racy entries
+};
+
+// ---- Helpers ----
+
+static guint32 read_be32(const guchar *p) {
+    return ((guint32)p[0] << 24) | ((guint32)p[1] << 16) | ((guint32)p[2] << 8) | p[3];
+}
+
+static guint16 read_be16(const guchar *p) {
+    return (guint16)(p[0] << 8 | p[1]);
+}
+
+static guint64 read_be64(const guchar *p) {
+    return (guint64)read_be32(p) << 32 | read_be32(p + 4);
+}
+
+static int compare_entries(gconstpointer a, gconstpointer b) {
+    return strcmp(((const GitIndexEntry *)a)->path, ((const GitIndexEntry *)b)->path);
+}
+
+// ---- Parsing ----
+
+typedef struct {
+    GArray *entries;
+    guchar base_sha[GIT_SHA_LEN];  // Shared index this one is split from
+    gboolean split;
+    GArray *delete_bits;           // Shared index positions, ascending
+    GArray *replace_bits;
+} ParsedIndex;
+
+// Version 4 prefix length: the same varint encoding as pack offsets
+static gboolean read_varint(const guchar **p, const guchar *end, gsize *value) {
+    if (*p >= end) return FALSE;
+    guchar c = *(*p)++;
+    gsize v = c & 0x7F;
+    while (c & 0x80) {
+        if (*p >= end) return FALSE;
+        c = *(*p)++;
+        v = ((v + 1) << 7) | (c & 0x7F);
+    }
+    *value = v;
+    return TRUE;
+}
+
+// EWAH compressed bitmap as written by git: bit count, word count, words
+// (each run-length marker followed by its literal words), last marker position
+static gboolean read_ewah(const guchar **p, const guchar *end, GArray *bits) {
+    if (end - *p < 8) return FALSE;
+    guint32 bit_count = read_be32(*p);
+    guint32 word_count = read_be32(*p + 4);
+    *p += 8;
+    if ((gsize)(end - *p) < (gsize)word_count * 8 + 4) return FALSE;
+
+    guint64 pos = 0;
+    guint32 i = 0;
+    while (i < word_count) {
+        guint64 marker = read_be64(*p + (gsize)i * 8);
+        i++;
+        gboolean run_bit = marker & 1;
+        guint64 run_words = (marker >> 1) & 0xFFFFFFFFu;
+        guint32 literal_words = (guint32)(marker >> 33);
+
+        if (pos + run_words * 64 > (guint64)bit_count + 63) return FALSE;
+        if (run_bit) {
+            for (guint64 b = 0; b < run_words * 64; b++) {
+                guint32 bit = (guint32)(pos + b);
+                g_array_append_val(bits, bit);
+            }
+        }
+        pos += run_words * 64;
+
+        for (guint32 l = 0; l < literal_words && i < word_count; l++, i++) {
+            guint64 word = read_be64(*p + (gsize)i * 8);
+            for (int b = 0; b < 64; b++) {
+                if (word & ((guint64)1 << b)) {
+                    guint32 bit = (guint32)(pos + b);
+                    g_array_append_val(bits, bit);
+                }
+            }
+            pos += 64;
+        }
+    }
+    *p += (gsize)word_count * 8 + 4;
+    return TRUE;
+}
+
+static gboolean parse_entries(const guchar *data, gsize len, GStringChunk *names, ParsedIndex *out) {
+    if (len < INDEX_HEADER_LEN + GIT_SHA_LEN || memcmp(data, "DIRC", 4) != 0) return FALSE;
+    guint32 version = read_be32(data + 4);
+    if (version < 2 || version > 4) return FALSE;
+    guint32 count = read_be32(data + 8);
+
+    const guchar *p = data + INDEX_HEADER_LEN;
+    const guchar *end = data + len - GIT_SHA_LEN;  // Trailing checksum
+    GString *name = g_string_new(NULL);
+    out->entries = g_array_sized_new(FALSE, FALSE, sizeof(GitIndexEntry), count);
+
+    for (guint32 i = 0; i < count; i++) {
+        const guchar *start = p;
+        if (end - p < INDEX_STAT_LEN + GIT_SHA_LEN + 2) goto fail;
+
+        GitIndexEntry entry;
+        entry.ctime = (gint64)read_be32(p) * 1000000000 + read_be32(p + 4);
+        entry.mtime = (gint64)read_be32(p + 8) * 1000000000 + read_be32(p + 12);
+        entry.ino = read_be32(p + 20);
+        entry.mode = read_be32(p + 24);
+        entry.size = read_be32(p + 36);
+        memcpy(entry.sha, p + INDEX_STAT_LEN, GIT_SHA_LEN);
+        p += INDEX_STAT_LEN + GIT_SHA_LEN;
+
+        guint16 flags = read_be16(p);
+        p += 2;
+        entry.flags = flags & (CE_VALID | CE_STAGEMASK);
+        entry.ext_flags = 0;
+        if (flags & CE_EXTENDED) {
+            if (version < 3 || end - p < 2) goto fail;
+            entry.ext_flags = read_be16(p) & (CE_SKIP_WORKTREE | CE_INTENT_TO_ADD);
+            p += 2;
+        }
+
+        if (version == 4) {
+            // Strip that many bytes off the previous name, then append the suffix
+            gsize strip;
+            if (!read_varint(&p, end, &strip) || strip > name->len) goto fail;
+            const guchar *nul = memchr(p, '\0', end - p);
+            if (!nul) goto fail;
+            g_string_truncate(name, name->len - strip);
+            g_string_append_len(name, (const char *)p, nul - p);
+            p = nul + 1;
+        } else {
+            // Names are NUL terminated and entries padded to a multiple of 8 bytes
+            const guchar *nul = memchr(p, '\0', end - p);
+            if (!nul) goto fail;
+            g_string_assign(name, "");
+            g_string_append_len(name, (const char *)p, nul - p);
+            gsize entry_len = ((p - start) + (nul - p) + 8) & ~(gsize)7;
+            if ((gsize)(end - start) < entry_len) goto fail;
+            p = start + entry_len;
+        }
+
+        entry.path = g_string_chunk_insert_len(names, name->str, name->len);
+        g_array_append_val(out->entries, entry);
+    }
+    g_string_free(name, TRUE);
+
+    // Extensions: 4-byte signature, 4-byte length, payload
+    while (end - p >= 8) {
+        guint32 ext_len = read_be32(p + 4);
+        const guchar *ext = p + 8;
+        if ((gsize)(end - ext) < ext_len) break;
+
+        if (memcmp(p, "link", 4) == 0 && ext_len >= GIT_SHA_LEN) {
+            memcpy(out->base_sha, ext, GIT_SHA_LEN);
+            out->split = TRUE;
+            const guchar *q = ext + GIT_SHA_LEN;
+            const guchar *ext_end = ext + ext_len;
+            out->delete_bits = g_array_new(FALSE, FALSE, sizeof(guint32));
+            out->replace_bits = g_array_new(FALSE, FALSE, sizeof(guint32));
+            if (q < ext_end && (!read_ewah(&q, ext_end, out->delete_bits) ||
+                                !read_ewah(&q, ext_end, out->replace_bits))) {
+                return FALSE;
+            }
+        }
+        p = ext + ext_len;
+    }
+    return TRUE;
+
+fail:
+    g_string_free(name, TRUE);
+    return FALSE;
+}
+
+static void parsed_index_clear(ParsedIndex *parsed) {
+    if (parsed->entries) g_array_free(parsed->entries, TRUE);
+    if (parsed->delete_bits) g_array_free(parsed->delete_bits, TRUE);
+    if (parsed->replace_bits) g_array_free(parsed->replace_bits, TRUE);
+}
+
+static gboolean parse_file(const char *path, GStringChunk *names, ParsedIndex *out, gint64 *mtime) {
+    GMappedFile *file = g_mapped_file_new(path, FALSE, NULL);
+    if (!file) return FALSE;
+
+    if (mtime) {
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            g_mapped_file_unref(file);
+            return FALSE;
+        }
+        *mtime = (gint64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    gboolean ok = parse_entries((const guchar *)g_mapped_file_get_contents(file),
+                                g_mapped_file_get_length(file), names, out);
+    g_mapped_file_unref(file);
+    return ok;
+}
+
+// A split index only holds changes against sharedindex.<sha>: entries of the
+// shared index flagged for deletion go, flagged ones are replaced in order by
+// the leading nameless entries here, and everything after those is added
+static GArray* merge_shared_index(const char *git_dir, ParsedIndex *split, GStringChunk *names) {
+    char hex[GIT_SHA_LEN * 2 + 1];
+    for (int i = 0; i < GIT_SHA_LEN; i++) g_snprintf(hex + 2 * i, 3, "%02x", split->base_sha[i]);
+    char *file_name = g_strconcat("sharedindex.", hex, NULL);
+    char *shared_path = g_build_filename(git_dir, file_name, NULL);
+    g_free(file_name);
+
+    ParsedIndex base = {0};
+    gboolean ok = parse_file(shared_path, names, &base, NULL);
+    g_free(shared_path);
+    if (!ok) {
+        parsed_index_clear(&base);
+        return NULL;
+    }
+
+    GArray *base_entries = base.entries;
+    guint replaced = 0;
+    for (guint i = 0; i < split->replace_bits->len; i++) {
+        guint32 pos = g_array_index(split->replace_bits, guint32, i);
+        if (pos >= base_entries->len || replaced >= split->entries->len) break;
+        GitIndexEntry *target = &g_array_index(base_entries, GitIndexEntry, pos);
+        GitIndexEntry replacement = g_array_index(split->entries, GitIndexEntry, replaced++);
+        replacement.path = target->path;
+        *target = replacement;
+    }
+    for (guint i = 0; i < split->delete_bits->len; i++) {
+        guint32 pos = g_array_index(split->delete_bits, guint32, i);
+        if (pos < base_entries->len) g_array_index(base_entries, GitIndexEntry, pos).path = NULL;
+    }
+
+    GArray *merged = g_array_sized_new(FALSE, FALSE, sizeof(GitIndexEntry), base_entries->len + split->entries->len);
+    for (guint i = 0; i < base_entries->len; i++) {
+        GitIndexEntry *entry = &g_array_index(base_entries, GitIndexEntry, i);
+        if (entry->path) g_array_append_val(merged, *entry);
+    }
+    for (guint i = replaced; i < split->entries->len; i++) {
+        g_array_append_val(merged, g_array_index(split->entries, GitIndexEntry, i));
+    }
+    g_array_sort(merged, compare_entries);
+
+    // An added entry for a path still in the shared index supersedes it
+    guint kept = 0;
+    for (guint i = 0; i < merged->len; i++) {
+        GitIndexEntry *entry = &g_array_index(merged, GitIndexEntry, i);
+        if (kept > 0) {
+            GitIndexEntry *prev = &g_array_index(merged, GitIndexEntry, kept - 1);
+            if (strcmp(prev->path, entry->path) == 0 && (prev->flags & CE_STAGEMASK) == (entry->flags & CE_STAGEMASK)) {
+                *prev = *entry;
+                continue;
+            }
+        }
+        g_array_index(merged, GitIndexEntry, kept++) = *entry;
+    }
+    g_array_set_size(merged, kept);
+
+    parsed_index_clear(&base);
+    return merged;
+}
+
+GitIndex* git_index_read(const char *git_dir) {
+    GitIndex *index = g_new0(GitIndex, 1);
+    index->names = g_string_chunk_new(64 * 1024);
+
+    ParsedIndex parsed = {0};
+    char *index_path = g_build_filename(git_dir, "index", NULL);
+    gboolean ok = parse_file(index_path, index->names, &parsed, &index->mtime);
+    g_free(index_path);
+
+    if (ok && parsed.split) {
+        index->entries = merge_shared_index(git_dir, &parsed, index->names);
+        ok = index->entries != NULL;
+    } else if (ok) {
+        index->entries = parsed.entries;
+        parsed.entries = NULL;
+    }
+    parsed_index_clear(&parsed);
+
+    if (!ok) {
+        git_index_free(index);
+        return NULL;
+    }
+    return index;
+}
+
+void git_index_free(GitIndex *index) {
+    if (!index) return;
+    if (index->entries) g_array_free(index->entries, TRUE);
+    g_string_chunk_free(index->names);
+    g_free(index);
+}
+
+guint git_index_get_count(GitIndex *index) {
+    return index->entries->len;
+}
+
+const GitIndexEntry* git_index_get_entry(GitIndex *index, guint i) {
+    return &g_array_index(index->entries, GitIndexEntry, i);
+}
+
+// ---- Worktree comparison ----
+
+static gboolean config_is_false(const char *value) {
+    return g_ascii_strcasecmp(value, "false") == 0 || g_ascii_strcasecmp(value, "no") == 0 ||
+           g_ascii_strcasecmp(value, "off") == 0 || strcmp(value, "0") == 0;
+}
+
+// The settings that apply come from the system and global config too, so git
+// itself is asked. TRUE when hashing is safe; FALSE as well when git can't be
+// asked, leaving the answer to git status.
+static gboolean config_allows_hashing(const char *work_tree) {
+    const char *argv[] = { "git", "-C", work_tree, "config", "--get-regexp",
+                           "^core\\.(autocrlf|filemode|attributesfile)$", NULL };
+    char *out = NULL;
+    gint wait_status = 0;
+    if (!g_spawn_sync(NULL, (char **)argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_STDERR_TO_DEV_NULL,
+                      NULL, NULL, &out, NULL, &wait_status, NULL)) {
+        return FALSE;
+    }
+    // Exit status 1 only means none of the keys is set
+    gboolean ok = WIFEXITED(wait_status) && WEXITSTATUS(wait_status) <= 1;
+    char **lines = g_strsplit(out ? out : "", "\n", -1);
+    // Later lines come from more specific files and win
+    gboolean crlf = FALSE, filemode = TRUE, attributes = FALSE;
+    for (int i = 0; ok && lines[i]; i++) {
+        char *value = strchr(lines[i], ' ');
+        if (!value) continue;
+        *value++ = '\0';
+        char *key = g_ascii_strdown(lines[i], -1);
+        // Line endings get converted, the executable bit is not trusted, or attributes may filter content
+        if (strcmp(key, "core.autocrlf") == 0) crlf = !config_is_false(value);
+        else if (strcmp(key, "core.filemode") == 0) filemode = !config_is_false(value);
+        else if (strcmp(key, "core.attributesfile") == 0) attributes = value[0] != '\0';
+        g_free(key);
+    }
+    g_strfreev(lines);
+    g_free(out);
+    return ok && !crlf && filemode && !attributes;
+}
+
+gboolean git_index_can_hash_worktree(const char *git_dir, const char *work_tree) {
+    char *attributes = g_build_filename(work_tree, ".gitattributes", NULL);
+    char *info_attributes = g_build_filename(git_dir, "info", "attributes", NULL);
+    // Where git looks for global attributes when core.attributesFile is unset
+    char *user_attributes = g_build_filename(g_get_user_config_dir(), "git", "attributes", NULL);
+    gboolean ok = !g_file_test(attributes, G_FILE_TEST_EXISTS) &&
+                  !g_file_test(info_attributes, G_FILE_TEST_EXISTS) &&
+                  !g_file_test(user_attributes, G_FILE_TEST_EXISTS) &&
+                  config_allows_hashing(work_tree);
+    g_free(attributes);
+    g_free(info_attributes);
+    g_free(user_attributes);
+    return ok;
+}
+
+typedef struct {
+    const GitIndexEntry *entry;
+    int dir_fd;
+    gboolean is_link;
+    gint64 size;
+    char status;  // Out: 'M' or '\0'
+} HashJob;
+
+static void hash_worker(gpointer data, gpointer pool_data) {
+    HashJob *job = (HashJob *)data;
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA1);
+    gboolean ok = FALSE;
+
+    if (job->is_link) {
+        char target[4096];
+        ssize_t n = readlinkat(job->dir_fd, job->entry->path, target, sizeof(target));
+        if (n >= 0 && n < (ssize_t)sizeof(target)) {
+            char header[32];
+            int header_len = g_snprintf(header, sizeof(header), "blob %zd", n) + 1;
+            g_checksum_update(checksum, (const guchar *)header, header_len);
+            g_checksum_update(checksum, (const guchar *)target, n);
+            ok = TRUE;
+        }
+    } else {
+        int fd = openat(job->dir_fd, job->entry->path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            char header[32];
+            int header_len = g_snprintf(header, sizeof(header), "blob %" G_GINT64_FORMAT, job->size) + 1;
+            g_checksum_update(checksum, (const guchar *)header, header_len);
+
+            guchar *buf = g_malloc(INDEX_READ_CHUNK);
+            gint64 total = 0;
+            ssize_t n;
+            while ((n = read(fd, buf, INDEX_READ_CHUNK)) > 0) {
+                g_checksum_update(checksum, buf, n);
+                total += n;
+            }
+            ok = n == 0 && total == job->size;
+            g_free(buf);
+            close(fd);
+        }
+    }
+
+    guchar digest[GIT_SHA_LEN];
+    gsize digest_len = sizeof(digest);
+    g_checksum_get_digest(checksum, digest, &digest_len);
+    g_checksum_free(checksum);
+    job->status = (!ok || memcmp(digest, job->entry->sha, GIT_SHA_LEN) != 0) ? 'M' : '\0';
+}
+
+GHashTable* git_index_find_changes(GitIndex *index, const char *work_tree, GHashTable **examined) {
+    GHashTable *changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    *examined = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    int dir_fd = open(work_tree, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) return changes;
+
+    // Only plain stage-0 entries git would look at in the worktree
+    GPtrArray *checked = g_ptr_array_new();
+    for (guint i = 0; i < index->entries->len; i++) {
+        const GitIndexEntry *entry = &g_array_index(index->entries, GitIndexEntry, i);
+        if (entry->flags & (CE_VALID | CE_STAGEMASK)) continue;
+        if (entry->ext_flags & (CE_SKIP_WORKTREE | CE_INTENT_TO_ADD)) continue;
+        if ((entry->mode & S_IFMT) == S_IFGITLINK) continue;
+        g_ptr_array_add(checked, (gpointer)entry);
+        g_hash_table_add(*examined, g_strdup(entry->path));
+    }
+
+    StatRequest *requests = g_new0(StatRequest, checked->len);
+    for (guint i = 0; i < checked->len; i++) {
+        const GitIndexEntry *entry = g_ptr_array_index(checked, i);
+        requests[i].dir_fd = dir_fd;
+        requests[i].path = entry->path;
+        requests[i].nofollow = TRUE;
+    }
+    stat_batch_run(requests, checked->len);
+
+    GArray *suspects = g_array_new(FALSE, FALSE, sizeof(HashJob));
+    for (guint i = 0; i < checked->len; i++) {
+        const GitIndexEntry *entry = g_ptr_array_index(checked, i);
+        StatRequest *req = &requests[i];
+        if (req->error != 0 || (req->mode & S_IFMT) != (entry->mode & S_IFMT)) {
+            if (req->error == ENOENT || req->error == ENOTDIR || req->error == 0) {
+                g_hash_table_insert(changes, g_strdup(entry->path), GINT_TO_POINTER(req->error ? 'D' : 'M'));
+            }
+            continue;
+        }
+        if (S_ISREG(req->mode) && ((req->mode & S_IXUSR) != 0) != ((entry->mode & S_IXUSR) != 0)) {
+            g_hash_table_insert(changes, g_strdup(entry->path), GINT_TO_POINTER('M'));
+            continue;
+        }
+        // A zero size is how git marks racily clean entries, so only trust other sizes
+        if ((guint32)req->size != entry->size && entry->size != 0) {
+            g_hash_table_insert(changes, g_strdup(entry->path), GINT_TO_POINTER('M'));
+            continue;
+        }
+
+        // Same stat data means unchanged, unless the file was written in the
+        // same tick as the index and could have changed again unnoticed
+        gboolean stat_changed = req->mtime != entry->mtime || req->ctime != entry->ctime ||
+                                (guint32)req->ino != entry->ino || (guint32)req->size != entry->size;
+        gboolean racy = entry->mtime >= index->mtime;
+        if (!stat_changed && !racy) continue;
+
+        HashJob job = { entry, dir_fd, S_ISLNK(req->mode), req->size, '\0' };
+        g_array_append_val(suspects, job);
+    }
+    g_free(requests);
+
+    // Hash on a few threads; the pool is joined before the jobs are read back
+    if (suspects->len > 1) {
+        GThreadPool *pool = g_thread_pool_new(hash_worker, NULL, MIN(suspects->len, INDEX_HASH_THREADS), FALSE, NULL);
+        for (guint i = 0; i < suspects->len; i++) g_thread_pool_push(pool, &g_array_index(suspects, HashJob, i), NULL);
+        g_thread_pool_free(pool, FALSE, TRUE);
+    } else if (suspects->len == 1) {
+        hash_worker(&g_array_index(suspects, HashJob, 0), NULL);
+    }
+    for (guint i = 0; i < suspects->len; i++) {
+        HashJob *job = &g_array_index(suspects, HashJob, i);
+        if (job->status) g_hash_table_insert(changes, g_strdup(job->entry->path), GINT_TO_POINTER(job->status));
+    }
+
+    g_array_free(suspects, TRUE);
+    g_ptr_array_free(checked, TRUE);
+    close(dir_fd);
+    return changes;
+}
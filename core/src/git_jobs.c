@@ -0,0 +1,91 @@
+#include "git_jobs.h"
+
+#define GIT_JOB_MAX_COOLDOWN_MS 10000  // Longest a rerun waits after the job before it
+#define GIT_POLL_RUNTIME_FACTOR 50     // Poll at least this many runtimes apart
+
+typedef struct {
+    GitJobFunc start;
+    gpointer user_data;
+    gboolean busy;        // Running, or waiting out the cooldown before a rerun
+    gboolean rerun;       // Requested again while busy
+    gint64 started;       // Monotonic time the running job started
+    gint64 average_us;    // Smoothed runtime, 0 until a job has ended
+    guint cooldown_id;
+} GitJob;
+
+static GitJob jobs[GIT_JOB_KIND_COUNT];
+
+void git_jobs_register(GitJobKind kind, GitJobFunc start, gpointer user_data) {
+    jobs[kind].start = start;
+    jobs[kind].user_data = user_data;
+}
+
+static void start_job(GitJob *job) {
+    job->busy = TRUE;
+    job->rerun = FALSE;
+    job->started = g_get_monotonic_time();
+    job->start(job->user_data);
+}
+
+void git_jobs_request(GitJobKind kind) {
+    GitJob *job = &jobs[kind];
+    if (!job->start) return;
+    if (job->busy) job->rerun = TRUE;
+    else start_job(job);
+}
+
+static gboolean on_cooldown_done(gpointer data) {
+    GitJob *job = (GitJob *)data;
+    job->cooldown_id = 0;
+    start_job(job);
+    return G_SOURCE_REMOVE;
+}
+
+void git_jobs_done(GitJobKind kind) {
+    GitJob *job = &jobs[kind];
+    if (!job->busy || job->cooldown_id > 0) return;
+
+    gint64 runtime = g_get_monotonic_time() - job->started;
+    job->average_us = job->average_us ? (3 * job->average_us + runtime) / 4 : runtime;
+
+    if (!job->rerun) {
+        job->busy = FALSE;
+        return;
+    }
+    // Leave git idle for as long as it was busy, so back-to-back reruns take at most half its time.
+    // Never started from inside the caller either, which may still be tearing its job down.
+    guint cooldown_ms = (guint)MIN(job->average_us / 1000, GIT_JOB_MAX_COOLDOWN_MS);
+    job->cooldown_id = g_timeout_add(cooldown_ms, on_cooldown_done, job);
+}
+
+void git_jobs_reset() {
+    for (int i = 0; i < GIT_JOB_KIND_COUNT; i++) {
+        GitJob *job = &jobs[i];
+        job->rerun = FALSE;
+        if (job->cooldown_id > 0) {
+            g_source_remove(job->cooldown_id);
+            job->cooldown_id = 0;
+            job->busy = FALSE;
+        }
+    }
+}
+
+guint git_jobs_backoff_s(GitJobKind kind, guint base_s) {
+    gint64 stretched_s = jobs[kind].average_us * GIT_POLL_RUNTIME_FACTOR / G_USEC_PER_SEC;
+    return (guint)MAX((gint64)base_s, stretched_s);
+}
+
+gboolean git_jobs_spawn(const char *folder, const char * const *args, GPid *pid, gint *standard_output, GError **error) {
+    GPtrArray *argv = g_ptr_array_new();
+    g_ptr_array_add(argv, "git");
+    g_ptr_array_add(argv, "-C");
+    g_ptr_array_add(argv, (gpointer)folder);
+    g_ptr_array_add(argv, "--no-optional-locks");
+    for (int i = 0; args[i]; i++) g_ptr_array_add(argv, (gpointer)args[i]);
+    g_ptr_array_add(argv, NULL);
+
+    gboolean ok = g_spawn_async_with_pipes(folder, (char **)argv->pdata, NULL, G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH,
+                                           NULL, NULL, pid, NULL, standard_output, NULL, error);
+    g_ptr_array_free(argv, TRUE);
+    return ok;
+}
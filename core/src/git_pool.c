@@ -0,0 +1,168 @@
+#include "git_pool.h"
+#include <string.h>
+
+#define GIT_POOL_HELPERS 2  // Concurrent cat-file requests before callers queue
+
+typedef struct {
+    GMutex lock;            // Held for a whole request/response exchange
+    GSubprocess *process;   // NULL until first use or after a restart
+    GOutputStream *in;
+    GDataInputStream *out;
+} GitHelper;
+
+struct _GitPool {
+    gint ref_count;
+    char *work_tree;
+    GitHelper cat_file[GIT_POOL_HELPERS];
+};
+
+static const char *cat_file_argv[] = { "git", "--no-optional-locks", "cat-file", "--batch", NULL };
+
+// ---- Helper processes ----
+
+static void helper_stop(GitHelper *helper) {
+    if (!helper->process) return;
+    // Closing stdin ends a batch command cleanly; force it in case it is stuck
+    g_output_stream_close(helper->in, NULL, NULL);
+    g_subprocess_force_exit(helper->process);
+    g_object_unref(helper->out);
+    g_object_unref(helper->process);
+    helper->process = NULL;
+    helper->in = NULL;
+    helper->out = NULL;
+}
+
+static gboolean helper_start(GitHelper *helper, const char *work_tree, const char * const *argv) {
+    GSubprocessLauncher *launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_STDIN_PIPE |
+                                                              G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                                              G_SUBPROCESS_FLAGS_STDERR_SILENCE);
+    g_subprocess_launcher_set_cwd(launcher, work_tree);
+    g_subprocess_launcher_setenv(launcher, "GIT_FLUSH", "1", TRUE); // Answer every line right away
+    helper->process = g_subprocess_launcher_spawnv(launcher, argv, NULL);
+    g_object_unref(launcher);
+    if (!helper->process) return FALSE;
+
+    helper->in = g_subprocess_get_stdin_pipe(helper->process);
+    helper->out = g_data_input_stream_new(g_subprocess_get_stdout_pipe(helper->process));
+    return TRUE;
+}
+
+// Take a free helper, or wait for the first one
+static GitHelper* helper_acquire(GitHelper *helpers, guint n) {
+    for (guint i = 0; i < n; i++) {
+        if (g_mutex_trylock(&helpers[i].lock)) return &helpers[i];
+    }
+    g_mutex_lock(&helpers[0].lock);
+    return &helpers[0];
+}
+
+// ---- cat-file ----
+
+typedef enum {
+    CAT_FILE_FOUND,
+    CAT_FILE_MISSING,
+    CAT_FILE_BROKEN   // The helper died or stopped making sense
+} CatFileResult;
+
+// Request "<object>\n"; answer "<id> <type> <size>\n<contents>\n" or "<object> missing\n"
+static CatFileResult cat_file_exchange(GitHelper *helper, const char *object, guchar **data, gsize *len, char **type) {
+    char *request = g_strconcat(object, "\n", NULL);
+    gboolean sent = g_output_stream_write_all(helper->in, request, strlen(request), NULL, NULL, NULL) &&
+                    g_output_stream_flush(helper->in, NULL, NULL);
+    g_free(request);
+    if (!sent) return CAT_FILE_BROKEN;
+
+    char *header = g_data_input_stream_read_line(helper->out, NULL, NULL, NULL);
+    if (!header) return CAT_FILE_BROKEN;
+
+    // The object name is echoed back as given and may hold spaces
+    // ("HEAD:some file"), so a miss is told by its suffix, not by field count
+    if (g_str_has_suffix(header, " missing") || g_str_has_suffix(header, " ambiguous")) {
+        g_free(header);
+        return CAT_FILE_MISSING;
+    }
+
+    char **fields = g_strsplit(header, " ", 3);
+    g_free(header);
+    if (!fields[0] || !fields[1] || !fields[2]) {
+        g_strfreev(fields);
+        return CAT_FILE_BROKEN;
+    }
+
+    char *end = NULL;
+    guint64 size = g_ascii_strtoull(fields[2], &end, 10);
+    if (!end || *end != '\0') {
+        g_strfreev(fields);
+        return CAT_FILE_BROKEN;
+    }
+
+    guchar *contents = g_malloc(size + 1);
+    gsize got = 0;
+    char newline;
+    if (!g_input_stream_read_all(G_INPUT_STREAM(helper->out), contents, size, &got, NULL, NULL) || got != size ||
+        !g_input_stream_read_all(G_INPUT_STREAM(helper->out), &newline, 1, &got, NULL, NULL) || got != 1) {
+        g_free(contents);
+        g_strfreev(fields);
+        return CAT_FILE_BROKEN;
+    }
+    contents[size] = '\0';
+
+    *data = contents;
+    *len = size;
+    if (type) *type = g_strdup(fields[1]);
+    g_strfreev(fields);
+    return CAT_FILE_FOUND;
+}
+
+guchar* git_pool_cat_file(GitPool *pool, const char *object, gsize *len, char **type) {
+    if (strchr(object, '\n')) return NULL; // Would break the line framing
+
+    GitHelper *helper = helper_acquire(pool->cat_file, GIT_POOL_HELPERS);
+    guchar *data = NULL;
+    // A helper that died (crash, repository gone, killed) gets one respawn per request
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!helper->process && !helper_start(helper, pool->work_tree, cat_file_argv)) break;
+        CatFileResult result = cat_file_exchange(helper, object, &data, len, type);
+        if (result != CAT_FILE_BROKEN) break;
+        helper_stop(helper);
+    }
+    g_mutex_unlock(&helper->lock);
+    return data;
+}
+
+// ---- Pool ----
+
+GitPool* git_pool_new(const char *work_tree) {
+    GitPool *pool = g_new0(GitPool, 1);
+    pool->ref_count = 1;
+    pool->work_tree = g_strdup(work_tree);
+    for (int i = 0; i < GIT_POOL_HELPERS; i++) g_mutex_init(&pool->cat_file[i].lock);
+    return pool;
+}
+
+GitPool* git_pool_ref(GitPool *pool) {
+    g_atomic_int_inc(&pool->ref_count);
+    return pool;
+}
+
+const char* git_pool_get_work_tree(GitPool *pool) {
+    return pool->work_tree;
+}
+
+void git_pool_restart(GitPool *pool) {
+    for (int i = 0; i < GIT_POOL_HELPERS; i++) {
+        g_mutex_lock(&pool->cat_file[i].lock);
+        helper_stop(&pool->cat_file[i]);
+        g_mutex_unlock(&pool->cat_file[i].lock);
+    }
+}
+
+void git_pool_unref(GitPool *pool) {
+    if (!pool || !g_atomic_int_dec_and_test(&pool->ref_count)) return;
+    for (int i = 0; i < GIT_POOL_HELPERS; i++) {
+        helper_stop(&pool->cat_file[i]);
+        g_mutex_clear(&pool->cat_file[i].lock);
+    }
+    g_free(pool->work_tree);
+    g_free(pool);
+}
@@ -0,0 +1,806 @@
+#include "git_repo.h"
+#include <string.h>
+
+#define GIT_SHA_LEN 20
+#define GIT_HEX_LEN 40
+#define GIT_SHORT_LEN 7
+#define GIT_SYMREF_DEPTH 5
+#define GIT_DELTA_DEPTH 4096      // Git itself refuses deeper delta chains
+#define GIT_WALK_LIMIT 100000     // Commits loaded before ahead/behind gives up
+
+// Pack object types
+enum {
+    OBJ_COMMIT = 1,
+    OBJ_TREE = 2,
+    OBJ_BLOB = 3,
+    OBJ_TAG = 4,
+    OBJ_OFS_DELTA = 6,
+    OBJ_REF_DELTA = 7
+};
+
+// One objects/pack/pack-*.idx (version 2) and its .pack, both mapped
+typedef struct {
+    GMappedFile *idx;
+    GMappedFile *pack;
+    guint32 count;
+    const guchar *fanout;         // 256 big-endian counts
+    const guchar *shas;           // Sorted object ids
+    const guchar *offsets;        // 31-bit offsets, or an index into large_offsets
+    const guchar *large_offsets;  // 64-bit offsets
+    const guchar *large_end;      // Where the trailing checksums start
+} GitPack;
+
+typedef struct {
+    char *objects_dir;
+    GPtrArray *packs;  // GitPack*
+} GitObjects;
+
+// ---- Helpers ----
+
+static guint32 read_be32(const guchar *p) {
+    return ((guint32)p[0] << 24) | ((guint32)p[1] << 16) | ((guint32)p[2] << 8) | p[3];
+}
+
+static gboolean hex_to_sha(const char *hex, guchar *sha) {
+    for (int i = 0; i < GIT_SHA_LEN; i++) {
+        int hi = g_ascii_xdigit_value(hex[2 * i]);
+        int lo = hi < 0 ? -1 : g_ascii_xdigit_value(hex[2 * i + 1]);
+        if (lo < 0) return FALSE;
+        sha[i] = (guchar)(hi << 4 | lo);
+    }
+    return TRUE;
+}
+
+static char* read_trimmed(const char *path) {
+    char *contents = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) return NULL;
+    g_strstrip(contents);
+    return contents;
+}
+
+// Inflate a zlib stream that may be followed by unrelated bytes; size_hint is the
+// expected output size, 0 if unknown
+static guchar* inflate_data(const guchar *in, gsize in_len, gsize size_hint, gsize *out_len) {
+    GConverter *z = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+    gsize cap = size_hint ? size_hint + 1 : MAX(in_len * 2, 256);
+    guchar *out = g_malloc(cap + 1);
+    gsize consumed = 0, written = 0;
+
+    for (;;) {
+        if (written == cap) {
+            cap *= 2;
+            out = g_realloc(out, cap + 1);
+        }
+        gsize bytes_read = 0, bytes_written = 0;
+        GError *err = NULL;
+        GConverterResult res = g_converter_convert(z, in + consumed, in_len - consumed, out + written, cap - written,
+                                                   G_CONVERTER_INPUT_AT_END, &bytes_read, &bytes_written, &err);
+        consumed += bytes_read;
+        written += bytes_written;
+        if (res == G_CONVERTER_FINISHED) break;
+        if (res == G_CONVERTER_ERROR) {
+            gboolean no_space = g_error_matches(err, G_IO_ERROR, G_IO_ERROR_NO_SPACE);
+            g_error_free(err);
+            if (no_space) {
+                cap *= 2;
+                out = g_realloc(out, cap + 1);
+                continue;
+            }
+            g_free(out);
+            g_object_unref(z);
+            return NULL;
+        }
+    }
+    g_object_unref(z);
+    out[written] = '\0';
+    *out_len = written;
+    return out;
+}
+
+// ---- Repository layout ----
+
+char* git_repo_find_dir(const char *folder, char **work_tree) {
+    char *dir = g_strdup(folder);
+    for (;;) {
+        char *dot_git = g_build_filename(dir, ".git", NULL);
+        if (g_file_test(dot_git, G_FILE_TEST_IS_DIR)) {
+            if (work_tree) *work_tree = dir;
+            else g_free(dir);
+            return dot_git;
+        }
+
+        char *contents = read_trimmed(dot_git);
+        if (contents && g_str_has_prefix(contents, "gitdir:")) {
+            char *target = g_strstrip(contents + strlen("gitdir:"));
+            char *git_dir = g_path_is_absolute(target) ? g_strdup(target) : g_build_filename(dir, target, NULL);
+            g_free(contents);
+            g_free(dot_git);
+            if (work_tree) *work_tree = dir;
+            else g_free(dir);
+            return git_dir;
+        }
+        g_free(contents);
+        g_free(dot_git);
+
+        char *parent = g_path_get_dirname(dir);
+        gboolean at_top = strcmp(parent, dir) == 0;
+        g_free(dir);
+        dir = parent;
+        if (at_top) break;
+    }
+    g_free(dir);
+    return NULL;
+}
+
+char* git_repo_common_dir(const char *git_dir) {
+    char *path = g_build_filename(git_dir, "commondir", NULL);
+    char *common = read_trimmed(path);
+    g_free(path);
+    if (!common || common[0] == '\0') {
+        g_free(common);
+        return g_strdup(git_dir);
+    }
+    char *resolved = g_path_is_absolute(common) ? g_strdup(common) : g_build_filename(git_dir, common, NULL);
+    g_free(common);
+    return resolved;
+}
+
+static gboolean lookup_packed_ref(const char *common_dir, const char *ref, guchar *sha) {
+    char *path = g_build_filename(common_dir, "packed-refs", NULL);
+    char *contents = NULL;
+    gboolean found = FALSE;
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        size_t ref_len = strlen(ref);
+        for (char *line = contents; line && *line && !found; ) {
+            char *next = strchr(line, '\n');
+            if (next) *next++ = '\0';
+            // "<hex> <ref>"; comments start with '#' and peeled tags with '^'
+            if (line[0] != '#' && line[0] != '^' && strlen(line) == GIT_HEX_LEN + 1 + ref_len &&
+                line[GIT_HEX_LEN] == ' ' && strcmp(line + GIT_HEX_LEN + 1, ref) == 0) {
+                found = hex_to_sha(line, sha);
+            }
+            line = next;
+        }
+        g_free(contents);
+    }
+    g_free(path);
+    return found;
+}
+
+// Follow symbolic refs down to an object id. HEAD and other pseudo refs are per worktree.
+static gboolean resolve_ref(const char *git_dir, const char *common_dir, const char *ref, guchar *sha) {
+    char *name = g_strdup(ref);
+    gboolean found = FALSE;
+
+    for (int depth = 0; depth < GIT_SYMREF_DEPTH; depth++) {
+        const char *dir = g_str_has_prefix(name, "refs/") ? common_dir : git_dir;
+        char *path = g_build_filename(dir, name, NULL);
+        char *contents = read_trimmed(path);
+        g_free(path);
+
+        if (!contents) {
+            found = lookup_packed_ref(common_dir, name, sha);
+            break;
+        }
+        if (g_str_has_prefix(contents, "ref: ")) {
+            g_free(name);
+            name = g_strdup(contents + strlen("ref: "));
+            g_free(contents);
+            continue;
+        }
+        found = strlen(contents) >= GIT_HEX_LEN && hex_to_sha(contents, sha);
+        g_free(contents);
+        break;
+    }
+    g_free(name);
+    return found;
+}
+
+// branch.<name>.remote and branch.<name>.merge from the repository config
+static void read_branch_config(const char *common_dir, const char *branch, char **remote, char **merge) {
+    char *path = g_build_filename(common_dir, "config", NULL);
+    char *contents = NULL;
+    *remote = *merge = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+        g_free(path);
+        return;
+    }
+    g_free(path);
+
+    char *section = g_strdup_printf("branch \"%s\"", branch);
+    gboolean in_section = FALSE;
+    for (char *line = contents; line && *line; ) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        g_strstrip(line);
+
+        if (line[0] == '[') {
+            char *close = strrchr(line, ']');
+            if (close) *close = '\0';
+            // Section names are case-insensitive, branch names are not
+            in_section = g_ascii_strncasecmp(line + 1, "branch ", 7) == 0 && strcmp(line + 8, section + 7) == 0;
+        } else if (in_section && line[0] != '#' && line[0] != ';') {
+            char *eq = strchr(line, '=');
+            if (eq) {
+                *eq = '\0';
+                char *key = g_strstrip(line);
+                char *value = g_strstrip(eq + 1);
+                if (g_ascii_strcasecmp(key, "remote") == 0) {
+                    g_free(*remote);
+                    *remote = g_strdup(value);
+                } else if (g_ascii_strcasecmp(key, "merge") == 0) {
+                    g_free(*merge);
+                    *merge = g_strdup(value);
+                }
+            }
+        }
+        line = next;
+    }
+    g_free(section);
+    g_free(contents);
+}
+
+// ---- Object store ----
+
+static void pack_free(gpointer data) {
+    GitPack *pack = (GitPack *)data;
+    if (pack->idx) g_mapped_file_unref(pack->idx);
+    if (pack->pack) g_mapped_file_unref(pack->pack);
+    g_free(pack);
+}
+
+static GitPack* pack_open(const char *idx_path) {
+    GitPack *pack = g_new0(GitPack, 1);
+    pack->idx = g_mapped_file_new(idx_path, FALSE, NULL);
+
+    char *base = g_strndup(idx_path, strlen(idx_path) - strlen(".idx"));
+    char *pack_path = g_strconcat(base, ".pack", NULL);
+    g_free(base);
+    pack->pack = g_mapped_file_new(pack_path, FALSE, NULL);
+    g_free(pack_path);
+    if (!pack->idx || !pack->pack) {
+        pack_free(pack);
+        return NULL;
+    }
+
+    const guchar *data = (const guchar *)g_mapped_file_get_contents(pack->idx);
+    gsize len = g_mapped_file_get_length(pack->idx);
+    // Version 2: "\377tOc", version, fanout, ids, CRCs, offsets, large
+    // offsets, then the pack and idx checksums
+    gsize trailer = 2 * GIT_SHA_LEN;
+    if (len < 8 + 256 * 4 + trailer || memcmp(data, "\377tOc", 4) != 0 || read_be32(data + 4) != 2) {
+        pack_free(pack);
+        return NULL;
+    }
+    pack->fanout = data + 8;
+    pack->count = read_be32(pack->fanout + 255 * 4);
+    gsize large_start = 8 + 256 * 4 + (gsize)pack->count * (GIT_SHA_LEN + 4 + 4);
+    gboolean ok = large_start <= len - trailer;
+    // The searches trust the fan-out to stay within count
+    for (int i = 1; ok && i < 256; i++) ok = read_be32(pack->fanout + (i - 1) * 4) <= read_be32(pack->fanout + i * 4);
+    if (!ok) {
+        pack_free(pack);
+        return NULL;
+    }
+    pack->shas = pack->fanout + 256 * 4;
+    pack->offsets = pack->shas + (gsize)pack->count * (GIT_SHA_LEN + 4);
+    pack->large_offsets = data + large_start;
+    pack->large_end = data + len - trailer;
+    return pack;
+}
+
+static GitObjects* objects_open(const char *common_dir) {
+    GitObjects *store = g_new0(GitObjects, 1);
+    store->objects_dir = g_build_filename(common_dir, "objects", NULL);
+    store->packs = g_ptr_array_new_with_free_func(pack_free);
+
+    char *pack_dir = g_build_filename(store->objects_dir, "pack", NULL);
+    GDir *dir = g_dir_open(pack_dir, 0, NULL);
+    if (dir) {
+        const char *name;
+        while ((name = g_dir_read_name(dir))) {
+            if (!g_str_has_suffix(name, ".idx")) continue;
+            char *idx_path = g_build_filename(pack_dir, name, NULL);
+            GitPack *pack = pack_open(idx_path);
+            if (pack) g_ptr_array_add(store->packs, pack);
+            g_free(idx_path);
+        }
+        g_dir_close(dir);
+    }
+    g_free(pack_dir);
+    return store;
+}
+
+static void objects_free(GitObjects *store) {
+    g_ptr_array_free(store->packs, TRUE);
+    g_free(store->objects_dir);
+    g_free(store);
+}
+
+static gboolean pack_find(GitPack *pack, const guchar *sha, guint64 *offset) {
+    guint32 lo = sha[0] == 0 ? 0 : read_be32(pack->fanout + (sha[0] - 1) * 4);
+    guint32 hi = read_be32(pack->fanout + sha[0] * 4);
+    while (lo < hi) {
+        guint32 mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(pack->shas + (gsize)mid * GIT_SHA_LEN, sha, GIT_SHA_LEN);
+        if (cmp == 0) {
+            guint32 off = read_be32(pack->offsets + (gsize)mid * 4);
+            if (off & 0x80000000u) {
+                gsize large_index = off & 0x7fffffffu;
+                // A corrupt entry may point past the table
+                if (large_index >= (gsize)(pack->large_end - pack->large_offsets) / 8) return FALSE;
+                const guchar *large = pack->large_offsets + large_index * 8;
+                *offset = ((guint64)read_be32(large) << 32) | read_be32(large + 4);
+            } else {
+                *offset = off;
+            }
+            return TRUE;
+        }
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return FALSE;
+}
+
+static gsize read_delta_size(const guchar **p, const guchar *end) {
+    gsize size = 0;
+    int shift = 0;
+    while (*p < end) {
+        guchar c = *(*p)++;
+        size |= (gsize)(c & 0x7f) << shift;
+        shift += 7;
+        if (!(c & 0x80)) break;
+    }
+    return size;
+}
+
+static guchar* apply_delta(const guchar *base, gsize base_len, const guchar *delta, gsize delta_len, gsize *out_len) {
+    const guchar *p = delta, *end = delta + delta_len;
+    if (read_delta_size(&p, end) != base_len) return NULL;
+    gsize size = read_delta_size(&p, end);
+    guchar *out = g_malloc(size + 1);
+    gsize pos = 0;
+
+    while (p < end) {
+        guchar op = *p++;
+        if (op & 0x80) {
+            // Copy from the base: which offset and size bytes follow is given by the op bits
+            gsize off = 0, n = 0;
+            for (int i = 0; i < 4; i++) {
+                if ((op & (1 << i)) && p < end) off |= (gsize)*p++ << (8 * i);
+            }
+            for (int i = 0; i < 3; i++) {
+                if ((op & (0x10 << i)) && p < end) n |= (gsize)*p++ << (8 * i);
+            }
+            if (n == 0) n = 0x10000;
+            if (off + n > base_len || pos + n > size) break;
+            memcpy(out + pos, base + off, n);
+            pos += n;
+        } else if (op) {
+            // Insert the next op bytes
+            if (p + op > end || pos + op > size) break;
+            memcpy(out + pos, p, op);
+            p += op;
+            pos += op;
+        } else {
+            break; // Reserved
+        }
+    }
+    if (p != end || pos != size) {
+        g_free(out);
+        return NULL;
+    }
+    out[size] = '\0';
+    *out_len = size;
+    return out;
+}
+
+static guchar* read_object(GitObjects *store, const guchar *sha, int *type, gsize *size, int depth);
+
+static guchar* pack_read_at(GitObjects *store, GitPack *pack, guint64 offset, int *type, gsize *size, int depth) {
+    const guchar *data = (const guchar *)g_mapped_file_get_contents(pack->pack);
+    gsize len = g_mapped_file_get_length(pack->pack);
+    if (depth > GIT_DELTA_DEPTH || offset >= len) return NULL;
+
+    const guchar *p = data + offset, *end = data + len;
+    guchar c = *p++;
+    int obj_type = (c >> 4) & 7;
+    gsize obj_size = c & 15;
+    int shift = 4;
+    while ((c & 0x80) && p < end) {
+        c = *p++;
+        obj_size |= (gsize)(c & 0x7f) << shift;
+        shift += 7;
+    }
+
+    if (obj_type != OBJ_OFS_DELTA && obj_type != OBJ_REF_DELTA) {
+        *type = obj_type;
+        return inflate_data(p, end - p, obj_size, size);
+    }
+
+    guchar *base;
+    gsize base_len = 0;
+    if (obj_type == OBJ_OFS_DELTA) {
+        // Distance back to the base, in git's offset encoding
+        if (p >= end) return NULL;
+        c = *p++;
+        guint64 back = c & 0x7f;
+        while ((c & 0x80) && p < end) {
+            c = *p++;
+            back = ((back + 1) << 7) | (c & 0x7f);
+        }
+        if (back > offset) return NULL;
+        base = pack_read_at(store, pack, offset - back, type, &base_len, depth + 1);
+    } else {
+        if (p + GIT_SHA_LEN > end) return NULL;
+        base = read_object(store, p, type, &base_len, depth + 1);
+        p += GIT_SHA_LEN;
+    }
+    if (!base) return NULL;
+
+    gsize delta_len = 0;
+    guchar *delta = inflate_data(p, end - p, obj_size, &delta_len);
+    guchar *result = delta ? apply_delta(base, base_len, delta, delta_len, size) : NULL;
+    g_free(delta);
+    g_free(base);
+    return result;
+}
+
+static int loose_type(const char *name) {
+    if (strcmp(name, "commit") == 0) return OBJ_COMMIT;
+    if (strcmp(name, "tree") == 0) return OBJ_TREE;
+    if (strcmp(name, "blob") == 0) return OBJ_BLOB;
+    if (strcmp(name, "tag") == 0) return OBJ_TAG;
+    return 0;
+}
+
+// Returns the object body (NUL-terminated) or NULL if it is not in the store
+static guchar* read_object(GitObjects *store, const guchar *sha, int *type, gsize *size, int depth) {
+    for (guint i = 0; i < store->packs->len; i++) {
+        GitPack *pack = g_ptr_array_index(store->packs, i);
+        guint64 offset;
+        if (pack_find(pack, sha, &offset)) return pack_read_at(store, pack, offset, type, size, depth);
+    }
+
+    // Loose: objects/ab/cdef..., a zlib stream of "<type> <size>\0<body>"
+    char hex[GIT_HEX_LEN + 1];
+    for (int i = 0; i < GIT_SHA_LEN; i++) g_snprintf(hex + 2 * i, 3, "%02x", sha[i]);
+    char sub[3] = { hex[0], hex[1], '\0' };
+    char *path = g_build_filename(store->objects_dir, sub, hex + 2, NULL);
+    gchar *raw = NULL;
+    gsize raw_len = 0;
+    gboolean ok = g_file_get_contents(path, &raw, &raw_len, NULL);
+    g_free(path);
+    if (!ok) return NULL;
+
+    gsize len = 0;
+    guchar *data = inflate_data((const guchar *)raw, raw_len, 0, &len);
+    g_free(raw);
+    if (!data) return NULL;
+
+    guchar *nul = memchr(data, '\0', len);
+    char *space = nul ? memchr(data, ' ', nul - data) : NULL;
+    if (!space) {
+        g_free(data);
+        return NULL;
+    }
+    *space = '\0';
+    *type = loose_type((const char *)data);
+    gsize header = nul + 1 - data;
+    *size = len - header;
+    memmove(data, nul + 1, *size + 1); // Keeps the terminating NUL
+    return data;
+}
+
+// ---- Ahead/behind ----
+
+#define WALK_FROM_HEAD 1
+#define WALK_FROM_UPSTREAM 2
+#define WALK_BOTH (WALK_FROM_HEAD | WALK_FROM_UPSTREAM)
+
+typedef struct {
+    guchar sha[GIT_SHA_LEN];  // Must stay first; the walk's hash table keys on it
+    gint64 time;
+    guint flags;
+    gboolean queued;
+    guint n_parents;
+    guchar *parents;          // n_parents ids back to back
+} WalkCommit;
+
+typedef struct {
+    GitObjects *store;
+    GHashTable *commits;      // sha -> WalkCommit*
+    GPtrArray *heap;          // Max-heap on commit time
+    guint unfinished;         // Queued commits not yet reached from both sides
+    gint64 oldest_single;     // Oldest commit ever reached from one side only
+} CommitWalk;
+
+static guint sha_hash(gconstpointer key) {
+    guint h;
+    memcpy(&h, key, sizeof(h));
+    return h;
+}
+
+static gboolean sha_equal(gconstpointer a, gconstpointer b) {
+    return memcmp(a, b, GIT_SHA_LEN) == 0;
+}
+
+static void walk_commit_free(gpointer data) {
+    WalkCommit *commit = (WalkCommit *)data;
+    g_free(commit->parents);
+    g_free(commit);
+}
+
+static void parse_commit(WalkCommit *commit, const char *body) {
+    GByteArray *parents = g_byte_array_new();
+    for (const char *line = body; line && *line && *line != '\n'; ) {
+        const char *next = strchr(line, '\n');
+        guchar sha[GIT_SHA_LEN];
+        if (g_str_has_prefix(line, "parent ") && hex_to_sha(line + 7, sha)) {
+            g_byte_array_append(parents, sha, GIT_SHA_LEN);
+        } else if (g_str_has_prefix(line, "committer ")) {
+            // "committer Name <mail> <timestamp> <tz>"
+            const char *mail_end = strrchr(line, '>');
+            if (mail_end && (!next || mail_end < next)) commit->time = g_ascii_strtoll(mail_end + 1, NULL, 10);
+        }
+        line = next ? next + 1 : NULL;
+    }
+    commit->n_parents = parents->len / GIT_SHA_LEN;
+    commit->parents = g_byte_array_free(parents, FALSE);
+}
+
+static WalkCommit* walk_get(CommitWalk *walk, const guchar *sha) {
+    WalkCommit *commit = g_hash_table_lookup(walk->commits, sha);
+    if (commit) return commit;
+
+    commit = g_new0(WalkCommit, 1);
+    memcpy(commit->sha, sha, GIT_SHA_LEN);
+    int type = 0;
+    gsize size = 0;
+    guchar *body = read_object(walk->store, sha, &type, &size, 0);
+    // Missing parents (shallow clones) simply end the walk there
+    if (body && type == OBJ_COMMIT) parse_commit(commit, (const char *)body);
+    g_free(body);
+    g_hash_table_insert(walk->commits, commit->sha, commit);
+    return commit;
+}
+
+static void heap_push(CommitWalk *walk, WalkCommit *commit) {
+    GPtrArray *heap = walk->heap;
+    g_ptr_array_add(heap, commit);
+    for (guint i = heap->len - 1; i > 0; ) {
+        guint parent = (i - 1) / 2;
+        WalkCommit *up = g_ptr_array_index(heap, parent);
+        if (up->time >= commit->time) break;
+        heap->pdata[i] = up;
+        heap->pdata[parent] = commit;
+        i = parent;
+    }
+    commit->queued = TRUE;
+    if (commit->flags != WALK_BOTH) {
+        walk->unfinished++;
+        walk->oldest_single = MIN(walk->oldest_single, commit->time);
+    }
+}
+
+static WalkCommit* heap_pop(CommitWalk *walk) {
+    GPtrArray *heap = walk->heap;
+    WalkCommit *top = g_ptr_array_index(heap, 0);
+    WalkCommit *last = g_ptr_array_remove_index(heap, heap->len - 1);
+    if (heap->len > 0) {
+        heap->pdata[0] = last;
+        for (guint i = 0; ; ) {
+            guint left = 2 * i + 1, right = left + 1, best = i;
+            if (left < heap->len && ((WalkCommit *)heap->pdata[left])->time > ((WalkCommit *)heap->pdata[best])->time) best = left;
+            if (right < heap->len && ((WalkCommit *)heap->pdata[right])->time > ((WalkCommit *)heap->pdata[best])->time) best = right;
+            if (best == i) break;
+            heap->pdata[i] = heap->pdata[best];
+            heap->pdata[best] = last;
+            i = best;
+        }
+    }
+    top->queued = FALSE;
+    if (top->flags != WALK_BOTH) walk->unfinished--;
+    return top;
+}
+
+// Newest first, marking each commit with the side(s) it is reachable from.
+// Once everything queued is reachable from both sides, the walk still has to
+// go on while a queued commit could lead to one marked from a single side;
+// commits are assumed not to be older than their parents.
+static gboolean count_divergence(const char *common_dir, const guchar *head, const guchar *upstream, int *ahead, int *behind) {
+    if (memcmp(head, upstream, GIT_SHA_LEN) == 0) {
+        *ahead = *behind = 0;
+        return TRUE;
+    }
+
+    CommitWalk walk;
+    walk.store = objects_open(common_dir);
+    walk.commits = g_hash_table_new_full(sha_hash, sha_equal, NULL, walk_commit_free);
+    walk.heap = g_ptr_array_new();
+    walk.unfinished = 0;
+    walk.oldest_single = G_MAXINT64;
+
+    WalkCommit *start = walk_get(&walk, head);
+    start->flags = WALK_FROM_HEAD;
+    heap_push(&walk, start);
+    start = walk_get(&walk, upstream);
+    start->flags = WALK_FROM_UPSTREAM;
+    heap_push(&walk, start);
+
+    gboolean complete = TRUE;
+    while (walk.heap->len > 0) {
+        WalkCommit *top = g_ptr_array_index(walk.heap, 0);
+        if (walk.unfinished == 0 && top->time < walk.oldest_single) break;
+        if (g_hash_table_size(walk.commits) > GIT_WALK_LIMIT) {
+            complete = FALSE;
+            break;
+        }
+        WalkCommit *commit = heap_pop(&walk);
+        for (guint i = 0; i < commit->n_parents; i++) {
+            WalkCommit *parent = walk_get(&walk, commit->parents + (gsize)i * GIT_SHA_LEN);
+            guint flags = parent->flags | commit->flags;
+            if (flags == parent->flags) continue;
+            if (parent->queued) {
+                // Queued with one side, so it was counted as unfinished
+                if (flags == WALK_BOTH) walk.unfinished--;
+                parent->flags = flags;
+            } else {
+                parent->flags = flags;
+                heap_push(&walk, parent);
+            }
+        }
+    }
+
+    if (complete) {
+        *ahead = *behind = 0;
+        GHashTableIter it;
+        gpointer value;
+        g_hash_table_iter_init(&it, walk.commits);
+        while (g_hash_table_iter_next(&it, NULL, &value)) {
+            guint flags = ((WalkCommit *)value)->flags;
+            if (flags == WALK_FROM_HEAD) (*ahead)++;
+            else if (flags == WALK_FROM_UPSTREAM) (*behind)++;
+        }
+    }
+
+    g_ptr_array_free(walk.heap, TRUE);
+    g_hash_table_destroy(walk.commits);
+    objects_free(walk.store);
+    return complete;
+}
+
+// ---- HEAD ----
+
+gboolean git_repo_read_head(const char *git_dir, GitHeadInfo *info) {
+    memset(info, 0, sizeof(*info));
+    info->ahead = info->behind = -1;
+
+    char *head_path = g_build_filename(git_dir, "HEAD", NULL);
+    char *head = read_trimmed(head_path);
+    g_free(head_path);
+    if (!head) return FALSE;
+
+    char *common_dir = git_repo_common_dir(git_dir);
+    guchar head_sha[GIT_SHA_LEN];
+    gboolean has_commit; // FALSE on a branch with no commits yet
+
+    if (g_str_has_prefix(head, "ref: ")) {
+        const char *ref = head + strlen("ref: ");
+        info->branch = g_strdup(g_str_has_prefix(ref, "refs/heads/") ? ref + strlen("refs/heads/") : ref);
+        has_commit = resolve_ref(git_dir, common_dir, ref, head_sha);
+    } else {
+        info->detached = TRUE;
+        info->branch = g_strndup(head, GIT_SHORT_LEN);
+        has_commit = strlen(head) >= GIT_HEX_LEN && hex_to_sha(head, head_sha);
+    }
+
+    if (!info->detached) {
+        char *remote = NULL, *merge = NULL;
+        read_branch_config(common_dir, info->branch, &remote, &merge);
+        if (remote && merge) {
+            const char *merge_branch = g_str_has_prefix(merge, "refs/heads/") ? merge + strlen("refs/heads/") : merge;
+            char *upstream_ref;
+            if (strcmp(remote, ".") == 0) {
+                // Tracks another local branch
+                upstream_ref = g_strdup(merge);
+                info->upstream = g_strdup(merge_branch);
+            } else {
+                upstream_ref = g_strdup_printf("refs/remotes/%s/%s", remote, merge_branch);
+                info->upstream = g_strdup_printf("%s/%s", remote, merge_branch);
+            }
+
+            guchar upstream_sha[GIT_SHA_LEN];
+            if (has_commit && resolve_ref(git_dir, common_dir, upstream_ref, upstream_sha)) {
+                count_divergence(common_dir, head_sha, upstream_sha, &info->ahead, &info->behind);
+            }
+            g_free(upstream_ref);
+        }
+        g_free(remote);
+        g_free(merge);
+    }
+
+    g_free(common_dir);
+    g_free(head);
+    return TRUE;
+}
+
+// ---- Files at HEAD ----
+
+char* git_repo_head_id(const char *git_dir) {
+    char *common_dir = git_repo_common_dir(git_dir);
+    guchar sha[GIT_SHA_LEN];
+    gboolean found = resolve_ref(git_dir, common_dir, "HEAD", sha);
+    g_free(common_dir);
+    if (!found) return NULL;
+
+    char *hex = g_malloc(GIT_HEX_LEN + 1);
+    for (int i = 0; i < GIT_SHA_LEN; i++) g_snprintf(hex + 2 * i, 3, "%02x", sha[i]);
+    return hex;
+}
+
+// Find name in a tree object: entries are "<octal mode> <name>\0<20-byte id>"
+static gboolean tree_lookup(const guchar *tree, gsize size, const char *name, gsize name_len, guchar *sha, gboolean *is_tree) {
+    const guchar *p = tree;
+    const guchar *end = tree + size;
+    while (p < end) {
+        const guchar *space = memchr(p, ' ', end - p);
+        const guchar *nul = space ? memchr(space, '\0', end - space) : NULL;
+        if (!nul || end - nul < 1 + GIT_SHA_LEN) return FALSE;
+        if ((gsize)(nul - space - 1) == name_len && memcmp(space + 1, name, name_len) == 0) {
+            memcpy(sha, nul + 1, GIT_SHA_LEN);
+            *is_tree = *p == '4'; // 40000
+            return TRUE;
+        }
+        p = nul + 1 + GIT_SHA_LEN;
+    }
+    return FALSE;
+}
+
+guchar* git_repo_read_head_file(const char *git_dir, const char *rel_path, gsize *len) {
+    char *common_dir = git_repo_common_dir(git_dir);
+    guchar sha[GIT_SHA_LEN];
+    gboolean found = resolve_ref(git_dir, common_dir, "HEAD", sha);
+    GitObjects *store = found ? objects_open(common_dir) : NULL;
+    g_free(common_dir);
+    if (!store) return NULL;
+
+    // Commit, then its tree, then one tree per path component
+    int type = 0;
+    gsize size = 0;
+    guchar *data = read_object(store, sha, &type, &size, 0);
+    found = data && type == OBJ_COMMIT && g_str_has_prefix((const char *)data, "tree ") &&
+            hex_to_sha((const char *)data + strlen("tree "), sha);
+    g_free(data);
+    data = NULL;
+
+    gboolean is_tree = TRUE;
+    const char *component = rel_path;
+    while (found && *component) {
+        data = read_object(store, sha, &type, &size, 0);
+        if (!data || type != OBJ_TREE || !is_tree) {
+            found = FALSE;
+            break;
+        }
+        const char *slash = strchr(component, '/');
+        gsize name_len = slash ? (gsize)(slash - component) : strlen(component);
+        found = tree_lookup(data, size, component, name_len, sha, &is_tree);
+        g_clear_pointer(&data, g_free);
+        component = slash ? slash + 1 : component + name_len;
+    }
+
+    if (found && !is_tree) {
+        data = read_object(store, sha, &type, &size, 0);
+        if (data && type != OBJ_BLOB) g_clear_pointer(&data, g_free);
+        if (data) *len = size;
+    } else {
+        data = NULL;
+    }
+    objects_free(store);
+    return data;
+}
+
+void git_head_info_clear(GitHeadInfo *info) {
+    g_clear_pointer(&info->branch, g_free);
+    g_clear_pointer(&info->upstream, g_free);
+}
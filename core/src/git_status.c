@@ -0,0 +1,130 @@
+#include "git_status.h"
+#include <string.h>
+
+// Space-separated fields before the path in each record type
+#define FIELDS_ORDINARY 8   // 1 XY sub mH mI mW hH hI path
+#define FIELDS_RENAMED 9    // 2 XY sub mH mI mW hH hI Xscore path\0origPath
+#define FIELDS_UNMERGED 10  // u XY sub m1 m2 m3 mW h1 h2 h3 path
+
+struct _GitStatusParser {
+    GitStatusFunc func;
+    gpointer user_data;
+    GByteArray *carry;   // Start of a record the last chunk cut off
+    gboolean broken;
+};
+
+gboolean git_file_status_is_unmerged(GitFileStatus status) {
+    char x = GIT_FILE_STATUS_INDEX(status);
+    char y = GIT_FILE_STATUS_WORKTREE(status);
+    return x == 'U' || y == 'U' || (x == 'A' && y == 'A') || (x == 'D' && y == 'D');
+}
+
+static const char* skip_fields(const char *p, const char *end, int n) {
+    while (n > 0 && p < end) {
+        const char *space = memchr(p, ' ', end - p);
+        if (!space) return NULL;
+        p = space + 1;
+        n--;
+    }
+    return n == 0 ? p : NULL;
+}
+
+static char column(char c) {
+    return c == '.' ? ' ' : c;
+}
+
+// Parse one record at data; returns the bytes it spans, or 0 if it is not complete yet
+static gsize parse_record(GitStatusParser *parser, const char *data, gsize len) {
+    const char *nul = memchr(data, '\0', len);
+    if (!nul) return 0;
+    gsize consumed = nul - data + 1;
+
+    int fields;
+    switch (data[0]) {
+        case '1': fields = FIELDS_ORDINARY; break;
+        case 'u': fields = FIELDS_UNMERGED; break;
+        case '2': {
+            // The original path follows as a second NUL-terminated string
+            const char *orig_end = memchr(nul + 1, '\0', len - consumed);
+            if (!orig_end) return 0;
+            consumed = orig_end - data + 1;
+            fields = FIELDS_RENAMED;
+            break;
+        }
+        case '?':
+        case '!':
+            if (nul - data < 3 || data[1] != ' ') {
+                parser->broken = TRUE;
+                return consumed;
+            }
+            parser->func(data + 2, nul - data - 2, data[0] == '?' ? GIT_FILE_UNTRACKED : GIT_FILE_IGNORED, parser->user_data);
+            return consumed;
+        case '#':
+            return consumed; // Headers (--branch, --show-stash)
+        default:
+            parser->broken = TRUE;
+            return consumed;
+    }
+
+    const char *path = skip_fields(data, nul, fields);
+    if (!path || path == nul) {
+        parser->broken = TRUE;
+        return consumed;
+    }
+
+    char x = column(data[2]);
+    char y = column(data[3]);
+    // "S..U": a submodule whose only change is untracked content inside it
+    const char *sub = data + 5;
+    if (sub[0] == 'S' && sub[1] == '.' && sub[2] == '.' && sub[3] == 'U' && y == 'M') y = '?';
+
+    parser->func(path, nul - path, GIT_FILE_STATUS(x, y), parser->user_data);
+    return consumed;
+}
+
+GitStatusParser* git_status_parser_new(GitStatusFunc func, gpointer user_data) {
+    GitStatusParser *parser = g_new0(GitStatusParser, 1);
+    parser->func = func;
+    parser->user_data = user_data;
+    parser->carry = g_byte_array_new();
+    return parser;
+}
+
+void git_status_parser_feed(GitStatusParser *parser, const char *data, gsize len) {
+    gsize pos = 0;
+
+    // Finish the record the previous chunk cut off, one NUL-terminated piece at a time
+    while (parser->carry->len > 0) {
+        const char *nul = memchr(data + pos, '\0', len - pos);
+        if (!nul) {
+            g_byte_array_append(parser->carry, (const guint8 *)data + pos, len - pos);
+            return;
+        }
+        gsize piece = nul - (data + pos) + 1;
+        g_byte_array_append(parser->carry, (const guint8 *)data + pos, piece);
+        pos += piece;
+        if (parse_record(parser, (const char *)parser->carry->data, parser->carry->len) > 0) {
+            g_byte_array_set_size(parser->carry, 0);
+        }
+    }
+
+    // Everything else is parsed in place
+    while (pos < len) {
+        gsize consumed = parse_record(parser, data + pos, len - pos);
+        if (consumed == 0) {
+            g_byte_array_append(parser->carry, (const guint8 *)data + pos, len - pos);
+            return;
+        }
+        pos += consumed;
+    }
+}
+
+gboolean git_status_parser_finish(GitStatusParser *parser) {
+    return !parser->broken && parser->carry->len == 0;
+}
+
+void git_status_parser_free(GitStatusParser *parser) {
+    if (!parser) return;
+    g_byte_array_free(parser->carry, TRUE);
+    g_free(parser);
+}
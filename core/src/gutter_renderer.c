@@ -0,0 +1,101 @@
+#include "gutter_renderer.h"
+#include "line_diff.h"
+
+#define GUTTER_BAR_WIDTH 3
+
+typedef enum {
+    GUTTER_ADDED,
+    GUTTER_MODIFIED,
+    GUTTER_DELETED
+} GutterKind;
+
+static const char *gutter_colors[] = { "#73C991", "#3584e4", "#F85149" };
+
+struct _GutterRenderer {
+    GtkSourceGutterRenderer parent;
+    GArray *hunks;        // DiffHunk, by new_start
+    GdkRGBA colors[3];    // Per GutterKind
+};
+
+G_DEFINE_TYPE(GutterRenderer, gutter_renderer, GTK_SOURCE_TYPE_GUTTER_RENDERER)
+
+// Buffer lines a hunk paints: its new lines, or for a pure deletion the line above the gap
+static void hunk_lines(const DiffHunk *hunk, guint *first, guint *last) {
+    if (hunk->new_count == 0) {
+        *first = hunk->new_start > 0 ? hunk->new_start - 1 : 0;
+        *last = *first;
+    } else {
+        *first = hunk->new_start;
+        *last = hunk->new_start + hunk->new_count - 1;
+    }
+}
+
+// Hunks never overlap or touch, so a binary search on the line finds the only candidate
+static gboolean lookup_line(GutterRenderer *renderer, guint line, GutterKind *kind) {
+    if (!renderer->hunks) return FALSE;
+    guint lo = 0, hi = renderer->hunks->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        const DiffHunk *hunk = &g_array_index(renderer->hunks, DiffHunk, mid);
+        guint first, last;
+        hunk_lines(hunk, &first, &last);
+        if (line < first) {
+            hi = mid;
+        } else if (line > last) {
+            lo = mid + 1;
+        } else {
+            if (hunk->old_count == 0) *kind = GUTTER_ADDED;
+            else if (hunk->new_count == 0) *kind = GUTTER_DELETED;
+            else *kind = GUTTER_MODIFIED;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void gutter_renderer_draw(GtkSourceGutterRenderer *base, cairo_t *cr, GdkRectangle *background_area,
+                                 GdkRectangle *cell_area, GtkTextIter *start, GtkTextIter *end,
+                                 GtkSourceGutterRendererState state) {
+    GTK_SOURCE_GUTTER_RENDERER_CLASS(gutter_renderer_parent_class)->draw(base, cr, background_area, cell_area, start, end, state);
+
+    GutterRenderer *renderer = GUTTER_RENDERER(base);
+    GutterKind kind;
+    if (!lookup_line(renderer, gtk_text_iter_get_line(start), &kind)) return;
+
+    gdk_cairo_set_source_rgba(cr, &renderer->colors[kind]);
+    if (kind == GUTTER_DELETED) {
+        // Deleted lines sit between rows; mark the bottom edge of the row above
+        cairo_rectangle(cr, cell_area->x, cell_area->y + cell_area->height - GUTTER_BAR_WIDTH,
+                        cell_area->width, GUTTER_BAR_WIDTH);
+    } else {
+        cairo_rectangle(cr, cell_area->x, cell_area->y, cell_area->width, cell_area->height);
+    }
+    cairo_fill(cr);
+}
+
+static void gutter_renderer_finalize(GObject *object) {
+    GutterRenderer *renderer = GUTTER_RENDERER(object);
+    if (renderer->hunks) g_array_unref(renderer->hunks);
+    G_OBJECT_CLASS(gutter_renderer_parent_class)->finalize(object);
+}
+
+static void gutter_renderer_class_init(GutterRendererClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = gutter_renderer_finalize;
+    GTK_SOURCE_GUTTER_RENDERER_CLASS(klass)->draw = gutter_renderer_draw;
+}
+
+static void gutter_renderer_init(GutterRenderer *renderer) {
+    for (int i = 0; i < 3; i++) gdk_rgba_parse(&renderer->colors[i], gutter_colors[i]);
+    gtk_source_gutter_renderer_set_size(GTK_SOURCE_GUTTER_RENDERER(renderer), GUTTER_BAR_WIDTH);
+}
+
+GutterRenderer* gutter_renderer_new() {
+    return g_object_new(GUTTER_TYPE_RENDERER, NULL);
+}
+
+void gutter_renderer_set_hunks(GutterRenderer *renderer, GArray *hunks) {
+    if (hunks) g_array_ref(hunks);
+    if (renderer->hunks) g_array_unref(renderer->hunks);
+    renderer->hunks = hunks;
+    gtk_source_gutter_renderer_queue_draw(GTK_SOURCE_GUTTER_RENDERER(renderer));
+}
@@ -0,0 +1,488 @@
+#include "ignore.h"
+#include "git_repo.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+// How each pattern is matched, picked when the file is compiled
+typedef enum {
+    MATCH_LITERAL,  // Exact name or path; basename literals go through a hash table
+    MATCH_SUFFIX,   // "*.ext"
+    MATCH_GLOB      // Anything else, via glob_match()
+} MatchKind;
+
+typedef struct {
+    char *text;         // Pattern body (no '!', leading '/' or trailing '/')
+    gsize len;
+    guint index;        // Position in the file; later patterns win
+    MatchKind kind;
+    gboolean negate;
+    gboolean dir_only;
+    gboolean anchored;  // Matched against the path below the file's folder, not the name
+} IgnorePattern;
+
+typedef struct {
+    gatomicrefcount ref_count;
+    char *base;             // Folder relative to the workspace root ("" for the root)
+    char *outer;            // For rules from above the root: path from their folder down to it
+    GPtrArray *patterns;    // IgnorePattern*, everything not in the hash tables
+    GHashTable *names;      // Literal basename -> last index + 1
+    GHashTable *dir_names;  // Same, for patterns ending in '/'
+    guint n_patterns;
+} IgnoreRules;
+
+struct _IgnoreMatcher {
+    gatomicrefcount ref_count;
+    char *root;
+    GRWLock lock;
+    GHashTable *dir_rules;  // Relative folder -> IgnoreRules* of its .gitignore
+    IgnoreRules *defaults;
+    IgnoreRules *exclude;
+    char *exclude_path;     // info/exclude of the repository holding the root
+    GPtrArray *outer_rules; // IgnoreRules* of .gitignore files between the work tree and the root, nearest first
+    IgnoreRules *override;
+};
+
+struct _IgnoreScope {
+    char *rel_dir;          // Folder relative to the root
+    GPtrArray *rules;       // IgnoreRules*, highest precedence first
+    GString *scratch;
+};
+
+// Heavy folders skipped when there is no repository to say otherwise
+static const char *default_patterns =
+    "node_modules/\nvendor/\nvenv/\nenv/\n__pycache__/\n.tox/\n"
+    "dist/\nbuild/\ntarget/\nout/\ncoverage/\n";
+
+static gboolean has_glob_chars(const char *s, gsize len) {
+    for (gsize i = 0; i < len; i++) {
+        if (s[i] == '*' || s[i] == '?' || s[i] == '[' || s[i] == '\\') return TRUE;
+    }
+    return FALSE;
+}
+
+// Returns the position after the class, or NULL if the class is malformed
+static const char* match_class(const char *p, char c, gboolean *matched) {
+    gboolean negate = (*p == '!' || *p == '^');
+    if (negate) p++;
+
+    gboolean found = FALSE;
+    gboolean first = TRUE;
+    while (*p && (first || *p != ']')) {
+        char lo = *p;
+        if (lo == '\\' && p[1]) lo = *++p;
+        char hi = lo;
+        if (p[1] == '-' && p[2] && p[2] != ']') {
+            p += 2;
+            hi = *p;
+            if (hi == '\\' && p[1]) hi = *++p;
+        }
+        if (c >= lo && c <= hi) found = TRUE;
+        p++;
+        first = FALSE;
+    }
+    if (*p != ']') return NULL;
+    *matched = found != negate;
+    return p + 1;
+}
+
+// Shell glob where '*' and '?' stop at '/' and "**" crosses folders
+static gboolean glob_match(const char *p, const char *s) {
+    while (*p) {
+        switch (*p) {
+            case '?':
+                if (!*s || *s == '/') return FALSE;
+                break;
+            case '*':
+                if (p[1] == '*') {
+                    const char *rest = p + 2;
+                    if (*rest == '\0') return TRUE;
+                    if (*rest == '/') {
+                        // "**/" matches zero or more whole folders
+                        rest++;
+                        for (const char *t = s; ; t++) {
+                            if (glob_match(rest, t)) return TRUE;
+                            t = strchr(t, '/');
+                            if (!t) return FALSE;
+                        }
+                    }
+                    for (const char *t = s; ; t++) {
+                        if (glob_match(rest, t)) return TRUE;
+                        if (!*t) return FALSE;
+                    }
+                }
+                for (const char *t = s; ; t++) {
+                    if (glob_match(p + 1, t)) return TRUE;
+                    if (!*t || *t == '/') return FALSE;
+                }
+            case '[': {
+                if (!*s || *s == '/') return FALSE;
+                gboolean matched;
+                const char *next = match_class(p + 1, *s, &matched);
+                if (next) {
+                    if (!matched) return FALSE;
+                    p = next;
+                    s++;
+                    continue;
+                }
+                if (*s != '[') return FALSE; // Unterminated: literal '['
+                break;
+            }
+            case '\\':
+                if (p[1]) p++;
+                /* fall through */
+            default:
+                if (*p != *s) return FALSE;
+                break;
+        }
+        p++;
+        s++;
+    }
+    return *s == '\0';
+}
+
+static void free_pattern(gpointer data) {
+    IgnorePattern *pattern = (IgnorePattern *)data;
+    g_free(pattern->text);
+    g_free(pattern);
+}
+
+static IgnoreRules* rules_ref(IgnoreRules *rules) {
+    g_atomic_ref_count_inc(&rules->ref_count);
+    return rules;
+}
+
+static void rules_unref(gpointer data) {
+    IgnoreRules *rules = (IgnoreRules *)data;
+    if (!rules || !g_atomic_ref_count_dec(&rules->ref_count)) return;
+    g_ptr_array_free(rules->patterns, TRUE);
+    g_hash_table_destroy(rules->names);
+    g_hash_table_destroy(rules->dir_names);
+    g_free(rules->base);
+    g_free(rules->outer);
+    g_free(rules);
+}
+
+static void compile_line(IgnoreRules *rules, char *line) {
+    // Trailing spaces are dropped unless escaped
+    gsize len = strlen(line);
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\r') &&
+           !(len > 1 && line[len - 2] == '\\')) {
+        len--;
+    }
+    line[len] = '\0';
+    if (len == 0 || line[0] == '#') return;
+
+    gboolean negate = FALSE;
+    if (line[0] == '!') {
+        negate = TRUE;
+        line++;
+        len--;
+    } else if (line[0] == '\\' && (line[1] == '!' || line[1] == '#')) {
+        line++;
+        len--;
+    }
+
+    gboolean dir_only = FALSE;
+    if (len > 0 && line[len - 1] == '/') {
+        dir_only = TRUE;
+        line[--len] = '\0';
+    }
+    if (len == 0) return;
+
+    // A slash anywhere but the end ties the pattern to this .gitignore's folder
+    gboolean anchored = strchr(line, '/') != NULL;
+    if (line[0] == '/') {
+        line++;
+        len--;
+    }
+    if (len == 0) return;
+
+    guint index = rules->n_patterns++;
+    if (!anchored && !negate && !has_glob_chars(line, len)) {
+        // Plain names are the bulk of most files: one hash lookup per entry
+        g_hash_table_insert(dir_only ? rules->dir_names : rules->names, g_strdup(line), GUINT_TO_POINTER(index + 1));
+        return;
+    }
+
+    IgnorePattern *pattern = g_new0(IgnorePattern, 1);
+    pattern->text = g_strndup(line, len);
+    pattern->len = len;
+    pattern->index = index;
+    pattern->negate = negate;
+    pattern->dir_only = dir_only;
+    pattern->anchored = anchored;
+    if (!has_glob_chars(line, len)) {
+        pattern->kind = MATCH_LITERAL;
+    } else if (!anchored && line[0] == '*' && !has_glob_chars(line + 1, len - 1)) {
+        pattern->kind = MATCH_SUFFIX;
+    } else {
+        pattern->kind = MATCH_GLOB;
+    }
+    g_ptr_array_add(rules->patterns, pattern);
+}
+
+static IgnoreRules* rules_compile(const char *base, const char *contents) {
+    IgnoreRules *rules = g_new0(IgnoreRules, 1);
+    g_atomic_ref_count_init(&rules->ref_count);
+    rules->base = g_strdup(base);
+    rules->patterns = g_ptr_array_new_with_free_func(free_pattern);
+    rules->names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    rules->dir_names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    char **lines = g_strsplit(contents, "\n", -1);
+    for (int i = 0; lines[i]; i++) compile_line(rules, lines[i]);
+    g_strfreev(lines);
+    return rules;
+}
+
+static IgnoreRules* rules_load(const char *base, int dir_fd, const char *file) {
+    int fd = dir_fd >= 0 ? openat(dir_fd, file, O_RDONLY | O_CLOEXEC) : open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    GString *contents = g_string_new(NULL);
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) g_string_append_len(contents, buf, n);
+    close(fd);
+
+    IgnoreRules *rules = rules_compile(base, contents->str);
+    g_string_free(contents, TRUE);
+    return rules;
+}
+
+static gboolean pattern_matches(IgnorePattern *pattern, const char *name, const char *rel, gboolean is_dir) {
+    if (pattern->dir_only && !is_dir) return FALSE;
+    const char *subject = pattern->anchored ? rel : name;
+
+    switch (pattern->kind) {
+        case MATCH_LITERAL:
+            return strcmp(subject, pattern->text) == 0;
+        case MATCH_SUFFIX: {
+            gsize n = strlen(subject);
+            gsize suffix = pattern->len - 1;
+            return n >= suffix && memcmp(subject + n - suffix, pattern->text + 1, suffix) == 0;
+        }
+        default:
+            return glob_match(pattern->text, subject);
+    }
+}
+
+// Index + 1 of the last pattern in the file that matches, or 0
+static guint rules_match(IgnoreRules *rules, IgnoreScope *scope, const char *name, gboolean is_dir, gboolean *negate) {
+    guint best = GPOINTER_TO_UINT(g_hash_table_lookup(rules->names, name));
+    if (is_dir) best = MAX(best, GPOINTER_TO_UINT(g_hash_table_lookup(rules->dir_names, name)));
+    *negate = FALSE;
+
+    const char *rel = NULL;
+    for (guint i = rules->patterns->len; i > 0; i--) {
+        IgnorePattern *pattern = g_ptr_array_index(rules->patterns, i - 1);
+        if (pattern->index + 1 <= best) break;
+
+        if (pattern->anchored && !rel) {
+            // Path of the entry below the folder holding the rules
+            const char *below = scope->rel_dir + strlen(rules->base);
+            if (*below == '/') below++;
+            g_string_assign(scope->scratch, rules->outer ? rules->outer : "");
+            if (rules->outer && *below) g_string_append_c(scope->scratch, '/');
+            g_string_append(scope->scratch, below);
+            if (scope->scratch->len > 0) g_string_append_c(scope->scratch, '/');
+            g_string_append(scope->scratch, name);
+            rel = scope->scratch->str;
+        }
+        if (pattern_matches(pattern, name, rel, is_dir)) {
+            *negate = pattern->negate;
+            return pattern->index + 1;
+        }
+    }
+    return best;
+}
+
+gboolean ignore_scope_match(IgnoreScope *scope, const char *name, gboolean is_dir) {
+    for (guint i = 0; i < scope->rules->len; i++) {
+        gboolean negate;
+        if (rules_match(g_ptr_array_index(scope->rules, i), scope, name, is_dir, &negate)) return !negate;
+    }
+    return FALSE;
+}
+
+static const char* relative_to_root(IgnoreMatcher *matcher, const char *path) {
+    size_t root_len = strlen(matcher->root);
+    if (strncmp(path, matcher->root, root_len) != 0) return NULL;
+    if (path[root_len] == '\0') return "";
+    if (path[root_len] != '/') return NULL;
+    return path + root_len + 1;
+}
+
+IgnoreScope* ignore_matcher_scope(IgnoreMatcher *matcher, const char *dir_path) {
+    IgnoreScope *scope = g_new0(IgnoreScope, 1);
+    const char *rel = relative_to_root(matcher, dir_path);
+    scope->rel_dir = g_strdup(rel ? rel : "");
+    scope->rules = g_ptr_array_new_with_free_func(rules_unref);
+    scope->scratch = g_string_new(NULL);
+    if (!rel) return scope; // Outside the workspace: nothing applies
+
+    if (matcher->override) g_ptr_array_add(scope->rules, rules_ref(matcher->override));
+
+    // Deepest .gitignore first
+    g_rw_lock_reader_lock(&matcher->lock);
+    char *dir = g_strdup(scope->rel_dir);
+    for (;;) {
+        IgnoreRules *rules = g_hash_table_lookup(matcher->dir_rules, dir);
+        if (rules) g_ptr_array_add(scope->rules, rules_ref(rules));
+        if (dir[0] == '\0') break;
+        char *slash = strrchr(dir, '/');
+        if (slash) *slash = '\0';
+        else dir[0] = '\0';
+    }
+    g_free(dir);
+    g_rw_lock_reader_unlock(&matcher->lock);
+
+    for (guint i = 0; i < matcher->outer_rules->len; i++) {
+        g_ptr_array_add(scope->rules, rules_ref(g_ptr_array_index(matcher->outer_rules, i)));
+    }
+    if (matcher->exclude) g_ptr_array_add(scope->rules, rules_ref(matcher->exclude));
+    if (matcher->defaults) g_ptr_array_add(scope->rules, rules_ref(matcher->defaults));
+    return scope;
+}
+
+void ignore_scope_free(IgnoreScope *scope) {
+    if (!scope) return;
+    g_ptr_array_free(scope->rules, TRUE);
+    g_string_free(scope->scratch, TRUE);
+    g_free(scope->rel_dir);
+    g_free(scope);
+}
+
+void ignore_matcher_load_dir(IgnoreMatcher *matcher, int dir_fd, const char *dir_path) {
+    const char *rel = relative_to_root(matcher, dir_path);
+    if (!rel) return;
+
+    // Several crawlers read the same folders; only the first one parses the file
+    g_rw_lock_reader_lock(&matcher->lock);
+    gboolean loaded = g_hash_table_contains(matcher->dir_rules, rel);
+    g_rw_lock_reader_unlock(&matcher->lock);
+    if (loaded) return;
+
+    IgnoreRules *rules;
+    if (dir_fd >= 0) {
+        rules = rules_load(rel, dir_fd, ".gitignore");
+    } else {
+        char *file = g_build_filename(dir_path, ".gitignore", NULL);
+        rules = rules_load(rel, -1, file);
+        g_free(file);
+    }
+
+    g_rw_lock_writer_lock(&matcher->lock);
+    if (!g_hash_table_contains(matcher->dir_rules, rel)) {
+        g_hash_table_insert(matcher->dir_rules, g_strdup(rel), rules); // NULL: no .gitignore
+        rules = NULL;
+    }
+    g_rw_lock_writer_unlock(&matcher->lock);
+    rules_unref(rules);
+}
+
+gboolean ignore_matcher_is_ignored(IgnoreMatcher *matcher, const char *path, gboolean is_dir) {
+    const char *rel = relative_to_root(matcher, path);
+    if (!rel || *rel == '\0') return FALSE;
+
+    // Walk down from the root: nothing inside an ignored folder can be re-included
+    GString *dir = g_string_new(matcher->root);
+    gboolean ignored = FALSE;
+    const char *p = rel;
+    while (!ignored && *p) {
+        const char *end = strchr(p, '/');
+        if (!end) end = p + strlen(p);
+        char *name = g_strndup(p, end - p);
+
+        ignore_matcher_load_dir(matcher, -1, dir->str);
+        IgnoreScope *scope = ignore_matcher_scope(matcher, dir->str);
+        ignored = ignore_scope_match(scope, name, *end ? TRUE : is_dir);
+        ignore_scope_free(scope);
+
+        g_string_append_c(dir, '/');
+        g_string_append(dir, name);
+        g_free(name);
+        p = *end ? end + 1 : end;
+    }
+    g_string_free(dir, TRUE);
+    return ignored;
+}
+
+gboolean ignore_matcher_is_rules_file(IgnoreMatcher *matcher, const char *path) {
+    if (matcher->exclude_path && strcmp(path, matcher->exclude_path) == 0) return TRUE;
+    const char *rel = relative_to_root(matcher, path);
+    if (!rel) return FALSE;
+    const char *slash = strrchr(rel, '/');
+    const char *name = slash ? slash + 1 : rel;
+    return strcmp(name, ".gitignore") == 0 || strcmp(rel, IGNORE_OVERRIDE_FILE) == 0;
+}
+
+IgnoreMatcher* ignore_matcher_new(const char *root) {
+    IgnoreMatcher *matcher = g_new0(IgnoreMatcher, 1);
+    g_atomic_ref_count_init(&matcher->ref_count);
+    g_rw_lock_init(&matcher->lock);
+    matcher->root = g_strdup(root);
+    matcher->dir_rules = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, rules_unref);
+
+    matcher->outer_rules = g_ptr_array_new_with_free_func(rules_unref);
+
+    // The root may be a folder inside a repository; its exclude file and the
+    // .gitignore files above the root apply all the same
+    char *work_tree = NULL;
+    char *git_dir = git_repo_find_dir(root, &work_tree);
+    if (git_dir) {
+        matcher->exclude_path = g_build_filename(git_dir, "info", "exclude", NULL);
+        matcher->exclude = rules_load("", -1, matcher->exclude_path);
+
+        size_t tree_len = strlen(work_tree);
+        if (strncmp(root, work_tree, tree_len) == 0 && root[tree_len] == '/') {
+            const char *below = root + tree_len + 1;
+            if (matcher->exclude) matcher->exclude->outer = g_strdup(below);
+
+            // Nearest folder first, matching the precedence of the folders inside
+            char *dir = g_path_get_dirname(root);
+            for (;;) {
+                char *file = g_build_filename(dir, ".gitignore", NULL);
+                IgnoreRules *rules = rules_load("", -1, file);
+                g_free(file);
+                if (rules) {
+                    rules->outer = g_strdup(root + strlen(dir) + 1);
+                    g_ptr_array_add(matcher->outer_rules, rules);
+                }
+                if (strlen(dir) <= tree_len) break;
+                char *parent = g_path_get_dirname(dir);
+                g_free(dir);
+                dir = parent;
+            }
+            g_free(dir);
+        }
+    } else {
+        matcher->defaults = rules_compile("", default_patterns);
+    }
+    g_free(git_dir);
+    g_free(work_tree);
+
+    char *override = g_build_filename(root, IGNORE_OVERRIDE_FILE, NULL);
+    matcher->override = rules_load("", -1, override);
+    g_free(override);
+    return matcher;
+}
+
+IgnoreMatcher* ignore_matcher_ref(IgnoreMatcher *matcher) {
+    g_atomic_ref_count_inc(&matcher->ref_count);
+    return matcher;
+}
+
+void ignore_matcher_unref(IgnoreMatcher *matcher) {
+    if (!matcher || !g_atomic_ref_count_dec(&matcher->ref_count)) return;
+    g_hash_table_destroy(matcher->dir_rules);
+    rules_unref(matcher->defaults);
+    rules_unref(matcher->exclude);
+    g_free(matcher->exclude_path);
+    g_ptr_array_free(matcher->outer_rules, TRUE);
+    rules_unref(matcher->override);
+    g_rw_lock_clear(&matcher->lock);
+    g_free(matcher->root);
+    g_free(matcher);
+}
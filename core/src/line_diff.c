@@ -0,0 +1,214 @@
+#include "line_diff.h"
+#include <string.h>
+
+#define LINE_DIFF_MAX_COST 4096  // Edit distance past which a region is taken as replaced wholesale
+
+struct _LineTable {
+    GHashTable *ids;      // Line text -> id + 1
+    GStringChunk *text;   // Backing store for the keys
+};
+
+LineTable* line_table_new() {
+    LineTable *table = g_new0(LineTable, 1);
+    table->ids = g_hash_table_new(g_str_hash, g_str_equal);
+    table->text = g_string_chunk_new(64 * 1024);
+    return table;
+}
+
+void line_table_free(LineTable *table) {
+    if (!table) return;
+    g_hash_table_destroy(table->ids);
+    g_string_chunk_free(table->text);
+    g_free(table);
+}
+
+guint line_table_size(LineTable *table) {
+    return g_hash_table_size(table->ids);
+}
+
+guint line_table_intern(LineTable *table, const char *line, gsize len) {
+    if (len > 0 && line[len - 1] == '\r') len--;
+
+    char stack[256];
+    char *key = len < sizeof(stack) ? stack : g_malloc(len + 1);
+    memcpy(key, line, len);
+    key[len] = '\0';
+
+    gpointer value = g_hash_table_lookup(table->ids, key);
+    guint id;
+    if (value) {
+        id = GPOINTER_TO_UINT(value) - 1;
+    } else {
+        id = g_hash_table_size(table->ids);
+        g_hash_table_insert(table->ids, g_string_chunk_insert_len(table->text, key, len), GUINT_TO_POINTER(id + 1));
+    }
+    if (key != stack) g_free(key);
+    return id;
+}
+
+void line_table_split(LineTable *table, const char *text, gsize len, GArray *ids) {
+    const char *p = text;
+    const char *end = text + len;
+    for (;;) {
+        const char *nl = memchr(p, '\n', end - p);
+        guint id = line_table_intern(table, p, (nl ? nl : end) - p);
+        g_array_append_val(ids, id);
+        if (!nl) break;
+        p = nl + 1;
+    }
+}
+
+// ---- Myers ----
+
+typedef struct {
+    const guint *a;
+    const guint *b;
+    gboolean *a_changed;
+    gboolean *b_changed;
+    int *v_forward;   // Furthest x reached per diagonal, sized for the whole input
+    int *v_backward;
+} DiffContext;
+
+static void mark_changed(DiffContext *ctx, int a_lo, int a_hi, int b_lo, int b_hi) {
+    for (int i = a_lo; i < a_hi; i++) ctx->a_changed[i] = TRUE;
+    for (int j = b_lo; j < b_hi; j++) ctx->b_changed[j] = TRUE;
+}
+
+// Find where a shortest edit path crosses the middle, searching from both ends
+// at once. FALSE if the edit distance exceeds LINE_DIFF_MAX_COST.
+static gboolean middle_snake(DiffContext *ctx, int a_lo, int a_hi, int b_lo, int b_hi, int *x_mid, int *y_mid) {
+    const guint *a = ctx->a + a_lo;
+    const guint *b = ctx->b + b_lo;
+    int n = a_hi - a_lo;
+    int m = b_hi - b_lo;
+    int max_d = MIN((n + m + 1) / 2, LINE_DIFF_MAX_COST);
+    int offset = max_d + 1;
+    int *v1 = ctx->v_forward;
+    int *v2 = ctx->v_backward;
+    for (int i = 0; i < 2 * offset + 1; i++) v1[i] = v2[i] = -1;
+    v1[offset + 1] = 0;
+    v2[offset + 1] = 0;
+
+    int delta = n - m;
+    gboolean front = (delta & 1) != 0;  // Odd delta: paths meet while extending forwards
+    int k1_start = 0, k1_end = 0, k2_start = 0, k2_end = 0;
+
+    for (int d = 0; d < max_d; d++) {
+        for (int k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2) {
+            int k1_offset = offset + k1;
+            int x1 = (k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1]))
+                         ? v1[k1_offset + 1] : v1[k1_offset - 1] + 1;
+            int y1 = x1 - k1;
+            while (x1 < n && y1 < m && a[x1] == b[y1]) {
+                x1++;
+                y1++;
+            }
+            v1[k1_offset] = x1;
+            if (x1 > n) {
+                k1_end += 2;       // Ran off the right
+            } else if (y1 > m) {
+                k1_start += 2;     // Ran off the bottom
+            } else if (front) {
+                int k2_offset = offset + delta - k1;
+                if (k2_offset >= 0 && k2_offset < 2 * offset + 1 && v2[k2_offset] != -1 && x1 >= n - v2[k2_offset]) {
+                    *x_mid = x1;
+                    *y_mid = y1;
+                    return TRUE;
+                }
+            }
+        }
+
+        for (int k2 = -d + k2_start; k2 <= d - k2_end; k2 += 2) {
+            int k2_offset = offset + k2;
+            int x2 = (k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1]))
+                         ? v2[k2_offset + 1] : v2[k2_offset - 1] + 1;
+            int y2 = x2 - k2;
+            while (x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1]) {
+                x2++;
+                y2++;
+            }
+            v2[k2_offset] = x2;
+            if (x2 > n) {
+                k2_end += 2;
+            } else if (y2 > m) {
+                k2_start += 2;
+            } else if (!front) {
+                int k1_offset = offset + delta - k2;
+                if (k1_offset >= 0 && k1_offset < 2 * offset + 1 && v1[k1_offset] != -1) {
+                    int x1 = v1[k1_offset];
+                    int y1 = offset + x1 - k1_offset;
+                    if (x1 >= n - x2) {
+                        *x_mid = x1;
+                        *y_mid = y1;
+                        return TRUE;
+                    }
+                }
+            }
+        }
+    }
+    return FALSE;
+}
+
+static void diff_range(DiffContext *ctx, int a_lo, int a_hi, int b_lo, int b_hi) {
+    // Common prefix and suffix never take part in the search
+    while (a_lo < a_hi && b_lo < b_hi && ctx->a[a_lo] == ctx->b[b_lo]) {
+        a_lo++;
+        b_lo++;
+    }
+    while (a_lo < a_hi && b_lo < b_hi && ctx->a[a_hi - 1] == ctx->b[b_hi - 1]) {
+        a_hi--;
+        b_hi--;
+    }
+    if (a_lo == a_hi || b_lo == b_hi) {
+        mark_changed(ctx, a_lo, a_hi, b_lo, b_hi);
+        return;
+    }
+
+    int x, y;
+    if (!middle_snake(ctx, a_lo, a_hi, b_lo, b_hi, &x, &y)) {
+        mark_changed(ctx, a_lo, a_hi, b_lo, b_hi);
+        return;
+    }
+    diff_range(ctx, a_lo, a_lo + x, b_lo, b_lo + y);
+    diff_range(ctx, a_lo + x, a_hi, b_lo + y, b_hi);
+}
+
+GArray* line_diff(const guint *old_ids, guint old_n, const guint *new_ids, guint new_n) {
+    GArray *hunks = g_array_new(FALSE, FALSE, sizeof(DiffHunk));
+
+    DiffContext ctx;
+    ctx.a = old_ids;
+    ctx.b = new_ids;
+    ctx.a_changed = g_new0(gboolean, old_n + 1);
+    ctx.b_changed = g_new0(gboolean, new_n + 1);
+    int v_len = 2 * (MIN((int)((old_n + new_n + 1) / 2), LINE_DIFF_MAX_COST) + 1) + 1;
+    ctx.v_forward = g_new(int, v_len);
+    ctx.v_backward = g_new(int, v_len);
+    diff_range(&ctx, 0, old_n, 0, new_n);
+
+    guint i = 0, j = 0;
+    while (i < old_n || j < new_n) {
+        if (i < old_n && j < new_n && !ctx.a_changed[i] && !ctx.b_changed[j]) {
+            i++;
+            j++;
+            continue;
+        }
+        DiffHunk hunk = { i, 0, j, 0 };
+        while (i < old_n && ctx.a_changed[i]) {
+            i++;
+            hunk.old_count++;
+        }
+        while (j < new_n && ctx.b_changed[j]) {
+            j++;
+            hunk.new_count++;
+        }
+        if (hunk.old_count == 0 && hunk.new_count == 0) break; // Unreachable unless the marks disagree
+        g_array_append_val(hunks, hunk);
+    }
+
+    g_free(ctx.a_changed);
+    g_free(ctx.b_changed);
+    g_free(ctx.v_forward);
+    g_free(ctx.v_backward);
+    return hunks;
+}
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <dirent.h>
 #include "file_ops.h"
+#include "file_index.h"
 
 GtkWidget *search_popup, *search_entry, *search_list;
 
@@ -15,16 +16,24 @@ static void filter_file_list(const char *query) {
     gboolean first = FALSE;
     int count = 0;
 
-    for (GList *l = file_list; l != NULL; l = l->next) {
+    // Paths are rebuilt into reused buffers instead of allocating per entry
+    GString *path = g_string_new(NULL);
+    GString *lower_path = g_string_new(NULL);
+    guint n_entries = file_index_get_count(file_index);
+
+    for (FileId id = 0; id < n_entries; id++) {
         if (count >= 100) break; // Hard cap UI elements to prevent rendering freeze
+        if (!file_index_is_live(file_index, id)) continue;
+        if (file_index_get_node(file_index, id)->flags & FILE_NODE_IGNORED) continue; // Explorer only
+
+        file_index_get_path(file_index, id, path);
+        g_string_assign(lower_path, path->str);
+        for (gsize i = 0; i < lower_path->len; i++) lower_path->str[i] = g_ascii_tolower(lower_path->str[i]);
         
-        const char *path = (const char *)l->data;
-        char *lower_path = g_ascii_strdown(path, -1);
-        
-        if (g_strrstr(lower_path, lower_query) || strlen(lower_query) == 0) {
+        if (g_strrstr(lower_path->str, lower_query) || strlen(lower_query) == 0) {
             GtkTreeIter iter;
             gtk_list_store_append(store, &iter);
-            gtk_list_store_set(store, &iter, 0, path, -1);
+            gtk_list_store_set(store, &iter, 0, path->str, -1);
             count++;
 
             if (!first) {
@@ -34,8 +43,9 @@ static void filter_file_list(const char *query) {
                 first = TRUE;
             }
         }
-        g_free(lower_path);
     }
+    g_string_free(lower_path, TRUE);
+    g_string_free(path, TRUE);
     g_free(lower_query);
 }
 
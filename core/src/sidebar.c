@@ -2,451 +2,1947 @@
 #include "file_ops.h"
 #include "editor.h"
 #include "ui.h"
-#include <dirent.h>
+#include "crawler.h"
+#include "watcher.h"
+#include "file_index.h"
+#include "sidebar_model.h"
+#include "stat_batch.h"
+#include "git_repo.h"
+#include "git_index.h"
+#include "git_gutter.h"
+#include "git_pool.h"
+#include "git_status.h"
+#include "git_jobs.h"
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <string.h>
 #include <gio/gunixinputstream.h>
 
-typedef struct {
-    char *path;
-    GtkTreeIter parent_iter;
-    gboolean has_parent;
-} DirTask;
+static Crawler *tree_crawler = NULL;   // Reads single folders as they are expanded
+static Crawler *index_crawler = NULL;  // Walks the whole workspace for file_index
+static Watcher *workspace_watcher = NULL; // Recursive inotify watch over the open folder
+static IgnoreMatcher *workspace_ignore = NULL; // .gitignore rules of the open folder
+static guint refresh_timeout_id = 0;
+static guint git_poll_timeout_id = 0;
+static GHashTable *global_git_status = NULL; // Path -> GitStatusEntry*, changed files only
+
+static char *workspace_git_dir = NULL; // Repository folder of the workspace, NULL outside one
+static char *workspace_work_tree = NULL; // Folder holding .git; may sit above current_folder
+static GitPool *workspace_git_pool = NULL; // Batch git helpers for the work tree, started on demand
 
+GitPool* get_git_pool() {
+    return workspace_git_pool ? git_pool_ref(workspace_git_pool) : NULL;
+}
+
+// Every repository with files in the workspace: the one holding the open
+// folder, if any, and each nested repository or submodule the index crawl
+// found a .git in. Each has its own status runs, tracked checks and branch.
 typedef struct {
-    GQueue *queue;
-    gboolean cancelled;
-    guint source_id;
-} PopulateContext;
+    char *work_tree;
+    char *git_dir;
+    char branch[256];  // As shown in the status bar, with ahead/behind
+    gboolean written;  // Tracked files were written since its last tracked check
+} WorkspaceRepo;
+
+static GHashTable *workspace_repos = NULL; // Work tree -> WorkspaceRepo*
+
+static WorkspaceRepo* workspace_repo_new(char *work_tree, char *git_dir) {
+    WorkspaceRepo *repo = g_new0(WorkspaceRepo, 1);
+    repo->work_tree = work_tree;
+    repo->git_dir = git_dir;
+    return repo;
+}
 
-static PopulateContext *populate_ctx = NULL;
-static GFileMonitor *folder_monitor = NULL;
-static guint refresh_timeout_id = 0;
-static guint git_poll_timeout_id = 0;
-static GHashTable *global_git_status = NULL;
-static char current_git_branch[256] = "";
+static void workspace_repo_free(gpointer data) {
+    WorkspaceRepo *repo = (WorkspaceRepo *)data;
+    g_free(repo->work_tree);
+    g_free(repo->git_dir);
+    g_free(repo);
+}
+
+// Repository whose files include path: the one with the deepest work tree
+// strictly above it. A nested work tree itself belongs to the repository
+// around it, which lists it as a submodule.
+static WorkspaceRepo* repo_for_path(const char *path) {
+    if (!workspace_repos || g_hash_table_size(workspace_repos) == 0) return NULL;
+    char *dir = g_strdup(path);
+    char *slash;
+    WorkspaceRepo *repo = NULL;
+    while (!repo && (slash = strrchr(dir, '/')) && slash > dir) {
+        *slash = '\0';
+        repo = g_hash_table_lookup(workspace_repos, dir);
+    }
+    g_free(dir);
+    return repo;
+}
+
+static gboolean repo_owns(const char *work_tree, const char *path) {
+    WorkspaceRepo *repo = repo_for_path(path);
+    return repo && strcmp(repo->work_tree, work_tree) == 0;
+}
+
+static gboolean is_nested_repo_root(const char *path) {
+    return workspace_repos && g_hash_table_contains(workspace_repos, path);
+}
 
+// Branch of the repository holding the open file, else of the workspace's own
 const char* get_git_branch() {
-    if (strlen(current_git_branch) == 0) return "unknown";
-    return current_git_branch;
+    WorkspaceRepo *repo = strlen(current_file) > 0 ? repo_for_path(current_file) : NULL;
+    if (!repo && workspace_work_tree) repo = g_hash_table_lookup(workspace_repos, workspace_work_tree);
+    if (!repo || strlen(repo->branch) == 0) return "unknown";
+    return repo->branch;
+}
+
+static gint git_branch_serial = 0;     // Bumped to orphan an in-flight HEAD read
+
+typedef struct {
+    char *work_tree;
+    char *git_dir;
+    char *text;  // Filled in by the thread
+} BranchRead;
+
+static void branch_read_free(gpointer data) {
+    BranchRead *read = (BranchRead *)data;
+    g_free(read->work_tree);
+    g_free(read->git_dir);
+    g_free(read->text);
+    g_free(read);
+}
+
+static void read_git_heads(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    GPtrArray *reads = (GPtrArray *)task_data;
+    for (guint i = 0; i < reads->len; i++) {
+        BranchRead *read = g_ptr_array_index(reads, i);
+        GitHeadInfo info = { 0 };
+        git_repo_read_head(read->git_dir, &info);
+        GString *text = g_string_new(info.branch ? info.branch : "");
+        if (info.ahead > 0) g_string_append_printf(text, " \u2191%d", info.ahead);
+        if (info.behind > 0) g_string_append_printf(text, " \u2193%d", info.behind);
+        read->text = g_string_free(text, FALSE);
+        git_head_info_clear(&info);
+    }
+    g_task_return_boolean(task, TRUE);
 }
 
+static void on_git_heads_read(GObject *source, GAsyncResult *result, gpointer user_data) {
+    if (GPOINTER_TO_INT(user_data) != git_branch_serial) return;
+    GPtrArray *reads = g_task_get_task_data(G_TASK(result));
+    for (guint i = 0; i < reads->len; i++) {
+        BranchRead *read = g_ptr_array_index(reads, i);
+        WorkspaceRepo *repo = g_hash_table_lookup(workspace_repos, read->work_tree);
+        if (repo) g_strlcpy(repo->branch, read->text, sizeof(repo->branch));
+    }
+    update_advanced_status_bar();
+}
+
+// HEAD and refs are read in-process; only the ahead/behind history walk needs
+// a thread. Every repository is read, since switching files switches the one shown.
 static void update_git_branch() {
-    if (strlen(current_folder) == 0) {
-        current_git_branch[0] = '\0';
-        return;
+    git_branch_serial++;
+    if (!workspace_repos || g_hash_table_size(workspace_repos) == 0) return;
+
+    GPtrArray *reads = g_ptr_array_new_with_free_func(branch_read_free);
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, workspace_repos);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        WorkspaceRepo *repo = (WorkspaceRepo *)value;
+        BranchRead *read = g_new0(BranchRead, 1);
+        read->work_tree = g_strdup(repo->work_tree);
+        read->git_dir = g_strdup(repo->git_dir);
+        g_ptr_array_add(reads, read);
     }
 
-    char *argv[] = { "git", "-C", current_folder, "rev-parse", "--abbrev-ref", "HEAD", NULL };
-    gchar *stdout_text = NULL;
-    GError *error = NULL;
+    GTask *task = g_task_new(NULL, NULL, on_git_heads_read, GINT_TO_POINTER(git_branch_serial));
+    g_task_set_task_data(task, reads, (GDestroyNotify)g_ptr_array_unref);
+    g_task_run_in_thread(task, read_git_heads);
+    g_object_unref(task);
+}
 
-    if (g_spawn_sync(current_folder, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, &stdout_text, NULL, NULL, &error)) {
-        if (stdout_text) {
-            char *trimmed = g_strstrip(stdout_text);
-            strncpy(current_git_branch, trimmed, sizeof(current_git_branch) - 1);
-            g_free(stdout_text);
-        }
-    } else {
-        current_git_branch[0] = '\0';
-        if (error) g_error_free(error);
+typedef struct {
+    GitFileStatus status;
+    guint generation; // Newest status run that confirmed the entry
+} GitStatusEntry;
+
+static guint git_status_generation = 0; // Bumped as each status run starts
+static GHashTable *untracked_dirs = NULL; // Folders git listed as untracked as a whole; their files have no entries
+
+static gboolean status_has(GitFileStatus status, char c) {
+    return GIT_FILE_STATUS_INDEX(status) == c || GIT_FILE_STATUS_WORKTREE(status) == c;
+}
+
+// Whether a folder above path, inside the open folder, is a key of folders.
+// The walk up ends at the first folder that is a key of stop, if given.
+static gboolean has_ancestor_in(GHashTable *folders, GHashTable *stop, const char *path) {
+    size_t root_len = strlen(current_folder);
+    char *dir = g_strdup(path);
+    char *slash;
+    gboolean found = FALSE;
+    while (!found && (slash = strrchr(dir, '/')) && (size_t)(slash - dir) > root_len) {
+        *slash = '\0';
+        if (stop && g_hash_table_contains(stop, dir)) break;
+        found = g_hash_table_contains(folders, dir);
     }
+    g_free(dir);
+    return found;
+}
+
+// A nested repository inside an untracked folder still has its own status for its files
+static gboolean in_untracked_dir(const char *path) {
+    return untracked_dirs && g_hash_table_size(untracked_dirs) > 0 && has_ancestor_in(untracked_dirs, workspace_repos, path);
+}
+
+static GitFileStatus lookup_git_status(const char *path) {
+    GitStatusEntry *entry = global_git_status ? g_hash_table_lookup(global_git_status, path) : NULL;
+    if (entry) return entry->status;
+    return in_untracked_dir(path) ? GIT_FILE_UNTRACKED : GIT_FILE_CLEAN;
 }
 
 const char* get_git_status_letter(const char *path) {
-    if (!global_git_status || !path) return "";
-    const char *status = g_hash_table_lookup(global_git_status, path);
-    if (!status) return "";
+    if (!path) return "";
+    GitFileStatus status = lookup_git_status(path);
     
-    if (strstr(status, "M")) return "M";
-    if (strstr(status, "A")) return "A";
-    if (strstr(status, "?")) return "U";
+    if (status_has(status, 'M')) return "M";
+    if (status_has(status, 'A')) return "A";
+    if (status_has(status, '?')) return "U";
     return "";
 }
 
-static gboolean background_git_poll(gpointer data) {
-    update_git_status();
-    update_git_branch();
-    update_git_gutter();
-    return TRUE; // Continue polling
-}
+// Git state is refreshed when something changes: the repository's HEAD, index
+// or refs, files written in the workspace, or a save. The poll is only a
+// safety net for changes no watch sees (e.g. a network filesystem).
+#define GIT_REFRESH_DELAY_MS 300
+#define GIT_SAFETY_POLL_S 60
+
+// What a refresh has to redo
+#define GIT_REFRESH_BRANCH 1   // HEAD, refs, ahead/behind
+#define GIT_REFRESH_STATUS 2   // Full git status: index, untracked files, renames
+#define GIT_REFRESH_TRACKED 4  // Only worktree edits to tracked files, checked against the index in-process
+#define GIT_REFRESH_REPOS 8    // Full git status of the repositories in pending_status_repos only
+
+static guint git_refresh_id = 0;
+static int git_refresh_pending = 0;   // GIT_REFRESH_* bits
+static gint git_tracked_serial = 0;   // Bumped to orphan an in-flight tracked file check
+static gint repo_scan_serial = 0;     // Bumped to orphan an in-flight nested repository lookup
+static GPtrArray *git_monitors = NULL; // GFileMonitor* on each repository and common folder
+static Watcher *git_refs_watcher = NULL; // Every repository's refs folder, recursively (feature/x branches)
+static GHashTable *git_refs_roots = NULL; // Watched refs folder -> work tree
+static GHashTable *pending_status_paths = NULL; // Saved files waiting for the next GIT_JOB_PATHS run
+static GHashTable *pending_status_repos = NULL; // Work trees waiting for the next GIT_JOB_STATUS run
+static gboolean pending_status_all = FALSE;     // The next GIT_JOB_STATUS run covers every repository
+
+static void apply_tracked_changes(const char *work_tree, GHashTable *changes, GHashTable *examined);
 
-// Bitmasks for Git status
-#define GIT_STATUS_NONE 0
-#define GIT_STATUS_MODIFIED 1
-#define GIT_STATUS_ADDED 2
-#define GIT_STATUS_UNTRACKED 4
+typedef struct {
+    char *git_dir;
+    char *work_tree;
+    GHashTable *changes;  // Filled in by the thread; NULL when the index can't answer
+    GHashTable *examined; // Relative paths the index compared, with changes
+} TrackedCheck;
+
+static void tracked_check_free(gpointer data) {
+    TrackedCheck *check = (TrackedCheck *)data;
+    g_free(check->git_dir);
+    g_free(check->work_tree);
+    if (check->changes) g_hash_table_destroy(check->changes);
+    if (check->examined) g_hash_table_destroy(check->examined);
+    g_free(check);
+}
 
-static int update_tree_colors_recursive(GtkTreeModel *model, GtkTreeIter *iter, GHashTable *git_status) {
-    int aggregate_status = GIT_STATUS_NONE;
-    
-    do {
-        char *path;
-        gtk_tree_model_get(model, iter, 2, &path, -1);
-        
-        int current_node_status = GIT_STATUS_NONE;
-        const char *status = g_hash_table_lookup(git_status, path);
-        const char *color = NULL;
-        const char *letter = "";
-
-        if (status) {
-            if (strstr(status, "M")) {
-                current_node_status |= GIT_STATUS_MODIFIED;
-                color = "#E2C08D"; // Yellow
-                letter = "M";
-            } else if (strstr(status, "A")) {
-                current_node_status |= GIT_STATUS_ADDED;
-                color = "#73C991"; // Green
-                letter = "A";
-            } else if (strstr(status, "?")) {
-                current_node_status |= GIT_STATUS_UNTRACKED;
-                color = "#73C991"; // Green
-                letter = "U";
-            }
+// The index can't answer when it is unreadable or content filters are in play
+static void check_tracked_files(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    GPtrArray *checks = (GPtrArray *)task_data;
+    for (guint i = 0; i < checks->len; i++) {
+        TrackedCheck *check = g_ptr_array_index(checks, i);
+        if (!git_index_can_hash_worktree(check->git_dir, check->work_tree)) continue;
+        GitIndex *index = git_index_read(check->git_dir);
+        if (index) {
+            check->changes = git_index_find_changes(index, check->work_tree, &check->examined);
+            git_index_free(index);
         }
-        
-        GtkTreeIter child;
-        int children_status = GIT_STATUS_NONE;
-        if (gtk_tree_model_iter_children(model, &child, iter)) {
-            children_status = update_tree_colors_recursive(model, &child, git_status);
+    }
+    g_task_return_boolean(task, TRUE);
+}
+
+// Add a repository to the next full status run
+static void queue_repo_status(const char *work_tree) {
+    if (!pending_status_repos) pending_status_repos = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_add(pending_status_repos, g_strdup(work_tree));
+}
+
+static void on_tracked_files_checked(GObject *source, GAsyncResult *result, gpointer user_data) {
+    git_jobs_done(GIT_JOB_TRACKED);
+    if (GPOINTER_TO_INT(user_data) != git_tracked_serial) return;
+
+    GPtrArray *checks = g_task_get_task_data(G_TASK(result));
+    gboolean fallback = FALSE;
+    for (guint i = 0; i < checks->len; i++) {
+        TrackedCheck *check = g_ptr_array_index(checks, i);
+        if (check->changes) {
+            apply_tracked_changes(check->work_tree, check->changes, check->examined);
+        } else {
+            queue_repo_status(check->work_tree);
+            fallback = TRUE;
         }
-        
-        // If the current node isn't explicitly colored, but its children have changes, bubble up the color.
-        // We do NOT bubble up the letter, only the color, just like VSCode for parent folders.
-        if (!color && children_status != GIT_STATUS_NONE) {
-            if (children_status & GIT_STATUS_MODIFIED) color = "#E2C08D";
-            else if ((children_status & GIT_STATUS_ADDED) || (children_status & GIT_STATUS_UNTRACKED)) color = "#73C991";
+    }
+    if (fallback) git_jobs_request(GIT_JOB_STATUS);
+}
+
+// Writes inside the workspace can only change the worktree column of tracked
+// files (untracked ones are picked up by the folder watch), so the index is
+// compared against the files directly instead of running git status. Only
+// repositories that had files written are checked.
+static void start_tracked_check(gpointer data) {
+    GPtrArray *checks = g_ptr_array_new_with_free_func(tracked_check_free);
+    if (workspace_repos) {
+        GHashTableIter it;
+        gpointer value;
+        g_hash_table_iter_init(&it, workspace_repos);
+        while (g_hash_table_iter_next(&it, NULL, &value)) {
+            WorkspaceRepo *repo = (WorkspaceRepo *)value;
+            if (!repo->written) continue;
+            repo->written = FALSE;
+            TrackedCheck *check = g_new0(TrackedCheck, 1);
+            check->git_dir = g_strdup(repo->git_dir);
+            check->work_tree = g_strdup(repo->work_tree);
+            g_ptr_array_add(checks, check);
         }
+    }
+    if (checks->len == 0) {
+        g_ptr_array_unref(checks);
+        git_jobs_done(GIT_JOB_TRACKED);
+        return;
+    }
 
-        gtk_tree_store_set(GTK_TREE_STORE(model), iter, 3, color, 4, letter, -1);
-        
-        aggregate_status |= current_node_status | children_status;
-        g_free(path);
-        
-    } while (gtk_tree_model_iter_next(model, iter));
-    
-    return aggregate_status;
+    git_tracked_serial++;
+    GTask *task = g_task_new(NULL, NULL, on_tracked_files_checked, GINT_TO_POINTER(git_tracked_serial));
+    g_task_set_task_data(task, checks, (GDestroyNotify)g_ptr_array_unref);
+    g_task_run_in_thread(task, check_tracked_files);
+    g_object_unref(task);
 }
 
-typedef struct {
-    GString *buffer;
-} GitStatusCtx;
-
-static void on_git_status_read(GObject *source_object, GAsyncResult *res, gpointer user_data) {
-    GitStatusCtx *ctx = (GitStatusCtx *)user_data;
-    GInputStream *stream = G_INPUT_STREAM(source_object);
-    GError *err = NULL;
-    char buf[4096];
-    gssize bytes_read = g_input_stream_read_finish(stream, res, &err);
+static gboolean run_git_refresh(gpointer data) {
+    int what = git_refresh_pending;
+    git_refresh_id = 0;
+    git_refresh_pending = 0;
 
-    if (bytes_read > 0) {
-        g_string_append_len(ctx->buffer, buf, bytes_read);
-        g_input_stream_read_async(stream, buf, sizeof(buf), G_PRIORITY_DEFAULT, NULL, on_git_status_read, ctx);
+    if (what & GIT_REFRESH_STATUS) {
+        git_tracked_serial++; // The full status covers whatever a tracked check in flight would say
+        update_git_status();
     } else {
-        if (err) {
-            g_error_free(err);
-        } else if (ctx->buffer->len > 0) {
-            GHashTable *git_status = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
-            char **lines = g_strsplit(ctx->buffer->str, "\n", -1);
-            
-            for (int i = 0; lines[i] && strlen(lines[i]) > 3; i++) {
-                char status[3];
-                strncpy(status, lines[i], 2);
-                status[2] = '\0';
-                
-                char *rel_path = lines[i] + 3;
-                if (rel_path[0] == '"') {
-                    // Primitive unquoting if needed, or leave for exact match
-                }
-                
-                char *abs_path = g_build_filename(current_folder, rel_path, NULL);
-                g_hash_table_insert(git_status, abs_path, g_strdup(status));
-            }
-            g_strfreev(lines);
+        if (what & GIT_REFRESH_REPOS) git_jobs_request(GIT_JOB_STATUS);
+        if (what & GIT_REFRESH_TRACKED) git_jobs_request(GIT_JOB_TRACKED);
+    }
+    if (what & GIT_REFRESH_BRANCH) {
+        if (workspace_git_pool) git_pool_restart(workspace_git_pool);
+        update_git_branch();
+    }
+    // Worktree writes leave HEAD alone, and the gutter already diffs the live buffer
+    if (what & (GIT_REFRESH_STATUS | GIT_REFRESH_REPOS | GIT_REFRESH_BRANCH)) update_git_gutter();
+    return G_SOURCE_REMOVE;
+}
 
-            GtkTreeIter iter;
-            if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(tree_store), &iter)) {
-                update_tree_colors_recursive(GTK_TREE_MODEL(tree_store), &iter, git_status);
-            }
-            g_hash_table_destroy(git_status);
+// A checkout touches HEAD, the index and thousands of files at once; they all end up in one refresh
+static void schedule_git_refresh(int what) {
+    if (strlen(current_folder) == 0) return;
+    git_refresh_pending |= what;
+    if (git_refresh_id == 0) git_refresh_id = g_timeout_add(GIT_REFRESH_DELAY_MS, run_git_refresh, NULL);
+}
+
+// Rearms itself, further apart on repositories where status is slow
+static gboolean background_git_poll(gpointer data) {
+    schedule_git_refresh(GIT_REFRESH_STATUS | GIT_REFRESH_BRANCH);
+    git_poll_timeout_id = g_timeout_add_seconds(git_jobs_backoff_s(GIT_JOB_STATUS, GIT_SAFETY_POLL_S), background_git_poll, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+// What a change in a git folder invalidates. Branch tips move the ahead/behind
+// counts and, for the checked-out branch, the status against HEAD; remote refs
+// and FETCH_HEAD only move the counts. Git writes name.lock and renames it over
+// name; only the final name counts.
+static int git_file_refresh_flags(GFile *file) {
+    if (!file) return 0;
+    char *name = g_file_get_basename(file);
+    int flags = GIT_REFRESH_REPOS;
+    if (g_str_has_suffix(name, ".lock")) flags = 0;
+    else if (strcmp(name, "FETCH_HEAD") == 0) flags = GIT_REFRESH_BRANCH;
+    else if (strcmp(name, "HEAD") == 0 || strcmp(name, "packed-refs") == 0) flags = GIT_REFRESH_BRANCH | GIT_REFRESH_REPOS;
+    g_free(name);
+    return flags;
+}
+
+static gboolean ref_is_under(const char *ref, const char *folder) {
+    size_t len = strlen(folder);
+    return strncmp(ref, folder, len) == 0 && (ref[len] == '\0' || ref[len] == '/');
+}
+
+// ref is relative to the common folder, e.g. refs/heads/main; plain refs
+// means anything in it may have changed. Tags, notes and the stash move
+// neither the counts nor the status.
+static int git_ref_refresh_flags(const char *ref) {
+    if (g_str_has_suffix(ref, ".lock")) return 0;
+    if (strcmp(ref, "refs") == 0 || ref_is_under(ref, "refs/heads")) return GIT_REFRESH_BRANCH | GIT_REFRESH_REPOS;
+    if (ref_is_under(ref, "refs/remotes")) return GIT_REFRESH_BRANCH;
+    return 0;
+}
+
+static void queue_git_refresh(const char *work_tree, int flags) {
+    if (flags == 0) return;
+    if (flags & GIT_REFRESH_REPOS) queue_repo_status(work_tree);
+    schedule_git_refresh(flags);
+}
+
+// user_data is the work tree of the repository the folder belongs to
+static void on_git_dir_changed(GFileMonitor *monitor, GFile *file, GFile *other, GFileMonitorEvent event, gpointer user_data) {
+    if (event == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED || event == G_FILE_MONITOR_EVENT_CHANGED) return; // Wait for CHANGES_DONE
+    queue_git_refresh((const char *)user_data, git_file_refresh_flags(file) | git_file_refresh_flags(other));
+}
+
+// A ref was written, deleted or moved under a watched refs folder (or events
+// were lost, in which case path is the refs folder itself)
+static void on_git_ref_changed(Watcher *watcher, const char *path, gpointer user_data) {
+    char *refs_dir = g_strdup(path);
+    const char *work_tree;
+    while (!(work_tree = g_hash_table_lookup(git_refs_roots, refs_dir))) {
+        char *parent = g_path_get_dirname(refs_dir);
+        gboolean top = strcmp(parent, refs_dir) == 0;
+        g_free(refs_dir);
+        refs_dir = parent;
+        if (top) break;
+    }
+    if (work_tree) {
+        // Relative to the common folder: refs, refs/heads/feature/x, ...
+        const char *ref = path + strlen(refs_dir) - strlen("refs");
+        queue_git_refresh(work_tree, git_ref_refresh_flags(ref));
+    }
+    g_free(refs_dir);
+}
+
+// HEAD, FETCH_HEAD and index live in the repository folder; packed-refs and
+// refs in the common folder, which differs for linked worktrees. Branches
+// nest (feature/x), so refs is watched recursively; a fresh clone only gets
+// refs/remotes on its first fetch, so refs itself is the root.
+static void watch_repo(WorkspaceRepo *repo) {
+    char *common_dir = git_repo_common_dir(repo->git_dir);
+    char *dirs[] = { repo->git_dir, common_dir };
+    for (int i = 0; i < 2; i++) {
+        if (i == 1 && strcmp(common_dir, repo->git_dir) == 0) continue;
+        GFile *gf = g_file_new_for_path(dirs[i]);
+        GFileMonitor *monitor = g_file_monitor_directory(gf, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+        if (monitor) {
+            g_signal_connect_data(monitor, "changed", G_CALLBACK(on_git_dir_changed), g_strdup(repo->work_tree),
+                                  (GClosureNotify)g_free, 0);
+            g_ptr_array_add(git_monitors, monitor);
         }
-        
-        g_string_free(ctx->buffer, TRUE);
-        g_free(ctx);
-        g_input_stream_close_async(stream, G_PRIORITY_DEFAULT, NULL, NULL, NULL);
-        g_object_unref(stream);
+        g_object_unref(gf);
+    }
+
+    char *refs_dir = g_build_filename(common_dir, "refs", NULL);
+    if (!git_refs_watcher) {
+        git_refs_watcher = watcher_new(NULL, NULL, on_git_ref_changed, NULL, on_git_ref_changed, NULL, NULL);
+    }
+    // Linked worktrees share one common folder
+    if (git_refs_watcher && !g_hash_table_contains(git_refs_roots, refs_dir)) {
+        g_hash_table_insert(git_refs_roots, g_strdup(refs_dir), g_strdup(repo->work_tree));
+        watcher_add_root(git_refs_watcher, refs_dir);
     }
+    g_free(refs_dir);
+    g_free(common_dir);
 }
 
-static void on_git_status_child_watch(GPid pid, gint status, gpointer user_data) {
-    g_spawn_close_pid(pid);
+static void watch_repos() {
+    g_ptr_array_set_size(git_monitors, 0);
+    g_clear_pointer(&git_refs_watcher, watcher_destroy);
+    g_hash_table_remove_all(git_refs_roots);
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, workspace_repos);
+    while (g_hash_table_iter_next(&it, NULL, &value)) watch_repo((WorkspaceRepo *)value);
 }
 
-static void on_git_status_spliced(GObject *source, GAsyncResult *res, gpointer user_data) {
-    GOutputStream *out = G_OUTPUT_STREAM(source);
-    GError *splice_err = NULL;
-    if (g_output_stream_splice_finish(out, res, &splice_err) >= 0) {
-        gsize size = g_memory_output_stream_get_data_size(G_MEMORY_OUTPUT_STREAM(out));
+static void stop_git_monitors() {
+    if (git_refresh_id > 0) {
+        g_source_remove(git_refresh_id);
+        git_refresh_id = 0;
+    }
+    git_refresh_pending = 0;
+    git_jobs_reset();
+    g_clear_pointer(&pending_status_paths, g_hash_table_destroy);
+    g_clear_pointer(&pending_status_repos, g_hash_table_destroy);
+    pending_status_all = FALSE;
+    g_clear_pointer(&git_monitors, g_ptr_array_unref);
+    g_clear_pointer(&git_refs_watcher, watcher_destroy);
+    g_clear_pointer(&git_refs_roots, g_hash_table_destroy);
+    g_clear_pointer(&workspace_repos, g_hash_table_destroy);
+    g_clear_pointer(&workspace_git_dir, g_free);
+    g_clear_pointer(&workspace_work_tree, g_free);
+    g_clear_pointer(&workspace_git_pool, git_pool_unref);
+    git_branch_serial++;
+    git_tracked_serial++;
+    repo_scan_serial++;
+}
 
-        GHashTable *git_status = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+// Nested repositories join once the index crawl has found them
+static void start_git_monitors(const char *folder) {
+    stop_git_monitors();
+    git_monitors = g_ptr_array_new_with_free_func(g_object_unref);
+    git_refs_roots = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    workspace_repos = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, workspace_repo_free);
 
-        if (size > 0) {
-            char *output = g_strndup(g_memory_output_stream_get_data(G_MEMORY_OUTPUT_STREAM(out)), size);
-            char **lines = g_strsplit(output, "\n", -1);
+    workspace_git_dir = git_repo_find_dir(folder, &workspace_work_tree);
+    if (!workspace_git_dir) return;
+    workspace_git_pool = git_pool_new(workspace_work_tree);
 
-            for (int i = 0; lines[i] && strlen(lines[i]) > 3; i++) {
-                char status[3];
-                strncpy(status, lines[i], 2);
-                status[2] = '\0';
+    WorkspaceRepo *repo = workspace_repo_new(g_strdup(workspace_work_tree), g_strdup(workspace_git_dir));
+    g_hash_table_insert(workspace_repos, repo->work_tree, repo);
+    watch_repo(repo);
+}
 
-                char *rel_path = lines[i] + 3;
-                char *abs_path = g_build_filename(current_folder, rel_path, NULL);
-                g_hash_table_insert(git_status, abs_path, g_strdup(status));
-            }
-            g_strfreev(lines);
-            g_free(output);
+// Per folder, how many files below it carry each GIT_STATUS_* bit. Status
+// changes walk up the ancestors, so only folders whose color flips are touched.
+typedef struct {
+    guint modified;
+    guint added;
+    guint untracked;
+} DirGitCounts;
+
+static GHashTable *git_dir_counts = NULL; // Folder path -> DirGitCounts*
+static gboolean filtering = FALSE; // The filter box has text, so tree_model shows only the matches
+
+static int git_status_bits(GitFileStatus status) {
+    if (status_has(status, 'M')) return GIT_STATUS_MODIFIED;
+    if (status_has(status, 'A')) return GIT_STATUS_ADDED;
+    if (status_has(status, '?')) return GIT_STATUS_UNTRACKED;
+    return GIT_STATUS_NONE;
+}
+
+static int dir_counts_bits(const DirGitCounts *counts) {
+    if (!counts) return GIT_STATUS_NONE;
+    return (counts->modified ? GIT_STATUS_MODIFIED : 0) |
+           (counts->added ? GIT_STATUS_ADDED : 0) |
+           (counts->untracked ? GIT_STATUS_UNTRACKED : 0);
+}
+
+static void adjust_dir_counts(DirGitCounts *counts, int bits, int delta) {
+    if (bits & GIT_STATUS_MODIFIED) counts->modified += delta;
+    if (bits & GIT_STATUS_ADDED) counts->added += delta;
+    if (bits & GIT_STATUS_UNTRACKED) counts->untracked += delta;
+}
+
+// Stores an entry's git bits in the index for the explorer to draw. Entries
+// inside an untracked folder have no status of their own; the model colors
+// them after the folder.
+static void set_entry_git_color(SidebarModel *model, FileId id, const char *path) {
+    GitStatusEntry *entry = global_git_status ? g_hash_table_lookup(global_git_status, path) : NULL;
+    int own = git_status_bits(entry ? entry->status : GIT_FILE_CLEAN);
+    int below = git_dir_counts ? dir_counts_bits(g_hash_table_lookup(git_dir_counts, path)) : GIT_STATUS_NONE;
+    sidebar_model_set_git(model, id, own, below);
+}
+
+// Find the row for a path without reading anything from disk
+static gboolean lookup_row(const char *path, GtkTreeIter *out) {
+    FileId id = file_index_lookup(file_index, path);
+    return id != FILE_INDEX_NONE && sidebar_model_lookup_id(tree_model, id, out);
+}
+
+static void recolor_row(const char *path) {
+    FileId id = file_index_lookup(file_index, path);
+    if (id == FILE_INDEX_NONE) return;
+    set_entry_git_color(tree_model, id, path);
+}
+
+// Entries just added under a folder take their color from the status tables
+static void color_entries(FileId folder) {
+    if (!global_git_status || g_hash_table_size(global_git_status) == 0) return;
+    GString *path = g_string_new(NULL);
+    for (FileId id = file_index_get_first_child(file_index, folder); id != FILE_INDEX_NONE;
+         id = file_index_get_next_sibling(file_index, id)) {
+        file_index_get_path(file_index, id, path);
+        set_entry_git_color(tree_model, id, path->str);
+    }
+    g_string_free(path, TRUE);
+}
+
+// Move one file from old_bits to new_bits in the counters of every folder above it
+static void propagate_git_bits(const char *path, int old_bits, int new_bits) {
+    size_t root_len = strlen(current_folder);
+    GString *dir = g_string_new(path);
+    char *slash;
+    while ((slash = strrchr(dir->str, '/')) && (size_t)(slash - dir->str) > root_len) {
+        g_string_truncate(dir, slash - dir->str);
+        DirGitCounts *counts = g_hash_table_lookup(git_dir_counts, dir->str);
+        if (!counts) {
+            counts = g_new0(DirGitCounts, 1);
+            g_hash_table_insert(git_dir_counts, g_strdup(dir->str), counts);
         }
+        int before = dir_counts_bits(counts);
+        adjust_dir_counts(counts, old_bits, -1);
+        adjust_dir_counts(counts, new_bits, 1);
+        int after = dir_counts_bits(counts);
 
-        // Always refresh tree colors to clear stale indicators
-        GtkTreeIter iter;
-        if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(tree_store), &iter)) {
-            update_tree_colors_recursive(GTK_TREE_MODEL(tree_store), &iter, git_status);
+        if (after == GIT_STATUS_NONE) g_hash_table_remove(git_dir_counts, dir->str);
+        if (after != before) recolor_row(dir->str);
+    }
+    g_string_free(dir, TRUE);
+}
+
+// Rows below a folder take their color from it while it is untracked
+static void recolor_subtree(const char *path) {
+    FileId id = file_index_lookup(file_index, path);
+    if (id == FILE_INDEX_NONE) return;
+    sidebar_model_subtree_changed(tree_model, id);
+}
+
+// Record a file's new status, GIT_FILE_CLEAN dropping it. is_dir marks a
+// folder git listed as untracked without listing its files. generation is
+// that of the status run reporting it.
+static void set_file_git_status(const char *path, GitFileStatus status, gboolean is_dir, guint generation) {
+    GitStatusEntry *entry = g_hash_table_lookup(global_git_status, path);
+    int old_bits = git_status_bits(entry ? entry->status : GIT_FILE_CLEAN);
+    int new_bits = git_status_bits(status);
+    gboolean was_dir = g_hash_table_remove(untracked_dirs, path);
+    if (status == GIT_FILE_CLEAN) {
+        g_hash_table_remove(global_git_status, path);
+    } else {
+        if (!entry) {
+            entry = g_new0(GitStatusEntry, 1);
+            g_hash_table_insert(global_git_status, g_strdup(path), entry);
         }
+        entry->status = status;
+        entry->generation = MAX(entry->generation, generation);
+    }
+    is_dir = is_dir && status == GIT_FILE_UNTRACKED;
+    if (is_dir) g_hash_table_add(untracked_dirs, g_strdup(path));
+
+    if (old_bits != new_bits) {
+        recolor_row(path);
+        propagate_git_bits(path, old_bits, new_bits);
+    }
+    // After the folder's own color, which its rows follow
+    if (is_dir != was_dir) recolor_subtree(path);
+}
+
+static gint git_status_epoch = 0;  // Bumped to orphan every status run in flight
+
+// The counters are only consistent with the status table they were built from
+static void clear_git_status() {
+    git_status_epoch++;
+    g_clear_pointer(&global_git_status, g_hash_table_destroy);
+    g_clear_pointer(&untracked_dirs, g_hash_table_destroy);
+    g_clear_pointer(&git_dir_counts, g_hash_table_destroy);
+}
 
-        // Sync with global cache for UI bars
-        if (global_git_status) g_hash_table_destroy(global_git_status);
-        global_git_status = git_status;
+static void ensure_git_tables() {
+    if (!global_git_status) global_git_status = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    if (!untracked_dirs) untracked_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    if (!git_dir_counts) git_dir_counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
 
-        // Refresh UI bars
+static void on_git_status_child_watch(GPid pid, gint status, gpointer user_data) {
+    g_spawn_close_pid(pid);
+}
+
+// Whether path lies strictly inside the open folder
+static gboolean in_workspace(const char *path) {
+    size_t root_len = strlen(current_folder);
+    return root_len > 0 && strncmp(path, current_folder, root_len) == 0 && path[root_len] == '/';
+}
+
+// changes maps tracked paths, relative to work_tree, to their worktree state
+// ('M' or 'D'); the index column of the cached status is kept as is. Only
+// the paths in examined were compared, so only those are known to be clean.
+static void apply_tracked_changes(const char *work_tree, GHashTable *changes, GHashTable *examined) {
+    ensure_git_tables();
+    size_t root_len = strlen(work_tree);
+
+    GHashTable *worktree = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, changes);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        char *abs_path = g_build_filename(work_tree, (const char *)key, NULL);
+        if (in_workspace(abs_path)) g_hash_table_insert(worktree, abs_path, value);
+        else g_free(abs_path);
+    }
+
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    GArray *statuses = g_array_new(FALSE, FALSE, sizeof(GitFileStatus));
+    // Tracked files the cache has as changed in the worktree but no longer are.
+    // Untracked and conflicted files, submodules and the other entries the
+    // index comparison skips are left to the full status.
+    g_hash_table_iter_init(&it, global_git_status);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        GitFileStatus status = ((GitStatusEntry *)value)->status;
+        char x = GIT_FILE_STATUS_INDEX(status);
+        if (x == '?' || git_file_status_is_unmerged(status) || GIT_FILE_STATUS_WORKTREE(status) == ' ' ||
+            g_hash_table_contains(worktree, key) || !repo_owns(work_tree, key)) continue;
+        const char *relative = (const char *)key + root_len;
+        if (*relative == '/') relative++;
+        if (!g_hash_table_contains(examined, relative)) continue;
+        GitFileStatus clean = x == ' ' ? GIT_FILE_CLEAN : GIT_FILE_STATUS(x, ' ');
+        g_ptr_array_add(paths, g_strdup(key));
+        g_array_append_val(statuses, clean);
+    }
+    g_hash_table_iter_init(&it, worktree);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        GitFileStatus old = lookup_git_status(key);
+        if (git_file_status_is_unmerged(old)) continue;
+        GitFileStatus status = GIT_FILE_STATUS(old ? GIT_FILE_STATUS_INDEX(old) : ' ', GPOINTER_TO_INT(value));
+        if (status == old) continue;
+        g_ptr_array_add(paths, g_strdup(key));
+        g_array_append_val(statuses, status);
+    }
+    guint changed = paths->len;
+    for (guint i = 0; i < changed; i++) {
+        set_file_git_status(g_ptr_array_index(paths, i), g_array_index(statuses, GitFileStatus, i), FALSE, git_status_generation);
+    }
+    g_array_free(statuses, TRUE);
+    g_ptr_array_free(paths, TRUE);
+    g_hash_table_destroy(worktree);
+
+    if (changed > 0) {
         update_path_bar();
         update_status_with_unsaved_mark(!gtk_text_buffer_get_modified(GTK_TEXT_BUFFER(text_buffer)));
     }
-    if (splice_err) g_error_free(splice_err);
-    g_object_unref(out);
 }
 
-void update_git_status() {
-    if (strlen(current_folder) == 0) return;
+#define GIT_STATUS_READ_SIZE (64 * 1024)
+#define GIT_STATUS_MAX_PATHSPECS 64  // Beyond this a scoped run falls back to a full one
+#define GIT_STATUS_MAX_RUNS 4        // Repositories whose status is read at the same time
+
+typedef struct _StatusBatch StatusBatch;
+
+// One git status of one repository being read. Records are applied as they
+// arrive, so a large workspace never holds its whole status output in memory at once.
+typedef struct {
+    StatusBatch *batch;
+    GInputStream *stream;     // NULL until the run is spawned
+    GitStatusParser *parser;
+    char *work_tree;          // Files of nested repositories are left to their own runs
+    GHashTable *scope;        // Paths the run was limited to, each with everything below; NULL for the whole repository
+    GString *path;            // Work tree root + '/', reused for every record
+    gsize root_len;
+    gint epoch;
+    guint generation;
+    char buffer[GIT_STATUS_READ_SIZE];
+} StatusRun;
+
+// The runs of one status job, one per repository. Each repository's git
+// works on its own index and files, so several are read at once.
+struct _StatusBatch {
+    GitJobKind kind;
+    GQueue waiting;  // StatusRun* not spawned yet
+    guint running;
+    gint epoch;
+};
+
+static void status_run_free(StatusRun *run) {
+    if (run->stream) {
+        g_input_stream_close(run->stream, NULL, NULL);
+        g_object_unref(run->stream);
+    }
+    if (run->parser) git_status_parser_free(run->parser);
+    if (run->scope) g_hash_table_destroy(run->scope);
+    g_string_free(run->path, TRUE);
+    g_free(run->work_tree);
+    g_free(run);
+}
+
+static gboolean status_run_is_current(StatusRun *run) {
+    return run->epoch == git_status_epoch && strlen(current_folder) > 0;
+}
+
+static void on_git_status_record(const char *path, gsize path_len, GitFileStatus status, gpointer user_data) {
+    StatusRun *run = (StatusRun *)user_data;
+    g_string_truncate(run->path, run->root_len);
+    // Untracked folders come as one "dir/" record instead of a record per file
+    gboolean is_dir = path_len > 0 && path[path_len - 1] == '/';
+    g_string_append_len(run->path, path, is_dir ? path_len - 1 : path_len);
+    const char *abs_path = run->path->str;
+    if (status == GIT_FILE_IGNORED || !in_workspace(abs_path) || !repo_owns(run->work_tree, abs_path)) return;
+    // The root of a nested repository counts as a changed submodule, but not
+    // as an untracked folder: its files have a status of their own
+    if (status == GIT_FILE_UNTRACKED && is_nested_repo_root(abs_path)) return;
+    // A scoped run inside an untracked folder lists the files it was asked about; the folder already covers them.
+    // A full run is the authority on which folders are still untracked as a whole.
+    if (run->scope && status == GIT_FILE_UNTRACKED && in_untracked_dir(abs_path)) return;
+
+    GitStatusEntry *entry = g_hash_table_lookup(global_git_status, abs_path);
+    // Runs overlap; what a newer one already confirmed is not undone by an older one
+    if (entry && entry->generation > run->generation) return;
+    if (entry && entry->status == status && is_dir == g_hash_table_contains(untracked_dirs, abs_path)) {
+        entry->generation = run->generation;
+    } else {
+        set_file_git_status(abs_path, status, is_dir, run->generation);
+    }
+}
+
+// Whether path is one of the scope's paths or lies below one
+static gboolean in_scope(GHashTable *scope, const char *path) {
+    return g_hash_table_contains(scope, path) || has_ancestor_in(scope, NULL, path);
+}
+
+// Files within the run's scope that it left out are clean now. Entries a
+// newer run has confirmed carry its stamp and are kept; those only an older
+// run still reported keep that run's stamp, so they go.
+static void finish_status_run(StatusRun *run) {
+    GPtrArray *gone = g_ptr_array_new_with_free_func(g_free);
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, global_git_status);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        if (((GitStatusEntry *)value)->generation >= run->generation) continue;
+        if (run->scope && !in_scope(run->scope, key)) continue;
+        if (repo_owns(run->work_tree, key)) g_ptr_array_add(gone, g_strdup(key));
+    }
+    for (guint i = 0; i < gone->len; i++) set_file_git_status(g_ptr_array_index(gone, i), GIT_FILE_CLEAN, FALSE, git_status_generation);
+    g_ptr_array_free(gone, TRUE);
+}
+
+static void status_batch_next(StatusBatch *batch);
+
+static void status_run_ended(StatusRun *run) {
+    StatusBatch *batch = run->batch;
+    status_run_free(run);
+    batch->running--;
+    status_batch_next(batch);
+}
+
+static void on_git_status_read(GObject *source, GAsyncResult *res, gpointer user_data) {
+    StatusRun *run = (StatusRun *)user_data;
+    gssize n = g_input_stream_read_finish(G_INPUT_STREAM(source), res, NULL);
+    if (!status_run_is_current(run)) {
+        status_run_ended(run);
+        return;
+    }
+
+    ensure_git_tables();
+    if (n > 0) {
+        git_status_parser_feed(run->parser, run->buffer, n);
+        g_input_stream_read_async(run->stream, run->buffer, sizeof(run->buffer), G_PRIORITY_DEFAULT, NULL, on_git_status_read, run);
+        return;
+    }
+
+    // A cut-off listing can't say which files became clean
+    if (n == 0 && git_status_parser_finish(run->parser)) finish_status_run(run);
+
+    // Refresh UI bars
+    update_path_bar();
+    update_status_with_unsaved_mark(!gtk_text_buffer_get_modified(GTK_TEXT_BUFFER(text_buffer)));
+    status_run_ended(run);
+}
+
+static gboolean spawn_status_run(StatusRun *run) {
+    GHashTable *scope = run->scope;
+    GPtrArray *args = g_ptr_array_new();
+    g_ptr_array_add(args, "status");
+    g_ptr_array_add(args, "--porcelain=v2");
+    g_ptr_array_add(args, "-z");
+    // Untracked folders as one entry each; -uall would list every file of a large untracked data folder
+    g_ptr_array_add(args, "-unormal");
+    // Submodules are read by runs of their own; here only a moved commit counts
+    g_ptr_array_add(args, "--ignore-submodules=dirty");
+    if (scope) {
+        g_ptr_array_add(args, "--");
+        GHashTableIter it;
+        gpointer key;
+        g_hash_table_iter_init(&it, scope);
+        while (g_hash_table_iter_next(&it, &key, NULL)) g_ptr_array_add(args, key);
+    }
+    g_ptr_array_add(args, NULL);
 
-    char *argv[] = { "git", "-C", current_folder, "status", "--porcelain", "-u", NULL };
-    
     gint standard_output;
     GPid pid;
     GError *err = NULL;
+    gboolean spawned = git_jobs_spawn(run->work_tree, (const char * const *)args->pdata, &pid, &standard_output, &err);
+    g_ptr_array_free(args, TRUE);
+    if (!spawned) {
+        if (err) g_error_free(err);
+        return FALSE;
+    }
 
-    if (g_spawn_async_with_pipes(current_folder, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH, NULL, NULL, &pid, NULL, &standard_output, NULL, &err)) {
-        
-        GitStatusCtx *ctx = g_new0(GitStatusCtx, 1);
-        ctx->buffer = g_string_new("");
+    run->stream = g_unix_input_stream_new(standard_output, TRUE);
+    run->parser = git_status_parser_new(on_git_status_record, run);
+    run->generation = ++git_status_generation;
+    g_input_stream_read_async(run->stream, run->buffer, sizeof(run->buffer), G_PRIORITY_DEFAULT, NULL, on_git_status_read, run);
+    g_child_watch_add(pid, on_git_status_child_watch, NULL);
+    return TRUE;
+}
 
-        GInputStream *stream = g_unix_input_stream_new(standard_output, TRUE);
-        char *buf = g_malloc(4096);
-        g_free(buf); 
-        
-        GOutputStream *mem_stream = g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
-        g_output_stream_splice_async(mem_stream, stream, G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET, 
-            G_PRIORITY_DEFAULT, NULL, on_git_status_spliced, NULL);
-        
-        g_object_unref(stream);
-        g_child_watch_add(pid, on_git_status_child_watch, NULL);
-    } else {
-        if (err) g_error_free(err);
+static StatusBatch* status_batch_new(GitJobKind kind) {
+    StatusBatch *batch = g_new0(StatusBatch, 1);
+    batch->kind = kind;
+    g_queue_init(&batch->waiting);
+    batch->epoch = git_status_epoch;
+    return batch;
+}
+
+// scope, if given, is taken over
+static void status_batch_add(StatusBatch *batch, WorkspaceRepo *repo, GHashTable *scope) {
+    StatusRun *run = g_new0(StatusRun, 1);
+    run->batch = batch;
+    run->work_tree = g_strdup(repo->work_tree);
+    run->scope = scope;
+    // Paths are relative to the repository root, which may be above the open folder
+    run->path = g_string_new(repo->work_tree);
+    if (!g_str_has_suffix(run->path->str, "/")) g_string_append_c(run->path, '/');
+    run->root_len = run->path->len;
+    run->epoch = batch->epoch;
+    g_queue_push_tail(&batch->waiting, run);
+}
+
+// Spawns runs while there is room; the job is done once the last one ends
+static void status_batch_next(StatusBatch *batch) {
+    while (batch->running < GIT_STATUS_MAX_RUNS && !g_queue_is_empty(&batch->waiting)) {
+        StatusRun *run = g_queue_pop_head(&batch->waiting);
+        if (status_run_is_current(run) && spawn_status_run(run)) {
+            batch->running++;
+        } else {
+            status_run_free(run);
+        }
     }
+    if (batch->running > 0) return;
+    git_jobs_done(batch->kind);
+    g_free(batch);
 }
 
-static void stop_population_if_running() {
-    if (populate_ctx) {
-        populate_ctx->cancelled = TRUE;
-        if (populate_ctx->source_id > 0) {
-            g_source_remove(populate_ctx->source_id);
+static void start_full_status(gpointer data) {
+    GHashTable *repos = pending_status_repos;
+    gboolean all = pending_status_all;
+    pending_status_repos = NULL;
+    pending_status_all = FALSE;
+
+    StatusBatch *batch = status_batch_new(GIT_JOB_STATUS);
+    if (strlen(current_folder) > 0 && workspace_repos) {
+        GHashTableIter it;
+        gpointer key, value;
+        g_hash_table_iter_init(&it, workspace_repos);
+        while (g_hash_table_iter_next(&it, &key, &value)) {
+            if (all || (repos && g_hash_table_contains(repos, key))) status_batch_add(batch, (WorkspaceRepo *)value, NULL);
         }
-        void *data;
-        while ((data = g_queue_pop_head(populate_ctx->queue))) {
-            DirTask *t = (DirTask *)data;
-            g_free(t->path);
-            g_free(t);
+    }
+    if (repos) g_hash_table_destroy(repos);
+    status_batch_next(batch);
+}
+
+// Every path saved or changed since the last run goes into one git status
+// per repository, unless there are so many that the whole workspace is as quick
+static void start_path_status(gpointer data) {
+    if (strlen(current_folder) == 0 || !pending_status_paths) {
+        git_jobs_done(GIT_JOB_PATHS);
+        return;
+    }
+    GHashTable *paths = pending_status_paths;
+    pending_status_paths = NULL;
+    if (g_hash_table_size(paths) > GIT_STATUS_MAX_PATHSPECS) {
+        g_hash_table_destroy(paths);
+        git_jobs_done(GIT_JOB_PATHS);
+        update_git_status();
+        return;
+    }
+
+    GHashTable *scopes = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_hash_table_destroy); // WorkspaceRepo* -> paths
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, paths);
+    while (g_hash_table_iter_next(&it, &key, NULL)) {
+        WorkspaceRepo *repo = repo_for_path((const char *)key);
+        if (!repo) continue;
+        GHashTable *scope = g_hash_table_lookup(scopes, repo);
+        if (!scope) {
+            scope = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+            g_hash_table_insert(scopes, repo, scope);
         }
-        g_queue_free(populate_ctx->queue);
-        g_free(populate_ctx);
-        populate_ctx = NULL;
+        g_hash_table_add(scope, g_strdup((const char *)key));
+    }
+    g_hash_table_destroy(paths);
+
+    StatusBatch *batch = status_batch_new(GIT_JOB_PATHS);
+    g_hash_table_iter_init(&it, scopes);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        g_hash_table_iter_steal(&it);
+        status_batch_add(batch, (WorkspaceRepo *)key, (GHashTable *)value);
+    }
+    g_hash_table_destroy(scopes);
+    status_batch_next(batch);
+}
+
+void update_git_status() {
+    if (strlen(current_folder) == 0) return;
+    pending_status_all = TRUE;
+    git_jobs_request(GIT_JOB_STATUS);
+}
+
+// Add a path, and everything below it, to the next scoped status run
+static void queue_status_path(const char *path) {
+    // A .git appearing or vanishing only matters to the repository map
+    if (!in_workspace(path) || g_str_has_suffix(path, "/.git")) return;
+    if (!pending_status_paths) pending_status_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_add(pending_status_paths, g_strdup(path));
+}
+
+// Refresh one file's status, e.g. after the editor saved it
+void update_git_status_for_path(const char *path) {
+    if (strlen(current_folder) == 0) return;
+    queue_status_path(path);
+    git_jobs_request(GIT_JOB_PATHS);
+}
+
+// Crawl jobs are tagged with the FileId of the folder being read; the root's
+// NULL tag maps to FILE_INDEX_ROOT
+#define FILE_ID_TO_TAG(id) GUINT_TO_POINTER((guint)(id) + 1)
+#define TAG_TO_FILE_ID(tag) ((FileId)(GPOINTER_TO_UINT(tag) - 1))
+
+static GHashTable *loading_dirs = NULL;   // FileIds of folders being read for the explorer
+static gboolean tree_root_loaded = FALSE; // Top-level entries are all in the index
+static char *pending_reveal = NULL;       // File to select once its ancestors are loaded
+static GHashTable *stale_children = NULL; // Re-read folder FileId -> set of cached child ids not listed yet
+static gint revalidate_serial = 0;        // Bumped to orphan an in-flight cache check
+static gboolean revalidating = FALSE;     // Cache check running; index ids must stay put
+static gboolean index_cache_pending = FALSE; // Save the index once the first population completes
+
+static void stop_population_if_running() {
+    if (tree_crawler) {
+        crawler_destroy(tree_crawler);
+        tree_crawler = NULL;
+    }
+    if (index_crawler) {
+        crawler_destroy(index_crawler);
+        index_crawler = NULL;
     }
+    if (loading_dirs) g_hash_table_remove_all(loading_dirs);
+    g_clear_pointer(&stale_children, g_hash_table_destroy);
+    g_atomic_int_inc(&revalidate_serial);
+    revalidating = FALSE;
+    tree_root_loaded = FALSE;
 }
 
-static void add_to_tree(const char *path, const char *name, const char *icon_name, GtkTreeIter *parent, GtkTreeIter *iter) {
-    gtk_tree_store_append(tree_store, iter, parent);
-    gtk_tree_store_set(tree_store, iter, 0, icon_name, 1, name, 2, path, 3, NULL, -1);
+// Compaction renumbers ids, so it waits until no crawl or cache check holds any
+static void compact_index() {
+    if (crawler_is_busy(index_crawler) || crawler_is_busy(tree_crawler) || revalidating) return;
+    guint n_old = file_index_get_count(file_index);
+    guint32 *remap = file_index_compact(file_index);
+    if (!remap) return;
+    sidebar_model_remap(tree_model, remap, n_old);
+    g_free(remap);
+}
+
+// Index flags of an entry found under parent. The crawl does not walk ignored
+// folders; they and anything read below them or below an excluded folder are
+// kept for the explorer only.
+static guint16 entry_flags(FileId parent, gboolean is_dir, gboolean is_ignored, gboolean is_excluded) {
+    guint16 flags = is_dir ? FILE_NODE_DIR : 0;
+    guint16 parent_flags = parent == FILE_INDEX_ROOT ? 0 : file_index_get_node(file_index, parent)->flags;
+    if (is_ignored || (parent_flags & (FILE_NODE_IGNORED | FILE_NODE_EXCLUDED))) {
+        flags |= FILE_NODE_IGNORED;
+    } else if (is_excluded) {
+        flags |= FILE_NODE_EXCLUDED;
+    }
+    return flags;
+}
+
+// Folders the index crawl has not listed (ignored ones it never will) are read on their own when expanded
+static void request_dir_load(GtkTreeIter *dir) {
+    if (!tree_crawler || sidebar_model_get_kind(tree_model, dir) != SIDEBAR_ROW_DIR) return;
+    FileId id = sidebar_model_get_id(tree_model, dir);
+    if ((file_index_get_node(file_index, id)->flags & FILE_NODE_LISTED) ||
+        g_hash_table_contains(loading_dirs, GUINT_TO_POINTER(id))) {
+        return;
+    }
+
+    char *path = sidebar_model_get_path(tree_model, dir);
+    g_hash_table_add(loading_dirs, GUINT_TO_POINTER(id));
+    crawler_queue_dir(tree_crawler, path, FILE_ID_TO_TAG(id));
+    g_free(path);
+}
+
+static void on_row_expanded(GtkTreeView *tv, GtkTreeIter *iter, GtkTreePath *path, gpointer user_data) {
+    if (filtering) return; // Filtered rows are complete already
+    request_dir_load(iter);
 }
 
 static GHashTable *expanded_paths = NULL;
 
-static void save_expanded_state_recursive(GtkTreeModel *model, GtkTreeIter *iter) {
-    do {
-        char *path;
-        gtk_tree_model_get(model, iter, 2, &path, -1);
-        GtkTreePath *tree_path = gtk_tree_model_get_path(model, iter);
-        
-        if (gtk_tree_view_row_expanded(GTK_TREE_VIEW(tree_view), tree_path)) {
-            g_hash_table_add(expanded_paths, g_strdup(path));
-        }
-        
-        gtk_tree_path_free(tree_path);
+// map_expanded_rows callback; user_data limits it to a folder and what is below it
+static void save_expanded_path(GtkTreeView *view, GtkTreePath *tree_path, gpointer user_data) {
+    const char *under = (const char *)user_data;
+    GtkTreeModel *model = gtk_tree_view_get_model(view);
+    GtkTreeIter iter;
+    if (!gtk_tree_model_get_iter(model, &iter, tree_path)) return;
+
+    char *path = sidebar_model_get_path(SIDEBAR_MODEL(model), &iter);
+    size_t len = under ? strlen(under) : 0;
+    if (path && (!under || (strncmp(path, under, len) == 0 && (path[len] == '\0' || path[len] == '/')))) {
+        g_hash_table_add(expanded_paths, path);
+    } else {
         g_free(path);
-        
-        GtkTreeIter child;
-        if (gtk_tree_model_iter_children(model, &child, iter)) {
-            save_expanded_state_recursive(model, &child);
-        }
-    } while (gtk_tree_model_iter_next(model, iter));
+    }
 }
 
-static void restore_expanded_state_recursive(GtkTreeModel *model, GtkTreeIter *iter) {
-    do {
-        char *path;
-        gtk_tree_model_get(model, iter, 2, &path, -1);
-        
-        if (g_hash_table_contains(expanded_paths, path)) {
-            GtkTreePath *tree_path = gtk_tree_model_get_path(model, iter);
-            gtk_tree_view_expand_row(GTK_TREE_VIEW(tree_view), tree_path, FALSE);
-            gtk_tree_path_free(tree_path);
+static void save_expanded_state(const char *under) {
+    if (!expanded_paths) {
+        expanded_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    gtk_tree_view_map_expanded_rows(GTK_TREE_VIEW(tree_view), save_expanded_path, (gpointer)under);
+}
+
+static void restore_expanded(FileId parent);
+
+// Expanding a folder not read yet reads it, and its own children are
+// reopened once that read is done
+static void restore_expanded_row(FileId id, GString *path) {
+    file_index_get_path(file_index, id, path);
+    if (!g_hash_table_remove(expanded_paths, path->str)) return;
+
+    GtkTreeIter iter;
+    if (!sidebar_model_lookup_id(tree_model, id, &iter)) return;
+    GtkTreePath *tree_path = gtk_tree_model_get_path(GTK_TREE_MODEL(tree_model), &iter);
+    gtk_tree_view_expand_row(GTK_TREE_VIEW(tree_view), tree_path, FALSE);
+    gtk_tree_path_free(tree_path);
+    if (file_index_get_node(file_index, id)->flags & FILE_NODE_LISTED) restore_expanded(id);
+}
+
+// Reopen the folders under parent that were expanded before a reload
+static void restore_expanded(FileId parent) {
+    if (!expanded_paths || filtering) return;
+    GString *path = g_string_new(NULL);
+    for (FileId id = file_index_get_first_child(file_index, parent); id != FILE_INDEX_NONE;
+         id = file_index_get_next_sibling(file_index, id)) {
+        if (file_index_get_node(file_index, id)->flags & FILE_NODE_DIR) restore_expanded_row(id, path);
+    }
+    g_string_free(path, TRUE);
+}
+
+// Once neither crawl has anything left, every folder that was expanded and still exists is open again
+static void forget_expanded_if_idle() {
+    if (crawler_is_busy(tree_crawler) || crawler_is_busy(index_crawler) || revalidating) return;
+    g_clear_pointer(&expanded_paths, g_hash_table_destroy);
+}
+
+static void select_row(GtkTreeModel *model, GtkTreeIter *iter) {
+    GtkTreePath *tree_path = gtk_tree_model_get_path(model, iter);
+    gtk_tree_view_expand_to_path(GTK_TREE_VIEW(tree_view), tree_path);
+    gtk_tree_view_set_cursor(GTK_TREE_VIEW(tree_view), tree_path, NULL, FALSE);
+    gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(tree_view), tree_path, NULL, TRUE, 0.5, 0.0);
+    if (current_file_row_ref) gtk_tree_row_reference_free(current_file_row_ref);
+    current_file_row_ref = gtk_tree_row_reference_new(model, tree_path);
+    gtk_tree_path_free(tree_path);
+}
+
+// Select pending_reveal once it is in the index, reading the deepest folder
+// on its way that is not listed yet. Each folder read re-enters here from
+// show_folder_entries() until the entry exists.
+static void reveal_pending_file() {
+    // While filtering, the reveal waits until the full tree is back
+    if (!pending_reveal || !tree_root_loaded || filtering) return;
+
+    size_t root_len = strlen(current_folder);
+    if (root_len == 0 || strncmp(pending_reveal, current_folder, root_len) != 0 || pending_reveal[root_len] != '/') {
+        g_clear_pointer(&pending_reveal, g_free);
+        return;
+    }
+
+    GtkTreeIter iter;
+    FileId id = file_index_lookup(file_index, pending_reveal);
+    if (id != FILE_INDEX_NONE) {
+        if (sidebar_model_lookup_id(tree_model, id, &iter)) select_row(GTK_TREE_MODEL(tree_model), &iter);
+        g_clear_pointer(&pending_reveal, g_free);
+        return;
+    }
+
+    char *dir = g_path_get_dirname(pending_reveal);
+    FileId folder = FILE_INDEX_NONE;
+    while (strlen(dir) > root_len && (folder = file_index_lookup(file_index, dir)) == FILE_INDEX_NONE) {
+        char *up = g_path_get_dirname(dir);
+        g_free(dir);
+        dir = up;
+    }
+    g_free(dir);
+
+    guint16 flags = folder != FILE_INDEX_NONE ? file_index_get_node(file_index, folder)->flags : 0;
+    if ((flags & FILE_NODE_DIR) && !(flags & FILE_NODE_LISTED) && sidebar_model_lookup_id(tree_model, folder, &iter)) {
+        request_dir_load(&iter);
+        return;
+    }
+    // Not shown in the explorer (e.g. inside a hidden folder)
+    g_clear_pointer(&pending_reveal, g_free);
+}
+
+// A folder's entries are all in the index now, whichever crawl listed them
+static void show_folder_entries(FileId id) {
+    if (id == FILE_INDEX_ROOT) {
+        tree_root_loaded = TRUE;
+    } else {
+        file_index_set_flag(file_index, id, FILE_NODE_LISTED, TRUE);
+    }
+    color_entries(id);
+    sidebar_model_refresh(tree_model, id);
+    restore_expanded(id);
+    reveal_pending_file();
+}
+
+static void on_tree_entry(Crawler *crawler, CrawlBatch *batch, CrawlEntry *entry, gpointer user_data) {
+    // Dropped if the folder was removed while it was being read
+    FileId parent = TAG_TO_FILE_ID(batch->tag);
+    file_index_add(file_index, parent, entry->name, entry_flags(parent, entry->is_dir, entry->is_ignored, entry->is_excluded));
+}
+
+static void on_tree_batch_done(Crawler *crawler, CrawlBatch *batch, gpointer user_data) {
+    FileId id = TAG_TO_FILE_ID(batch->tag);
+    g_hash_table_remove(loading_dirs, GUINT_TO_POINTER(id));
+    show_folder_entries(id);
+}
+
+static void on_tree_finished(Crawler *crawler, gpointer user_data) {
+    forget_expanded_if_idle();
+}
+
+// Background walk of the whole workspace, for Ctrl+P, the filter and the explorer
+static void on_index_entry(Crawler *crawler, CrawlBatch *batch, CrawlEntry *entry, gpointer user_data) {
+    FileId parent = TAG_TO_FILE_ID(batch->tag);
+    guint16 flags = entry_flags(parent, entry->is_dir, entry->is_ignored, entry->is_excluded);
+    FileId id = file_index_add(file_index, parent, entry->name, flags);
+    if (id == FILE_INDEX_NONE) return; // Folder was removed while it was being read
+
+    // Re-reading a cached folder: entries already indexed keep their subtree
+    GHashTable *unseen = stale_children ? g_hash_table_lookup(stale_children, GUINT_TO_POINTER(parent)) : NULL;
+    if (unseen && g_hash_table_remove(unseen, GUINT_TO_POINTER(id))) {
+        gboolean was_dir = (file_index_get_node(file_index, id)->flags & FILE_NODE_DIR) != 0;
+        if (was_dir == entry->is_dir) return;
+        // Same name, different type: index it afresh
+        file_index_remove(file_index, &id, 1);
+        id = file_index_add(file_index, parent, entry->name, flags);
+    }
+
+    // Symlinks back into the tree and ignored folders are listed but not walked
+    if (entry->is_dir && !(flags & (FILE_NODE_EXCLUDED | FILE_NODE_IGNORED))) {
+        char *full_path = g_build_filename(batch->path, entry->name, NULL);
+        crawler_queue_dir(crawler, full_path, FILE_ID_TO_TAG(id));
+        g_free(full_path);
+    }
+}
+
+static void on_index_batch_done(Crawler *crawler, CrawlBatch *batch, gpointer user_data) {
+    if (batch->mtime == 0) return; // Unreadable; if it is gone, its parent's read drops it
+    FileId id = TAG_TO_FILE_ID(batch->tag);
+    file_index_set_mtime(file_index, id, batch->mtime);
+    // Its entries are indexed under the path it was first read at; the explorer reads it on demand
+    if (batch->is_loop && id != FILE_INDEX_ROOT) file_index_set_flag(file_index, id, FILE_NODE_EXCLUDED, TRUE);
+    if (id != FILE_INDEX_ROOT) file_index_set_flag(file_index, id, FILE_NODE_REPO, batch->has_git);
+
+    // Cached entries the re-read no longer lists are gone
+    GHashTable *unseen = stale_children ? g_hash_table_lookup(stale_children, GUINT_TO_POINTER(id)) : NULL;
+    if (unseen) {
+        GArray *gone = g_array_sized_new(FALSE, FALSE, sizeof(FileId), g_hash_table_size(unseen));
+        GHashTableIter it;
+        gpointer key;
+        g_hash_table_iter_init(&it, unseen);
+        while (g_hash_table_iter_next(&it, &key, NULL)) {
+            FileId child = GPOINTER_TO_UINT(key);
+            g_array_append_val(gone, child);
         }
-        g_free(path);
-        
-        GtkTreeIter child;
-        if (gtk_tree_model_iter_children(model, &child, iter)) {
-            restore_expanded_state_recursive(model, &child);
+        file_index_remove(file_index, (const FileId *)gone->data, gone->len);
+        g_array_free(gone, TRUE);
+        g_hash_table_remove(stale_children, GUINT_TO_POINTER(id));
+    }
+    if (!batch->is_loop) show_folder_entries(id);
+}
+
+static void save_index_cache() {
+    if (!file_index_is_modified(file_index) || strlen(current_folder) == 0) return;
+    char *cache_path = file_index_cache_path(current_folder);
+    file_index_save(file_index, cache_path);
+    g_free(cache_path);
+}
+
+// Nested repositories are the folders the index marks FILE_NODE_REPO. Their
+// .git is resolved off the main thread, since a submodule's is a file
+// pointing into the repository around it.
+static void find_nested_repos(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    GPtrArray *folders = (GPtrArray *)task_data;
+    GHashTable *repos = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, workspace_repo_free);
+    for (guint i = 0; i < folders->len; i++) {
+        const char *folder = g_ptr_array_index(folders, i);
+        char *work_tree = NULL;
+        char *git_dir = git_repo_find_dir(folder, &work_tree);
+        // A broken .git resolves to the repository around the folder instead
+        if (git_dir && strcmp(work_tree, folder) == 0) {
+            WorkspaceRepo *repo = workspace_repo_new(work_tree, git_dir);
+            g_hash_table_insert(repos, repo->work_tree, repo);
+        } else {
+            g_free(git_dir);
+            g_free(work_tree);
         }
-    } while (gtk_tree_model_iter_next(model, iter));
+    }
+    g_task_return_pointer(task, repos, (GDestroyNotify)g_hash_table_destroy);
 }
 
-static gboolean populate_step(gpointer data) {
-    if (!populate_ctx || populate_ctx->cancelled) return FALSE;
+// Statuses nothing owns any more came from a repository that is gone
+static void drop_orphaned_statuses() {
+    if (!global_git_status) return;
+    GPtrArray *gone = g_ptr_array_new_with_free_func(g_free);
+    GHashTableIter it;
+    gpointer key;
+    g_hash_table_iter_init(&it, global_git_status);
+    while (g_hash_table_iter_next(&it, &key, NULL)) {
+        if (!repo_for_path(key)) g_ptr_array_add(gone, g_strdup(key));
+    }
+    for (guint i = 0; i < gone->len; i++) set_file_git_status(g_ptr_array_index(gone, i), GIT_FILE_CLEAN, FALSE, git_status_generation);
+    g_ptr_array_free(gone, TRUE);
+}
 
-    DirTask *task = g_queue_pop_head(populate_ctx->queue);
-    if (!task) {
-        populate_ctx->source_id = 0;
-        return FALSE;
+static void on_nested_repos_found(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GHashTable *found = g_task_propagate_pointer(G_TASK(result), NULL);
+    if (!found) return;
+    if (GPOINTER_TO_INT(user_data) != repo_scan_serial || !workspace_repos) {
+        g_hash_table_destroy(found);
+        return;
     }
 
-    DIR *dir = opendir(task->path);
-    if (dir) {
-        struct dirent *entry;
-        GList *subdirs = NULL;
-        GList *files = NULL;
-
-        static const char *excluded_dirs[] = {
-            "node_modules", "vendor", "venv", "env",
-            "__pycache__", ".tox", "dist", "build",
-            "target", "out", "coverage", NULL
-        };
-
-        while ((entry = readdir(dir))) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-
-            char *name = g_strdup(entry->d_name);
-            char full_path[1024];
-            snprintf(full_path, sizeof(full_path), "%s/%s", task->path, name);
-
-            struct stat st;
-            if (stat(full_path, &st) == 0) {
-                if (S_ISDIR(st.st_mode)) {
-                    // Skip hidden directories (starting with .)
-                    if (entry->d_name[0] == '.') {
-                        g_free(name);
-                        continue;
-                    }
-                    subdirs = g_list_insert_sorted(subdirs, name, (GCompareFunc)g_ascii_strcasecmp);
-                } else {
-                    // Allow hidden files (starting with .), they will be added to files list
-                    files = g_list_insert_sorted(files, name, (GCompareFunc)g_ascii_strcasecmp);
-                }
-            } else {
-                g_free(name);
-            }
-        }
-        closedir(dir);
-
-        // Add subdirectories first (folders at top)
-        for (GList *l = subdirs; l != NULL; l = l->next) {
-            char *name = (char *)l->data;
-            char full_path[1024];
-            snprintf(full_path, sizeof(full_path), "%s/%s", task->path, name);
-            
-            GtkTreeIter iter;
-            add_to_tree(full_path, name, "folder-symbolic", task->has_parent ? &task->parent_iter : NULL, &iter);
-
-            // Skip indexing contents of heavy directories
-            gboolean skip_contents = FALSE;
-            for (int i = 0; excluded_dirs[i]; i++) {
-                if (strcmp(name, excluded_dirs[i]) == 0) {
-                    skip_contents = TRUE;
-                    break;
-                }
-            }
+    // Known repositories keep their entry, and with it their branch
+    gboolean changed = FALSE;
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, workspace_repos);
+    while (g_hash_table_iter_next(&it, &key, NULL)) {
+        if (workspace_work_tree && strcmp(key, workspace_work_tree) == 0) continue;
+        if (g_hash_table_contains(found, key)) continue;
+        g_hash_table_iter_remove(&it);
+        changed = TRUE;
+    }
+    g_hash_table_iter_init(&it, found);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        if (g_hash_table_contains(workspace_repos, key)) continue;
+        g_hash_table_iter_steal(&it);
+        g_hash_table_insert(workspace_repos, key, value);
+        changed = TRUE;
+    }
+    g_hash_table_destroy(found);
+    if (!changed) return;
+
+    drop_orphaned_statuses();
+    watch_repos();
+    schedule_git_refresh(GIT_REFRESH_STATUS | GIT_REFRESH_BRANCH);
+}
+
+static void scan_nested_repos() {
+    if (!workspace_repos || !file_index) return;
+    GPtrArray *folders = g_ptr_array_new_with_free_func(g_free);
+    GString *path = g_string_new(NULL);
+    guint count = file_index_get_count(file_index);
+    for (FileId id = 0; id < count; id++) {
+        if (!file_index_is_live(file_index, id) || !(file_index_get_node(file_index, id)->flags & FILE_NODE_REPO)) continue;
+        file_index_get_path(file_index, id, path);
+        g_ptr_array_add(folders, g_strdup(path->str));
+    }
+    g_string_free(path, TRUE);
+
+    repo_scan_serial++;
+    GTask *task = g_task_new(NULL, NULL, on_nested_repos_found, GINT_TO_POINTER(repo_scan_serial));
+    g_task_set_task_data(task, folders, (GDestroyNotify)g_ptr_array_unref);
+    g_task_run_in_thread(task, find_nested_repos);
+    g_object_unref(task);
+}
+
+static void apply_sidebar_filter();
+
+static void on_index_finished(Crawler *crawler, gpointer user_data) {
+    g_clear_pointer(&stale_children, g_hash_table_destroy);
+    if (index_cache_pending) {
+        index_cache_pending = FALSE;
+        save_index_cache();
+    }
+
+    compact_index(); // Put off while the crawl was running
+    forget_expanded_if_idle();
+    if (filtering) apply_sidebar_filter();
+    schedule_git_refresh(GIT_REFRESH_STATUS); // Trigger git update once the index is fully built
+    scan_nested_repos();
+}
+
+// Folders of a cached index whose mtime is checked off the main thread, in one stat batch
+typedef struct {
+    gint serial;
+    GArray *ids;        // FileId of each folder
+    GPtrArray *paths;
+    GArray *mtimes;     // mtime recorded in the cache
+    GArray *changed;    // Positions in the arrays above whose mtime moved
+} DirCheck;
+
+static void free_dir_check(gpointer data) {
+    DirCheck *check = (DirCheck *)data;
+    g_array_free(check->ids, TRUE);
+    g_ptr_array_free(check->paths, TRUE);
+    g_array_free(check->mtimes, TRUE);
+    g_array_free(check->changed, TRUE);
+    g_free(check);
+}
+
+static void check_dir_mtimes(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    DirCheck *check = (DirCheck *)task_data;
+    if (check->serial != g_atomic_int_get(&revalidate_serial)) {
+        g_task_return_boolean(task, FALSE);
+        return;
+    }
+
+    StatRequest *requests = g_new0(StatRequest, check->paths->len);
+    for (guint i = 0; i < check->paths->len; i++) {
+        requests[i].dir_fd = AT_FDCWD;
+        requests[i].path = g_ptr_array_index(check->paths, i);
+    }
+    stat_batch_run(requests, check->paths->len);
+
+    for (guint i = 0; i < check->paths->len; i++) {
+        // Folders that vanished are dropped by their parent's re-read
+        if (requests[i].error != 0) continue;
+        if (requests[i].mtime != g_array_index(check->mtimes, gint64, i)) g_array_append_val(check->changed, i);
+    }
+    g_free(requests);
+    g_task_return_boolean(task, TRUE);
+}
+
+static void on_dir_check_done(GObject *source, GAsyncResult *result, gpointer user_data) {
+    DirCheck *check = g_task_get_task_data(G_TASK(result));
+    if (check->serial != revalidate_serial) return; // Folder closed or reloaded meanwhile
+    revalidating = FALSE;
+
+    if (check->changed->len == 0) {
+        on_index_finished(index_crawler, NULL);
+        return;
+    }
+
+    // Note the cached children of every changed folder, in one pass over the index
+    stale_children = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_hash_table_destroy);
+    for (guint i = 0; i < check->changed->len; i++) {
+        FileId id = g_array_index(check->ids, FileId, g_array_index(check->changed, guint, i));
+        g_hash_table_insert(stale_children, GUINT_TO_POINTER(id), g_hash_table_new(g_direct_hash, g_direct_equal));
+    }
+    guint count = file_index_get_count(file_index);
+    for (FileId id = 0; id < count; id++) {
+        if (!file_index_is_live(file_index, id)) continue;
+        GHashTable *children = g_hash_table_lookup(stale_children, GUINT_TO_POINTER(file_index_get_node(file_index, id)->parent));
+        if (children) g_hash_table_add(children, GUINT_TO_POINTER(id));
+    }
+
+    for (guint i = 0; i < check->changed->len; i++) {
+        guint pos = g_array_index(check->changed, guint, i);
+        crawler_queue_dir(index_crawler, g_ptr_array_index(check->paths, pos),
+                          FILE_ID_TO_TAG(g_array_index(check->ids, FileId, pos)));
+    }
+}
 
-            if (!skip_contents) {
-                DirTask *subtask = g_new0(DirTask, 1);
-                subtask->path = g_strdup(full_path);
-                subtask->parent_iter = iter;
-                subtask->has_parent = TRUE;
-                g_queue_push_tail(populate_ctx->queue, subtask);
+// The cached index is searchable right away; only folders whose mtime moved are read again
+static void start_revalidation(const char *root) {
+    DirCheck *check = g_new0(DirCheck, 1);
+    check->serial = revalidate_serial;
+    check->ids = g_array_new(FALSE, FALSE, sizeof(FileId));
+    check->paths = g_ptr_array_new_with_free_func(g_free);
+    check->mtimes = g_array_new(FALSE, FALSE, sizeof(gint64));
+    check->changed = g_array_new(FALSE, FALSE, sizeof(guint));
+
+    FileId root_id = FILE_INDEX_ROOT;
+    gint64 root_mtime = file_index_get_mtime(file_index, FILE_INDEX_ROOT);
+    g_array_append_val(check->ids, root_id);
+    g_ptr_array_add(check->paths, g_strdup(root));
+    g_array_append_val(check->mtimes, root_mtime);
+
+    // Folders only read for the explorer are not checked; they forget what
+    // they held and are read afresh when opened
+    GArray *unchecked = g_array_new(FALSE, FALSE, sizeof(FileId));
+    GString *path = g_string_new(NULL);
+    guint count = file_index_get_count(file_index);
+    for (FileId id = 0; id < count; id++) {
+        if (!file_index_is_live(file_index, id)) continue;
+        guint16 flags = file_index_get_node(file_index, id)->flags;
+        if (!(flags & FILE_NODE_DIR)) continue;
+        if (flags & (FILE_NODE_EXCLUDED | FILE_NODE_IGNORED)) {
+            if (!(flags & FILE_NODE_LISTED)) continue;
+            for (FileId child = file_index_get_first_child(file_index, id); child != FILE_INDEX_NONE;
+                 child = file_index_get_next_sibling(file_index, child)) {
+                g_array_append_val(unchecked, child);
             }
-            
-            file_list = g_list_append(file_list, g_strdup(full_path));
+            file_index_set_flag(file_index, id, FILE_NODE_LISTED, FALSE);
+            continue;
         }
 
-        // Add files after subdirectories
-        for (GList *l = files; l != NULL; l = l->next) {
-            char *name = (char *)l->data;
-            char full_path[1024];
-            snprintf(full_path, sizeof(full_path), "%s/%s", task->path, name);
-            
+        gint64 mtime = file_index_get_mtime(file_index, id);
+        file_index_get_path(file_index, id, path);
+        g_array_append_val(check->ids, id);
+        g_ptr_array_add(check->paths, g_strdup(path->str));
+        g_array_append_val(check->mtimes, mtime);
+    }
+    g_string_free(path, TRUE);
+    file_index_remove(file_index, (const FileId *)unchecked->data, unchecked->len);
+    g_array_free(unchecked, TRUE);
+
+    revalidating = TRUE;
+    GTask *task = g_task_new(NULL, NULL, on_dir_check_done, NULL);
+    g_task_set_task_data(task, check, free_dir_check);
+    g_task_run_in_thread(task, check_dir_mtimes);
+    g_object_unref(task);
+}
+
+static void start_population(const char *root, gboolean use_cache) {
+    if (!loading_dirs) loading_dirs = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    // Rules are re-read on every (re)population so .gitignore edits take effect
+    g_clear_pointer(&workspace_ignore, ignore_matcher_unref);
+    workspace_ignore = ignore_matcher_new(root);
+
+    // Ignored entries are flagged rather than skipped, so the explorer still shows them
+    tree_crawler = crawler_new(on_tree_entry, on_tree_batch_done, on_tree_finished, NULL, NULL);
+    crawler_set_ignore(tree_crawler, workspace_ignore);
+
+    index_crawler = crawler_new(on_index_entry, on_index_batch_done, on_index_finished, NULL, NULL);
+    crawler_set_ignore(index_crawler, workspace_ignore);
+    index_cache_pending = TRUE;
+
+    char *cache_path = file_index_cache_path(root);
+    gboolean cached = use_cache && file_index_load(file_index, root, cache_path);
+    g_free(cache_path);
+    if (cached) {
+        start_revalidation(root);
+        show_folder_entries(FILE_INDEX_ROOT);
+    } else {
+        crawler_queue_dir(index_crawler, root, NULL);
+    }
+}
+
+// Explorer filter: matches and their folders, taken from the file index in
+// one pass instead of asking a visible-func about every row, then applied to
+// the explorer's own rows as a visible mask
+#define FILTER_EXPAND_LIMIT 2000 // Larger results start collapsed to keep the view quick
+
+static GtkWidget *filter_entry = NULL;
+static GPtrArray *filter_saved_expanded = NULL; // Rows open before filtering, reopened after
+
+static void save_expanded_row(GtkTreeView *view, GtkTreePath *tree_path, gpointer user_data) {
+    GtkTreeIter iter;
+    if (gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_model), &iter, tree_path)) {
+        char *path = sidebar_model_get_path(tree_model, &iter);
+        if (path) g_ptr_array_add(filter_saved_expanded, path);
+    }
+}
+
+static void apply_sidebar_filter() {
+    GtkTreeView *view = GTK_TREE_VIEW(tree_view);
+    const char *text = filter_entry ? gtk_entry_get_text(GTK_ENTRY(filter_entry)) : "";
+
+    if (text[0] == '\0' || strlen(current_folder) == 0) {
+        if (!filtering) return;
+        filtering = FALSE;
+        sidebar_model_set_visible(tree_model, NULL, 0);
+
+        gtk_tree_view_collapse_all(view);
+        for (guint i = 0; filter_saved_expanded && i < filter_saved_expanded->len; i++) {
             GtkTreeIter iter;
-            add_to_tree(full_path, name, "text-x-generic-symbolic", task->has_parent ? &task->parent_iter : NULL, &iter);
-            
-            file_list = g_list_append(file_list, g_strdup(full_path));
+            if (!lookup_row(g_ptr_array_index(filter_saved_expanded, i), &iter)) continue;
+            GtkTreePath *tree_path = gtk_tree_model_get_path(GTK_TREE_MODEL(tree_model), &iter);
+            gtk_tree_view_expand_to_path(view, tree_path);
+            gtk_tree_path_free(tree_path);
         }
+        g_clear_pointer(&filter_saved_expanded, g_ptr_array_unref);
+        reveal_pending_file();
+        return;
+    }
 
-        g_list_free_full(subdirs, g_free);
-        g_list_free_full(files, g_free);
+    if (!filtering) {
+        filtering = TRUE;
+        filter_saved_expanded = g_ptr_array_new_with_free_func(g_free);
+        gtk_tree_view_map_expanded_rows(view, save_expanded_row, NULL);
     }
 
-    g_free(task->path);
-    g_free(task);
+    char *query = g_ascii_strdown(text, -1);
+    guint n_ids = file_index_get_count(file_index);
+    guint32 *visible = g_new0(guint32, FILE_INDEX_BITSET_WORDS(n_ids));
+    guint matched = file_index_match_subtrees(file_index, query, visible);
+    g_free(query);
 
-    if (g_queue_is_empty(populate_ctx->queue)) {
-        populate_ctx->source_id = 0;
-        
-        // Restore expansion state
-        if (expanded_paths) {
-            GtkTreeIter root_iter;
-            if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(tree_store), &root_iter)) {
-                restore_expanded_state_recursive(GTK_TREE_MODEL(tree_store), &root_iter);
-            }
-            g_hash_table_destroy(expanded_paths);
-            expanded_paths = NULL; // Clear for next run
+    // Rows that stay keep their expansion; only the ones that flip are signalled
+    sidebar_model_set_visible(tree_model, visible, n_ids);
+    if (matched <= FILTER_EXPAND_LIMIT) gtk_tree_view_expand_all(view);
+}
+
+static void reset_sidebar_filter() {
+    if (filter_entry) gtk_entry_set_text(GTK_ENTRY(filter_entry), "");
+    apply_sidebar_filter();
+}
+
+static void on_filter_changed(GtkSearchEntry *entry, gpointer user_data) {
+    apply_sidebar_filter();
+}
+
+static void on_filter_stop(GtkSearchEntry *entry, gpointer user_data) {
+    gtk_entry_set_text(GTK_ENTRY(entry), "");
+}
+
+GtkWidget* create_sidebar_filter() {
+    filter_entry = gtk_search_entry_new();
+    gtk_widget_set_name(filter_entry, "sidebar-filter");
+    gtk_entry_set_placeholder_text(GTK_ENTRY(filter_entry), "Filter files");
+    g_signal_connect(filter_entry, "search-changed", G_CALLBACK(on_filter_changed), NULL);
+    g_signal_connect(filter_entry, "stop-search", G_CALLBACK(on_filter_stop), NULL);
+    return filter_entry;
+}
+
+// Changed paths are collected and applied as one tree diff once events go quiet
+#define PATCH_QUIET_MS 150
+#define PATCH_MAX_DELAY_US (2 * G_USEC_PER_SEC)
+#define PATCH_MAX_CHANGES 2000
+
+static GHashTable *dirty_paths = NULL;
+static GHashTable *rescan_paths = NULL;     // Folders whose events were lost and must be re-read
+static gboolean dirty_overflow = FALSE;
+static gint64 first_dirty_time = 0;
+static gint path_patch_serial = 0;          // Bumped to orphan the batch being stat'ed
+static gboolean path_patch_running = FALSE; // One batch at a time, so results land in order
+
+// One batch of changed paths. They are stat'ed off the main thread, since on
+// a network filesystem each stat can take a round trip.
+typedef struct {
+    GHashTable *changes;   // Changed paths
+    GHashTable *rescans;   // Folders among them whose events were lost, or NULL
+    GPtrArray *paths;      // Keys of changes, in the order of requests
+    StatRequest *requests; // Filled in by the thread
+    gint serial;
+} PathPatch;
+
+static void path_patch_free(gpointer data) {
+    PathPatch *patch = (PathPatch *)data;
+    g_hash_table_destroy(patch->changes);
+    if (patch->rescans) g_hash_table_destroy(patch->rescans);
+    g_ptr_array_free(patch->paths, TRUE);
+    g_free(patch->requests);
+    g_free(patch);
+}
+
+// Drop every changed path (and everything below it) from the file index, then
+// add back whatever still exists; new folders are indexed by the crawler.
+// A .git appearing or vanishing makes its folder a repository root or an ordinary folder again
+static gboolean patch_repo_root(const char *path, gboolean exists) {
+    if (!g_str_has_suffix(path, "/.git")) return FALSE;
+    char *dir = g_path_get_dirname(path);
+    FileId id = file_index_lookup(file_index, dir);
+    g_free(dir);
+    if (id == FILE_INDEX_NONE) return FALSE;
+    file_index_set_flag(file_index, id, FILE_NODE_REPO, exists);
+    return TRUE;
+}
+
+static void patch_file_index(PathPatch *patch) {
+    GArray *stale = g_array_new(FALSE, FALSE, sizeof(FileId));
+    GHashTable *folders = g_hash_table_new(g_direct_hash, g_direct_equal); // Whose rows change
+    gboolean repos_changed = FALSE;
+
+    for (guint i = 0; i < patch->paths->len; i++) {
+        FileId id = file_index_lookup(file_index, g_ptr_array_index(patch->paths, i));
+        if (id == FILE_INDEX_NONE) continue;
+        // A file that is still a file keeps its entry, and with it its row
+        const StatRequest *st = &patch->requests[i];
+        if (!(file_index_get_node(file_index, id)->flags & FILE_NODE_DIR) && st->error == 0 && !S_ISDIR(st->mode)) {
+            continue;
         }
+        g_array_append_val(stale, id);
+        g_hash_table_add(folders, GUINT_TO_POINTER(file_index_get_node(file_index, id)->parent));
+    }
+    file_index_remove(file_index, (const FileId *)stale->data, stale->len);
+    g_array_free(stale, TRUE);
+
+    for (guint i = 0; i < patch->paths->len; i++) {
+        const char *path = g_ptr_array_index(patch->paths, i);
+        const StatRequest *st = &patch->requests[i];
+        if (patch_repo_root(path, st->error == 0)) repos_changed = TRUE;
+        if (st->error != 0) continue;
+
+        // Only patch folders already listed; the rest is read when crawled or opened
+        char *dir = g_path_get_dirname(path);
+        FileId parent = strcmp(dir, current_folder) == 0 ? FILE_INDEX_ROOT : file_index_lookup(file_index, dir);
+        g_free(dir);
+        if (parent == FILE_INDEX_NONE) continue;
+        if (parent == FILE_INDEX_ROOT ? !tree_root_loaded : !(file_index_get_node(file_index, parent)->flags & FILE_NODE_LISTED)) continue;
+
+        char *name = g_path_get_basename(path);
+        gboolean is_dir = S_ISDIR(st->mode);
+        if (crawler_is_listed(name, is_dir)) {
+            guint16 flags = entry_flags(parent, is_dir, ignore_matcher_is_ignored(workspace_ignore, path, is_dir), FALSE);
+            FileId id = file_index_add(file_index, parent, name, flags);
+            if (is_dir && !(flags & FILE_NODE_IGNORED)) crawler_queue_dir(index_crawler, path, FILE_ID_TO_TAG(id));
+            if (global_git_status) set_entry_git_color(tree_model, id, path);
+            g_hash_table_add(folders, GUINT_TO_POINTER(parent));
+        }
+        g_free(name);
+    }
 
-        update_git_status(); // Trigger git update once the tree is fully built
-        return FALSE;
+    GHashTableIter it;
+    gpointer key;
+    g_hash_table_iter_init(&it, folders);
+    while (g_hash_table_iter_next(&it, &key, NULL)) sidebar_model_refresh(tree_model, GPOINTER_TO_UINT(key));
+    g_hash_table_destroy(folders);
+    compact_index();
+    if (repos_changed) scan_nested_repos();
+}
+
+static void apply_path_changes(PathPatch *patch) {
+    // A folder whose events were lost is among the changes too, so it is
+    // indexed afresh; what was expanded in it opens again as it is read
+    GHashTableIter it;
+    gpointer key;
+    if (patch->rescans && !filtering) {
+        g_hash_table_iter_init(&it, patch->rescans);
+        while (g_hash_table_iter_next(&it, &key, NULL)) save_expanded_state((const char *)key);
+    }
+
+    patch_file_index(patch);
+
+    if (patch->rescans && expanded_paths && !filtering) {
+        GString *path = g_string_new(NULL);
+        g_hash_table_iter_init(&it, patch->rescans);
+        while (g_hash_table_iter_next(&it, &key, NULL)) {
+            FileId id = file_index_lookup(file_index, (const char *)key);
+            if (id != FILE_INDEX_NONE) restore_expanded_row(id, path);
+        }
+        g_string_free(path, TRUE);
+    }
+    if (filtering) apply_sidebar_filter();
+}
+
+static void stat_changed_paths(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    PathPatch *patch = (PathPatch *)task_data;
+    stat_batch_run(patch->requests, patch->paths->len);
+    g_task_return_boolean(task, TRUE);
+}
+
+static gboolean debounced_refresh(gpointer data);
+
+static void on_changed_paths_stated(GObject *source, GAsyncResult *result, gpointer user_data) {
+    if (GPOINTER_TO_INT(user_data) != path_patch_serial) return;
+    path_patch_running = FALSE;
+
+    PathPatch *patch = g_task_get_task_data(G_TASK(result));
+    apply_path_changes(patch);
+    // Only the changed subtrees need a new status
+    GHashTableIter it;
+    gpointer key;
+    g_hash_table_iter_init(&it, patch->changes);
+    while (g_hash_table_iter_next(&it, &key, NULL)) queue_status_path((const char *)key);
+    git_jobs_request(GIT_JOB_PATHS);
+
+    // Changes that came in while this batch was out waited for it
+    if (refresh_timeout_id == 0 && (dirty_overflow || (dirty_paths && g_hash_table_size(dirty_paths) > 0))) {
+        refresh_timeout_id = g_idle_add(debounced_refresh, NULL);
     }
-    return TRUE;
 }
 
 static gboolean debounced_refresh(gpointer data) {
     refresh_timeout_id = 0;
-    reload_sidebar();
+
+    if (dirty_overflow) {
+        // Too many changes to patch row by row (branch switch, package install, ...)
+        dirty_overflow = FALSE;
+        reload_sidebar(); // Orphans the batch in flight too
+    } else if (path_patch_running) {
+        return FALSE; // Picked up when the batch in flight is applied
+    } else if (dirty_paths && g_hash_table_size(dirty_paths) > 0) {
+        PathPatch *patch = g_new0(PathPatch, 1);
+        patch->changes = dirty_paths;
+        patch->rescans = rescan_paths;
+        dirty_paths = NULL;
+        rescan_paths = NULL;
+        patch->paths = g_ptr_array_sized_new(g_hash_table_size(patch->changes));
+        GHashTableIter it;
+        gpointer key;
+        g_hash_table_iter_init(&it, patch->changes);
+        while (g_hash_table_iter_next(&it, &key, NULL)) g_ptr_array_add(patch->paths, key);
+        patch->requests = g_new0(StatRequest, patch->paths->len);
+        for (guint i = 0; i < patch->paths->len; i++) {
+            patch->requests[i].dir_fd = AT_FDCWD;
+            patch->requests[i].path = g_ptr_array_index(patch->paths, i);
+        }
+        patch->serial = ++path_patch_serial;
+        path_patch_running = TRUE;
+
+        GTask *task = g_task_new(NULL, NULL, on_changed_paths_stated, GINT_TO_POINTER(patch->serial));
+        g_task_set_task_data(task, patch, path_patch_free);
+        g_task_run_in_thread(task, stat_changed_paths);
+        g_object_unref(task);
+        return FALSE;
+    }
+    if (dirty_paths) g_hash_table_remove_all(dirty_paths);
+    if (rescan_paths) g_hash_table_remove_all(rescan_paths);
     return FALSE;
 }
 
-static void on_folder_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type, gpointer user_data) {
-    if (event_type == G_FILE_MONITOR_EVENT_CREATED || 
-        event_type == G_FILE_MONITOR_EVENT_DELETED ||
-        event_type == G_FILE_MONITOR_EVENT_RENAMED ||
-        event_type == G_FILE_MONITOR_EVENT_MOVED) {
-        
-        if (refresh_timeout_id > 0) g_source_remove(refresh_timeout_id);
-        refresh_timeout_id = g_timeout_add(500, debounced_refresh, NULL);
+static void queue_path_change(const char *path) {
+    if (!path || strlen(current_folder) == 0) return;
+    if (!dirty_paths) {
+        dirty_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    if (!dirty_overflow) {
+        g_hash_table_add(dirty_paths, g_strdup(path));
+        if (g_hash_table_size(dirty_paths) > PATCH_MAX_CHANGES) {
+            dirty_overflow = TRUE;
+            g_hash_table_remove_all(dirty_paths);
+        }
+    }
+
+    // Restart the quiet period on every event, but never postpone past the max delay
+    gint64 now = g_get_monotonic_time();
+    if (refresh_timeout_id == 0) {
+        first_dirty_time = now;
+    } else if (now - first_dirty_time < PATCH_MAX_DELAY_US) {
+        g_source_remove(refresh_timeout_id);
+        refresh_timeout_id = 0;
+    }
+    if (refresh_timeout_id == 0) {
+        refresh_timeout_id = g_timeout_add(PATCH_QUIET_MS, debounced_refresh, NULL);
+    }
+}
+
+// Saves issued by the editor. GIO writes a temporary file next to the target
+// and renames it into place, which the watcher sees as a create and a move;
+// neither changes what the tree or the index hold for an existing file.
+#define SELF_WRITE_WINDOW_US (2 * G_USEC_PER_SEC)
+#define SELF_WRITE_TEMP_PREFIX ".goutputstream-"
+
+typedef struct {
+    gint64 expires;     // Monotonic time after which events count again
+    gboolean done;      // Save finished; ino and mtime are what it left behind
+    gboolean existed;   // A new file still needs its row, so only the temp file is dropped
+    ino_t ino;
+    gint64 mtime;
+} SelfWrite;
+
+static GHashTable *self_writes = NULL; // Path -> SelfWrite*
+
+void expect_self_write(const char *path) {
+    if (!self_writes) self_writes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    struct stat st;
+    SelfWrite *write = g_new0(SelfWrite, 1);
+    write->expires = g_get_monotonic_time() + SELF_WRITE_WINDOW_US;
+    write->existed = stat(path, &st) == 0;
+    g_hash_table_replace(self_writes, g_strdup(path), write);
+}
+
+void confirm_self_write(const char *path, gboolean written) {
+    SelfWrite *write = self_writes ? g_hash_table_lookup(self_writes, path) : NULL;
+    struct stat st;
+    if (write) {
+        if (written && stat(path, &st) == 0) {
+            write->done = TRUE;
+            write->ino = st.st_ino;
+            write->mtime = STAT_MTIME_NS(st);
+            write->expires = g_get_monotonic_time() + SELF_WRITE_WINDOW_US;
+        } else {
+            g_hash_table_remove(self_writes, path);
+        }
+    }
+    if (written) update_git_status_for_path(path); // Only this row's decoration can have changed
+}
+
+static gboolean is_self_write_event(const char *path) {
+    if (!self_writes || g_hash_table_size(self_writes) == 0) return FALSE;
+
+    gint64 now = g_get_monotonic_time();
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, self_writes);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        SelfWrite *write = (SelfWrite *)value;
+        if (now > write->expires) g_hash_table_iter_remove(&it);
+    }
+
+    SelfWrite *write = g_hash_table_lookup(self_writes, path);
+    if (write) {
+        if (!write->existed) return FALSE;
+        if (!write->done) return TRUE;
+        // Someone else may have written the file after we did
+        struct stat st;
+        return stat(path, &st) == 0 && st.st_ino == write->ino && STAT_MTIME_NS(st) == write->mtime;
+    }
+
+    char *name = g_path_get_basename(path);
+    gboolean is_temp = g_str_has_prefix(name, SELF_WRITE_TEMP_PREFIX);
+    g_free(name);
+    if (!is_temp) return FALSE;
+
+    char *dir = g_path_get_dirname(path);
+    gboolean found = FALSE;
+    g_hash_table_iter_init(&it, self_writes);
+    while (!found && g_hash_table_iter_next(&it, &key, NULL)) {
+        char *target_dir = g_path_get_dirname((const char *)key);
+        found = strcmp(dir, target_dir) == 0;
+        g_free(target_dir);
+    }
+    g_free(dir);
+    return found;
+}
+
+static void on_watch_write(Watcher *watcher, const char *path, gpointer user_data) {
+    // Our own saves refresh their file's status directly; ignored files never show a status
+    if (is_self_write_event(path) || ignore_matcher_is_ignored(workspace_ignore, path, FALSE)) return;
+    WorkspaceRepo *repo = repo_for_path(path);
+    if (!repo) return;
+    repo->written = TRUE;
+    schedule_git_refresh(GIT_REFRESH_TRACKED);
+}
+
+static void on_watch_change(Watcher *watcher, const char *path, gpointer user_data) {
+    // New ignore rules can change what is indexed anywhere below, so start over
+    if (ignore_matcher_is_rules_file(workspace_ignore, path)) dirty_overflow = TRUE;
+    else if (is_self_write_event(path)) return;
+    queue_path_change(path);
+}
+
+static void on_watch_rescan(Watcher *watcher, const char *path, gpointer user_data) {
+    if (strcmp(path, current_folder) == 0) {
+        dirty_overflow = TRUE;
+    } else {
+        if (!rescan_paths) {
+            rescan_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        }
+        g_hash_table_add(rescan_paths, g_strdup(path));
     }
+    queue_path_change(path);
+}
+
+static void on_watch_limit(Watcher *watcher, guint used, guint max, gboolean exhausted, gpointer user_data) {
+    char msg[256];
+    if (exhausted) {
+        snprintf(msg, sizeof(msg), "File watching incomplete: %u of %u inotify watches (raise fs.inotify.max_user_watches)", used, max);
+    } else {
+        snprintf(msg, sizeof(msg), "File watching near limit: %u of %u inotify watches", used, max);
+    }
+    g_warning("%s", msg);
+    set_status_notice(msg);
+}
+
+static void stop_watching() {
+    if (workspace_watcher) {
+        watcher_destroy(workspace_watcher);
+        workspace_watcher = NULL;
+    }
+}
+
+// Watches follow the ignore rules, so they are rebuilt along with them
+static void start_watching(const char *path) {
+    stop_watching();
+    set_status_notice(NULL);
+    workspace_watcher = watcher_new(path, workspace_ignore, on_watch_change, on_watch_write, on_watch_rescan, on_watch_limit, NULL);
+}
+
+// Pending changes are moot once the tree is rebuilt from scratch
+static void discard_path_changes() {
+    if (refresh_timeout_id > 0) {
+        g_source_remove(refresh_timeout_id);
+        refresh_timeout_id = 0;
+    }
+    if (dirty_paths) g_hash_table_remove_all(dirty_paths);
+    if (rescan_paths) g_hash_table_remove_all(rescan_paths);
+    dirty_overflow = FALSE;
+    path_patch_serial++;
+    path_patch_running = FALSE;
 }
 
 void open_folder(const char *path) {
@@ -454,34 +1950,24 @@ void open_folder(const char *path) {
         g_hash_table_destroy(expanded_paths);
         expanded_paths = NULL;
     }
+    g_clear_pointer(&pending_reveal, g_free);
+    discard_path_changes();
     stop_population_if_running();
-    gtk_tree_store_clear(tree_store);
-    g_list_free_full(file_list, g_free);
-    file_list = NULL;
+    reset_sidebar_filter();
+    sidebar_model_clear(tree_model); // Before the index it reads is reset
+    clear_git_status();
+    save_index_cache(); // What the watcher patched into the previous workspace
     g_strlcpy(current_folder, path, sizeof(current_folder));
+    file_index_reset(file_index, path);
 
-    populate_ctx = g_new0(PopulateContext, 1);
-    populate_ctx->queue = g_queue_new();
-    
-    DirTask *root_task = g_new0(DirTask, 1);
-    root_task->path = g_strdup(path);
-    root_task->has_parent = FALSE;
-    g_queue_push_tail(populate_ctx->queue, root_task);
-
-    populate_ctx->source_id = g_idle_add(populate_step, NULL);
+    start_population(path, TRUE);
 
-    // Setup file monitor
-    if (folder_monitor) {
-        g_file_monitor_cancel(folder_monitor);
-        g_object_unref(folder_monitor);
-    }
-    GFile *gf = g_file_new_for_path(path);
-    folder_monitor = g_file_monitor_directory(gf, G_FILE_MONITOR_NONE, NULL, NULL);
-    g_signal_connect(folder_monitor, "changed", G_CALLBACK(on_folder_changed), NULL);
-    g_object_unref(gf);
+    // Watch the whole workspace for files appearing, vanishing or moving
+    start_watching(path);
 
     save_recent_folder(path);
-    update_git_status();
+    start_git_monitors(path);
+    schedule_git_refresh(GIT_REFRESH_STATUS | GIT_REFRESH_BRANCH);
     show_editor_view(); // Will show empty state as current_file is empty
     ui_refresh_terminal_paths(path);
     
@@ -499,14 +1985,13 @@ void close_folder() {
         g_hash_table_destroy(expanded_paths);
         expanded_paths = NULL;
     }
-    if (global_git_status) {
-        g_hash_table_destroy(global_git_status);
-        global_git_status = NULL;
-    }
+    g_clear_pointer(&pending_reveal, g_free);
+    clear_git_status();
     stop_population_if_running();
-    gtk_tree_store_clear(tree_store);
-    g_list_free_full(file_list, g_free);
-    file_list = NULL;
+    reset_sidebar_filter();
+    sidebar_model_clear(tree_model); // Before the index it reads is reset
+    save_index_cache();
+    if (file_index) file_index_reset(file_index, "");
     current_folder[0] = '\0';
     if (sidebar_column) {
         gtk_tree_view_column_set_title(sidebar_column, "Files");
@@ -516,46 +2001,27 @@ void close_folder() {
         current_file_row_ref = NULL;
     }
 
-    if (folder_monitor) {
-        g_file_monitor_cancel(folder_monitor);
-        g_object_unref(folder_monitor);
-        folder_monitor = NULL;
-    }
-    if (refresh_timeout_id > 0) {
-        g_source_remove(refresh_timeout_id);
-        refresh_timeout_id = 0;
-    }
+    stop_watching();
+    stop_git_monitors();
+    discard_path_changes();
+    g_clear_pointer(&workspace_ignore, ignore_matcher_unref);
 
+    set_status_notice(NULL);
     show_welcome_screen();
 }
 
 void reload_sidebar() {
     if (strlen(current_folder) > 0) {
-        if (!expanded_paths) {
-            expanded_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-        } else {
-            g_hash_table_remove_all(expanded_paths);
-        }
-        
-        GtkTreeIter root_iter;
-        if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(tree_store), &root_iter)) {
-            save_expanded_state_recursive(GTK_TREE_MODEL(tree_store), &root_iter);
-        }
-        
-        stop_population_if_running();
-        gtk_tree_store_clear(tree_store);
-        g_list_free_full(file_list, g_free);
-        file_list = NULL;
+        if (expanded_paths) g_hash_table_remove_all(expanded_paths);
+        if (!filtering) save_expanded_state(NULL);
 
-        populate_ctx = g_new0(PopulateContext, 1);
-        populate_ctx->queue = g_queue_new();
-
-        DirTask *root_task = g_new0(DirTask, 1);
-        root_task->path = g_strdup(current_folder);
-        root_task->has_parent = FALSE;
-        g_queue_push_tail(populate_ctx->queue, root_task);
+        discard_path_changes();
+        stop_population_if_running();
+        sidebar_model_clear(tree_model); // Before the index it reads is reset
+        file_index_reset(file_index, current_folder);
 
-        populate_ctx->source_id = g_idle_add(populate_step, NULL);
+        start_population(current_folder, FALSE);
+        start_watching(current_folder);
     }
 }
 
@@ -574,12 +2040,11 @@ void cleanup_sidebar() {
         g_source_remove(refresh_timeout_id);
         refresh_timeout_id = 0;
     }
-    if (folder_monitor) {
-        g_file_monitor_cancel(folder_monitor);
-        g_object_unref(folder_monitor);
-        folder_monitor = NULL;
-    }
+    stop_watching();
+    stop_git_monitors();
     stop_population_if_running();
+    save_index_cache();
+    g_clear_pointer(&workspace_ignore, ignore_matcher_unref);
 }
 
 
@@ -589,17 +2054,18 @@ static void on_row_activated(GtkTreeView *tv, GtkTreePath *path, GtkTreeViewColu
     if (gtk_tree_model_get_iter(model, &iter, path)) {
         char *filepath;
         gtk_tree_model_get(model, &iter, 2, &filepath, -1);
-        
-        struct stat st;
-        if (stat(filepath, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
+
+        // The row already knows what it is; no need to stat on the main thread
+        SidebarRowKind kind = sidebar_model_get_kind(SIDEBAR_MODEL(model), &iter);
+        if (filepath) {
+            if (kind == SIDEBAR_ROW_DIR) {
                 // Toggle expansion for folders on single click
                 if (gtk_tree_view_row_expanded(tv, path)) {
                     gtk_tree_view_collapse_row(tv, path);
                 } else {
                     gtk_tree_view_expand_row(tv, path, FALSE);
                 }
-            } else if (S_ISREG(st.st_mode)) {
+            } else if (kind == SIDEBAR_ROW_FILE) {
                 // Check extension for binary files (images, pdfs)
                 const char *ext = strrchr(filepath, '.');
                 if (ext) {
@@ -679,9 +2145,10 @@ static gboolean on_tree_view_button_press(GtkWidget *widget, GdkEventButton *eve
 GtkTreeViewColumn *sidebar_column = NULL;
 
 void init_sidebar() {
-    // 0: icon-name, 1: name, 2: path, 3: color, 4: git-status-letter
-    tree_store = gtk_tree_store_new(5, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
-    tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(tree_store));
+    // 0: icon-name, 1: name, 2: path, 3: color, 4: git-status-letter, all computed per row
+    file_index = file_index_new("");
+    tree_model = sidebar_model_new(file_index);
+    tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(tree_model));
     
     // Enable single-click activation
     gtk_tree_view_set_activate_on_single_click(GTK_TREE_VIEW(tree_view), TRUE);
@@ -710,76 +2177,28 @@ void init_sidebar() {
     gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view), column);
 
     g_signal_connect(tree_view, "row-activated", G_CALLBACK(on_row_activated), NULL);
+    g_signal_connect(tree_view, "row-expanded", G_CALLBACK(on_row_expanded), NULL);
     g_signal_connect(tree_view, "button-press-event", G_CALLBACK(on_tree_view_button_press), NULL);
 
-    // Initial background git poll
+    // Safety-net git poll; changes normally arrive through the watches
+    git_jobs_register(GIT_JOB_STATUS, start_full_status, NULL);
+    git_jobs_register(GIT_JOB_PATHS, start_path_status, NULL);
+    git_jobs_register(GIT_JOB_TRACKED, start_tracked_check, NULL);
     if (git_poll_timeout_id == 0) {
-        git_poll_timeout_id = g_timeout_add_seconds(2, background_git_poll, NULL);
+        git_poll_timeout_id = g_timeout_add_seconds(GIT_SAFETY_POLL_S, background_git_poll, NULL);
     }
 }
 
-void select_file_in_sidebar_recursive(GtkTreeModel *model, GtkTreeIter *iter, const char *filepath) {
-    do {
-        char *path;
-        gtk_tree_model_get(model, iter, 2, &path, -1);
-        if (path && strcmp(path, filepath) == 0) {
-            GtkTreePath *tree_path = gtk_tree_model_get_path(model, iter);
-            gtk_tree_view_expand_to_path(GTK_TREE_VIEW(tree_view), tree_path);
-            gtk_tree_view_set_cursor(GTK_TREE_VIEW(tree_view), tree_path, NULL, FALSE);
-            gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(tree_view), tree_path, NULL, TRUE, 0.5, 0.0);
-            if (current_file_row_ref) gtk_tree_row_reference_free(current_file_row_ref);
-            current_file_row_ref = gtk_tree_row_reference_new(model, tree_path);
-            gtk_tree_path_free(tree_path);
-            g_free(path);
-            return;
-        }
-        GtkTreeIter child_iter;
-        if (gtk_tree_model_iter_children(model, &child_iter, iter)) {
-            select_file_in_sidebar_recursive(model, &child_iter, filepath);
-        }
-        g_free(path);
-    } while (gtk_tree_model_iter_next(model, iter));
-}
-
 void select_file_in_sidebar(const char *filepath) {
-    GtkTreeModel *model = GTK_TREE_MODEL(tree_store);
-    GtkTreeIter iter;
-    if (gtk_tree_model_get_iter_first(model, &iter)) {
-        do {
-            char *path;
-            gtk_tree_model_get(model, &iter, 2, &path, -1);
-            if (path && strcmp(path, filepath) == 0) {
-                GtkTreePath *tree_path = gtk_tree_model_get_path(model, &iter);
-                gtk_tree_view_expand_to_path(GTK_TREE_VIEW(tree_view), tree_path);
-                gtk_tree_view_set_cursor(GTK_TREE_VIEW(tree_view), tree_path, NULL, FALSE);
-                gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(tree_view), tree_path, NULL, TRUE, 0.5, 0.0);
-                if (current_file_row_ref) gtk_tree_row_reference_free(current_file_row_ref);
-                current_file_row_ref = gtk_tree_row_reference_new(model, tree_path);
-                gtk_tree_path_free(tree_path);
-                g_free(path);
-                return;
-            }
-            GtkTreeIter child_iter;
-            if (gtk_tree_model_iter_children(model, &child_iter, &iter)) {
-                select_file_in_sidebar_recursive(model, &child_iter, filepath);
-            }
-            g_free(path);
-        } while (gtk_tree_model_iter_next(model, &iter));
-    }
+    g_free(pending_reveal);
+    pending_reveal = g_strdup(filepath);
+    reveal_pending_file();
 }
 
 void mark_unsaved_file(const char *filepath, gboolean unsaved) {
-    if (current_file_row_ref && gtk_tree_row_reference_valid(current_file_row_ref)) {
-        GtkTreePath *path = gtk_tree_row_reference_get_path(current_file_row_ref);
-        GtkTreeIter iter;
-        GtkTreeModel *model = GTK_TREE_MODEL(tree_store);
-        if (gtk_tree_model_get_iter(model, &iter, path)) {
-            char *filename = g_path_get_basename(filepath);
-            char display_name[1024];
-            snprintf(display_name, sizeof(display_name), "%s%s", filename, unsaved ? " *" : "");
-            gtk_tree_store_set(tree_store, &iter, 1, display_name, -1);
-            g_free(filename);
-        }
-        gtk_tree_path_free(path);
-    }
+    FileId id = filepath ? file_index_lookup(file_index, filepath) : FILE_INDEX_NONE;
+    if (id == FILE_INDEX_NONE) return;
+
+    // Called on every keystroke; the model only redraws the row when the mark flips
+    sidebar_model_set_unsaved(tree_model, id, unsaved);
 }
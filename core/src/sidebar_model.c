@@ -0,0 +1,681 @@
+#include "sidebar_model.h"
+#include <string.h>
+
+#define GIT_COLOR_MODIFIED "#E2C08D" // Yellow
+#define GIT_COLOR_ADDED "#73C991"    // Green
+
+// Rows of one folder, read from the index when the view first asks for them
+typedef struct {
+    GArray *rows;           // FileId, in display order
+    gboolean loading;       // A LOADING row comes before them
+} Level;
+
+struct _SidebarModel {
+    GObject parent_instance;
+    FileIndex *index;
+    GHashTable *levels;     // Folder FileId -> Level*, only for folders whose row is shown
+    GHashTable *unsaved;    // FileIds of files with unsaved edits
+    guint32 *visible;       // While filtering: one bit per id, NULL shows every entry
+    guint n_visible;
+    gint stamp;
+};
+
+// Iters hold the FileId in user_data; the loading row holds its folder's id
+// and a non-NULL user_data2. user_data3 is the row's position when the iter
+// was made, checked before use so a stale one only costs a search.
+
+static void sidebar_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(SidebarModel, sidebar_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, sidebar_model_tree_model_init))
+
+static void level_free(gpointer data) {
+    Level *level = data;
+    g_array_free(level->rows, TRUE);
+    g_free(level);
+}
+
+static guint level_len(Level *level) {
+    return level->rows->len + (level->loading ? 1 : 0);
+}
+
+static const FileNode* entry(SidebarModel *model, FileId id) {
+    return file_index_get_node(model->index, id);
+}
+
+static gboolean is_dir(SidebarModel *model, FileId id) {
+    return (entry(model, id)->flags & FILE_NODE_DIR) != 0;
+}
+
+static gboolean in_mask(const guint32 *visible, guint n_visible, FileId id) {
+    return !visible || (id < n_visible && FILE_INDEX_BIT_TEST(visible, id));
+}
+
+static gboolean is_visible(SidebarModel *model, FileId id) {
+    return in_mask(model->visible, model->n_visible, id);
+}
+
+// Same order as the crawler: folders first, then case-insensitive by name
+static gint compare_entries(SidebarModel *model, FileId a, FileId b) {
+    if (a == b) return 0;
+    gboolean dir_a = is_dir(model, a);
+    if (dir_a != is_dir(model, b)) return dir_a ? -1 : 1;
+
+    const char *name_a = file_index_get_name(model->index, a);
+    const char *name_b = file_index_get_name(model->index, b);
+    gint cmp = g_ascii_strcasecmp(name_a, name_b);
+    if (cmp == 0) cmp = strcmp(name_a, name_b);
+    if (cmp == 0) cmp = a < b ? -1 : 1; // A removed entry and the one re-added under its name
+    return cmp;
+}
+
+static gint compare_ids(gconstpointer a, gconstpointer b, gpointer model) {
+    return compare_entries(model, *(const FileId *)a, *(const FileId *)b);
+}
+
+// While filtering, folders without a match are left empty instead
+static gboolean needs_loading_row(SidebarModel *model, FileId folder) {
+    return folder != FILE_INDEX_ROOT && !model->visible && !(entry(model, folder)->flags & FILE_NODE_LISTED);
+}
+
+static GArray* read_rows(SidebarModel *model, FileId folder) {
+    GArray *rows = g_array_new(FALSE, FALSE, sizeof(FileId));
+    for (FileId id = file_index_get_first_child(model->index, folder); id != FILE_INDEX_NONE;
+         id = file_index_get_next_sibling(model->index, id)) {
+        if (is_visible(model, id)) g_array_append_val(rows, id);
+    }
+    g_array_sort_with_data(rows, compare_ids, model);
+    return rows;
+}
+
+static Level* lookup_level(SidebarModel *model, FileId folder) {
+    return g_hash_table_lookup(model->levels, GUINT_TO_POINTER(folder));
+}
+
+// Only for folders whose row is shown, so every level has its parent's
+static Level* get_level(SidebarModel *model, FileId folder) {
+    Level *level = lookup_level(model, folder);
+    if (!level) {
+        level = g_new(Level, 1);
+        level->rows = read_rows(model, folder);
+        level->loading = needs_loading_row(model, folder);
+        g_hash_table_insert(model->levels, GUINT_TO_POINTER(folder), level);
+    }
+    return level;
+}
+
+// Whether a folder has any row under a mask, without reading its level
+static gboolean has_rows_in(SidebarModel *model, FileId folder, const guint32 *visible, guint n_visible) {
+    if (!visible && !(entry(model, folder)->flags & FILE_NODE_LISTED)) return TRUE; // Loading row
+    for (FileId id = file_index_get_first_child(model->index, folder); id != FILE_INDEX_NONE;
+         id = file_index_get_next_sibling(model->index, id)) {
+        if (in_mask(visible, n_visible, id)) return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean has_rows(SidebarModel *model, FileId folder) {
+    return has_rows_in(model, folder, model->visible, model->n_visible);
+}
+
+// Position of an entry's row in the level, -1 if it is not there
+static gint find_row(SidebarModel *model, Level *level, FileId id, gint hint) {
+    GArray *rows = level->rows;
+    gint skip = level->loading ? 1 : 0;
+    if (hint >= skip && (guint)(hint - skip) < rows->len && g_array_index(rows, FileId, hint - skip) == id) return hint;
+
+    guint lo = 0, hi = rows->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        gint cmp = compare_entries(model, g_array_index(rows, FileId, mid), id);
+        if (cmp == 0) return mid + skip;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+static void set_id_iter(SidebarModel *model, GtkTreeIter *iter, FileId id, gboolean loading, gint n) {
+    iter->stamp = model->stamp;
+    iter->user_data = GUINT_TO_POINTER(id);
+    iter->user_data2 = loading ? GINT_TO_POINTER(1) : NULL;
+    iter->user_data3 = GINT_TO_POINTER(n);
+}
+
+static gboolean set_row(SidebarModel *model, GtkTreeIter *iter, Level *level, FileId folder, gint n) {
+    if (n < 0 || (guint)n >= level_len(level)) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    if (level->loading && n == 0) set_id_iter(model, iter, folder, TRUE, 0);
+    else set_id_iter(model, iter, g_array_index(level->rows, FileId, n - (level->loading ? 1 : 0)), FALSE, n);
+    return TRUE;
+}
+
+static FileId iter_id(SidebarModel *model, GtkTreeIter *iter) {
+    g_return_val_if_fail(iter && iter->stamp == model->stamp, FILE_INDEX_ROOT);
+    return GPOINTER_TO_UINT(iter->user_data);
+}
+
+static gboolean is_loading_row(GtkTreeIter *iter) {
+    return iter->user_data2 != NULL;
+}
+
+// Folder whose level the row is in
+static FileId iter_folder(SidebarModel *model, GtkTreeIter *iter) {
+    FileId id = iter_id(model, iter);
+    if (id == FILE_INDEX_ROOT || is_loading_row(iter)) return id;
+    return entry(model, id)->parent;
+}
+
+// Tree path of an entry's row, NULL if it is not shown. With read FALSE, only
+// levels the view already asked for are looked at.
+static GtkTreePath* row_path(SidebarModel *model, FileId id, gint hint, gboolean read) {
+    FileId folder = entry(model, id)->parent;
+    GtkTreePath *path = folder == FILE_INDEX_ROOT ? gtk_tree_path_new() : row_path(model, folder, -1, read);
+    if (!path) return NULL;
+
+    Level *level = read ? get_level(model, folder) : lookup_level(model, folder);
+    gint n = level ? find_row(model, level, id, hint) : -1;
+    if (n < 0) {
+        gtk_tree_path_free(path);
+        return NULL;
+    }
+    gtk_tree_path_append_index(path, n);
+    return path;
+}
+
+static GtkTreePath* folder_path(SidebarModel *model, FileId folder) {
+    return folder == FILE_INDEX_ROOT ? gtk_tree_path_new() : row_path(model, folder, -1, FALSE);
+}
+
+static void emit_changed(SidebarModel *model, FileId id) {
+    GtkTreePath *path = row_path(model, id, -1, FALSE);
+    if (!path) return;
+    GtkTreeIter iter;
+    set_id_iter(model, &iter, id, FALSE, gtk_tree_path_get_indices(path)[gtk_tree_path_get_depth(path) - 1]);
+    gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+    gtk_tree_path_free(path);
+}
+
+static void emit_has_child_toggled(SidebarModel *model, FileId folder) {
+    if (folder == FILE_INDEX_ROOT) return;
+    GtkTreePath *path = row_path(model, folder, -1, FALSE);
+    if (!path) return;
+    GtkTreeIter iter;
+    set_id_iter(model, &iter, folder, FALSE, gtk_tree_path_get_indices(path)[gtk_tree_path_get_depth(path) - 1]);
+    gtk_tree_model_row_has_child_toggled(GTK_TREE_MODEL(model), path, &iter);
+    gtk_tree_path_free(path);
+}
+
+static void emit_inserted(SidebarModel *model, GtkTreePath *parent_path, FileId id, gboolean loading, gint n) {
+    GtkTreePath *path = gtk_tree_path_copy(parent_path);
+    gtk_tree_path_append_index(path, n);
+    GtkTreeIter iter;
+    set_id_iter(model, &iter, id, loading, n);
+    gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+    gtk_tree_path_free(path);
+}
+
+static void emit_deleted(SidebarModel *model, GtkTreePath *parent_path, gint n) {
+    GtkTreePath *path = gtk_tree_path_copy(parent_path);
+    gtk_tree_path_append_index(path, n);
+    gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+    gtk_tree_path_free(path);
+}
+
+typedef struct {
+    SidebarModel *model;
+    FileId folder;
+} SubtreeMatch;
+
+static gboolean level_is_under(gpointer key, gpointer value, gpointer user_data) {
+    SubtreeMatch *match = user_data;
+    for (FileId id = GPOINTER_TO_UINT(key); id != FILE_INDEX_ROOT; id = entry(match->model, id)->parent) {
+        if (id == match->folder) return TRUE;
+    }
+    return FALSE;
+}
+
+// Forget the levels of a folder whose row went away, and of everything below it
+static void drop_levels(SidebarModel *model, FileId folder) {
+    if (!is_dir(model, folder) || g_hash_table_size(model->levels) <= 1) return;
+    SubtreeMatch match = { model, folder };
+    g_hash_table_foreach_remove(model->levels, level_is_under, &match);
+}
+
+// Everything inside an untracked folder is untracked, up to a nested repository
+static int own_git_status(SidebarModel *model, FileId id) {
+    int own = FILE_NODE_GIT_OWN(entry(model, id));
+    if (own) return own;
+
+    for (FileId dir = entry(model, id)->parent; dir != FILE_INDEX_ROOT; dir = entry(model, dir)->parent) {
+        const FileNode *node = entry(model, dir);
+        if (node->flags & FILE_NODE_REPO) break;
+        if (FILE_NODE_GIT_OWN(node) == GIT_STATUS_UNTRACKED) return GIT_STATUS_UNTRACKED;
+    }
+    return GIT_STATUS_NONE;
+}
+
+// GtkTreeModel
+
+static GtkTreeModelFlags model_get_flags(GtkTreeModel *tree_model) {
+    return 0; // Iters are ids, which compaction renumbers
+}
+
+static gint model_get_n_columns(GtkTreeModel *tree_model) {
+    return SIDEBAR_N_COLUMNS;
+}
+
+static GType model_get_column_type(GtkTreeModel *tree_model, gint column) {
+    return G_TYPE_STRING;
+}
+
+static gboolean model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path) {
+    SidebarModel *model = SIDEBAR_MODEL(tree_model);
+    gint depth;
+    gint *indices = gtk_tree_path_get_indices_with_depth(path, &depth);
+    FileId folder = FILE_INDEX_ROOT;
+    iter->stamp = 0;
+
+    for (gint i = 0; i < depth; i++) {
+        if (i > 0) {
+            if (is_loading_row(iter) || !is_dir(model, iter_id(model, iter))) return FALSE;
+            folder = iter_id(model, iter);
+        }
+        if (!set_row(model, iter, get_level(model, folder), folder, indices[i])) return FALSE;
+    }
+    return depth > 0;
+}
+
+static GtkTreePath* model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    SidebarModel *model = SIDEBAR_MODEL(tree_model);
+    FileId id = iter_id(model, iter);
+    if (!is_loading_row(iter)) return row_path(model, id, GPOINTER_TO_INT(iter->user_data3), FALSE);
+
+    GtkTreePath *path = row_path(model, id, -1, FALSE);
+    if (path) gtk_tree_path_append_index(path, 0);
+    return path;
+}
+
+static void model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value) {
+    SidebarModel *model = SIDEBAR_MODEL(tree_model);
+    FileId id = iter_id(model, iter);
+    SidebarRowKind kind = sidebar_model_get_kind(model, iter);
+    g_value_init(value, G_TYPE_STRING);
+
+    if (kind == SIDEBAR_ROW_LOADING) {
+        if (column == SIDEBAR_COL_NAME) g_value_set_static_string(value, "Loading...");
+        return;
+    }
+
+    switch (column) {
+        case SIDEBAR_COL_ICON:
+            g_value_set_static_string(value, kind == SIDEBAR_ROW_DIR ? "folder-symbolic" : "text-x-generic-symbolic");
+            break;
+        case SIDEBAR_COL_NAME:
+            if (g_hash_table_contains(model->unsaved, GUINT_TO_POINTER(id))) {
+                g_value_take_string(value, g_strconcat(file_index_get_name(model->index, id), " *", NULL));
+            } else {
+                g_value_set_string(value, file_index_get_name(model->index, id));
+            }
+            break;
+        case SIDEBAR_COL_PATH:
+            g_value_take_string(value, sidebar_model_get_path(model, iter));
+            break;
+        case SIDEBAR_COL_COLOR:
+            switch (own_git_status(model, id)) {
+                case GIT_STATUS_MODIFIED:
+                    g_value_set_static_string(value, GIT_COLOR_MODIFIED);
+                    break;
+                case GIT_STATUS_ADDED:
+                case GIT_STATUS_UNTRACKED:
+                    g_value_set_static_string(value, GIT_COLOR_ADDED);
+                    break;
+                default: {
+                    // Folders take the color of their changes, like VSCode, but not the letter
+                    int below = FILE_NODE_GIT_BELOW(entry(model, id));
+                    if (below & GIT_STATUS_MODIFIED) {
+                        g_value_set_static_string(value, GIT_COLOR_MODIFIED);
+                    } else if (below & (GIT_STATUS_ADDED | GIT_STATUS_UNTRACKED)) {
+                        g_value_set_static_string(value, GIT_COLOR_ADDED);
+                    }
+                    break;
+                }
+            }
+            break;
+        case SIDEBAR_COL_STATUS:
+            switch (own_git_status(model, id)) {
+                case GIT_STATUS_MODIFIED: g_value_set_static_string(value, "M"); break;
+                case GIT_STATUS_ADDED: g_value_set_static_string(value, "A"); break;
+                case GIT_STATUS_UNTRACKED: g_value_set_static_string(value, "U"); break;
+                default: g_value_set_static_string(value, ""); break;
+            }
+            break;
+    }
+}
+
+// Moves the iter by delta within its level
+static gboolean step_row(SidebarModel *model, GtkTreeIter *iter, gint delta) {
+    FileId folder = iter_folder(model, iter);
+    Level *level = get_level(model, folder);
+    gint n = is_loading_row(iter) ? 0 : find_row(model, level, iter_id(model, iter), GPOINTER_TO_INT(iter->user_data3));
+    return set_row(model, iter, level, folder, n < 0 ? -1 : n + delta);
+}
+
+static gboolean model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return step_row(SIDEBAR_MODEL(tree_model), iter, 1);
+}
+
+static gboolean model_iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return step_row(SIDEBAR_MODEL(tree_model), iter, -1);
+}
+
+static gboolean model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n) {
+    SidebarModel *model = SIDEBAR_MODEL(tree_model);
+    FileId folder = FILE_INDEX_ROOT;
+    if (parent) {
+        folder = iter_id(model, parent);
+        if (is_loading_row(parent) || !is_dir(model, folder)) {
+            iter->stamp = 0;
+            return FALSE;
+        }
+    }
+    return set_row(model, iter, get_level(model, folder), folder, n);
+}
+
+static gboolean model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent) {
+    return model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+static gboolean model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    SidebarModel *model = SIDEBAR_MODEL(tree_model);
+    FileId id = iter_id(model, iter);
+    if (is_loading_row(iter) || !is_dir(model, id)) return FALSE;
+    Level *level = lookup_level(model, id);
+    return level ? level_len(level) > 0 : has_rows(model, id);
+}
+
+static gint model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    SidebarModel *model = SIDEBAR_MODEL(tree_model);
+    if (!iter) return level_len(get_level(model, FILE_INDEX_ROOT));
+    FileId id = iter_id(model, iter);
+    if (is_loading_row(iter) || !is_dir(model, id)) return 0;
+    return level_len(get_level(model, id));
+}
+
+static gboolean model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child) {
+    SidebarModel *model = SIDEBAR_MODEL(tree_model);
+    FileId folder = iter_folder(model, child);
+    if (folder == FILE_INDEX_ROOT) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    set_id_iter(model, iter, folder, FALSE, -1);
+    return TRUE;
+}
+
+static void sidebar_model_tree_model_init(GtkTreeModelIface *iface) {
+    iface->get_flags = model_get_flags;
+    iface->get_n_columns = model_get_n_columns;
+    iface->get_column_type = model_get_column_type;
+    iface->get_iter = model_get_iter;
+    iface->get_path = model_get_path;
+    iface->get_value = model_get_value;
+    iface->iter_next = model_iter_next;
+    iface->iter_previous = model_iter_previous;
+    iface->iter_children = model_iter_children;
+    iface->iter_has_child = model_iter_has_child;
+    iface->iter_n_children = model_iter_n_children;
+    iface->iter_nth_child = model_iter_nth_child;
+    iface->iter_parent = model_iter_parent;
+}
+
+// GObject
+
+static void sidebar_model_finalize(GObject *object) {
+    SidebarModel *model = SIDEBAR_MODEL(object);
+    g_hash_table_destroy(model->levels);
+    g_hash_table_destroy(model->unsaved);
+    g_free(model->visible);
+    G_OBJECT_CLASS(sidebar_model_parent_class)->finalize(object);
+}
+
+static void sidebar_model_class_init(SidebarModelClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = sidebar_model_finalize;
+}
+
+static void sidebar_model_init(SidebarModel *model) {
+    model->levels = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, level_free);
+    model->unsaved = g_hash_table_new(g_direct_hash, g_direct_equal);
+    model->stamp = g_random_int();
+}
+
+SidebarModel* sidebar_model_new(FileIndex *index) {
+    SidebarModel *model = g_object_new(SIDEBAR_TYPE_MODEL, NULL);
+    model->index = index;
+    get_level(model, FILE_INDEX_ROOT); // Read before a view sees it, so later rows are signalled
+    return model;
+}
+
+// Diffs a read level against the index. kept_dirs, when given, collects the
+// folder rows that stay, and the levels of folder rows that go are left for
+// the caller to drop.
+static void update_level(SidebarModel *model, FileId parent, Level *level, GArray *kept_dirs) {
+    GtkTreePath *path = folder_path(model, parent);
+    if (!path) return;
+
+    guint old_len = level_len(level);
+    GArray *rows = read_rows(model, parent);
+    gboolean loading = needs_loading_row(model, parent);
+    if (level->loading && !loading) {
+        level->loading = FALSE;
+        emit_deleted(model, path, 0);
+    }
+
+    // Both lists are sorted: walk them together, removing rows that are gone
+    // and inserting new ones in place, so each signal matches the rows as they are
+    guint i = 0, j = 0;
+    while (i < level->rows->len || j < rows->len) {
+        FileId old_id = i < level->rows->len ? g_array_index(level->rows, FileId, i) : FILE_INDEX_NONE;
+        FileId new_id = j < rows->len ? g_array_index(rows, FileId, j) : FILE_INDEX_NONE;
+        if (old_id == new_id) {
+            if (kept_dirs && is_dir(model, old_id)) g_array_append_val(kept_dirs, old_id);
+            i++;
+            j++;
+        } else if (new_id == FILE_INDEX_NONE || (old_id != FILE_INDEX_NONE && compare_entries(model, old_id, new_id) < 0)) {
+            g_array_remove_index(level->rows, i);
+            if (!kept_dirs) drop_levels(model, old_id);
+            emit_deleted(model, path, i + (level->loading ? 1 : 0));
+        } else {
+            g_array_insert_val(level->rows, i, new_id);
+            emit_inserted(model, path, new_id, FALSE, i + (level->loading ? 1 : 0));
+            i++;
+            j++;
+        }
+    }
+    g_array_free(rows, TRUE);
+
+    if (!level->loading && loading) {
+        level->loading = TRUE;
+        emit_inserted(model, path, parent, TRUE, 0);
+    }
+    if ((old_len == 0) != (level_len(level) == 0)) emit_has_child_toggled(model, parent);
+    gtk_tree_path_free(path);
+}
+
+void sidebar_model_refresh(SidebarModel *model, FileId parent) {
+    if (parent != FILE_INDEX_ROOT && !file_index_is_live(model->index, parent)) return;
+    Level *level = lookup_level(model, parent);
+    if (level) {
+        update_level(model, parent, level, NULL);
+    } else {
+        // Not read yet: the view only knows whether the folder has rows
+        emit_has_child_toggled(model, parent);
+    }
+}
+
+static gboolean level_not_shown(gpointer key, gpointer value, gpointer shown) {
+    return !g_hash_table_contains(shown, key);
+}
+
+void sidebar_model_set_visible(SidebarModel *model, guint32 *visible, guint n_ids) {
+    guint32 *old_visible = model->visible;
+    guint n_old = model->n_visible;
+    model->visible = visible;
+    model->n_visible = visible ? n_ids : 0;
+
+    // Top down, so every level is diffed once its folder's row is in place
+    GHashTable *shown = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GArray *folders = g_array_new(FALSE, FALSE, sizeof(FileId));
+    FileId folder = FILE_INDEX_ROOT;
+    g_array_append_val(folders, folder);
+    while (folders->len > 0) {
+        folder = g_array_index(folders, FileId, folders->len - 1);
+        g_array_set_size(folders, folders->len - 1);
+        Level *level = lookup_level(model, folder);
+        if (level) {
+            g_hash_table_add(shown, GUINT_TO_POINTER(folder));
+            update_level(model, folder, level, folders);
+        } else if (has_rows_in(model, folder, old_visible, n_old) != has_rows(model, folder)) {
+            emit_has_child_toggled(model, folder);
+        }
+    }
+    g_array_free(folders, TRUE);
+
+    // Levels of folders whose rows went away, all in one sweep
+    g_hash_table_foreach_remove(model->levels, level_not_shown, shown);
+    g_hash_table_destroy(shown);
+    g_free(old_visible);
+}
+
+static gboolean is_not_root(gpointer key, gpointer value, gpointer user_data) {
+    return GPOINTER_TO_UINT(key) != FILE_INDEX_ROOT;
+}
+
+void sidebar_model_clear(SidebarModel *model) {
+    Level *root = get_level(model, FILE_INDEX_ROOT);
+    GtkTreePath *path = gtk_tree_path_new();
+    // Last row first, so no sibling moves
+    while (root->rows->len > 0) {
+        g_array_set_size(root->rows, root->rows->len - 1);
+        emit_deleted(model, path, root->rows->len);
+    }
+    gtk_tree_path_free(path);
+
+    g_hash_table_foreach_remove(model->levels, is_not_root, NULL);
+    g_hash_table_remove_all(model->unsaved);
+    g_clear_pointer(&model->visible, g_free); // Its bits are for the old ids
+    model->n_visible = 0;
+}
+
+static GHashTable* remap_ids(GHashTable *table, const guint32 *remap, guint n_old) {
+    GHashTable *out = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, table);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        FileId id = GPOINTER_TO_UINT(key);
+        if (id < n_old && remap[id] != FILE_INDEX_NONE) g_hash_table_insert(out, GUINT_TO_POINTER(remap[id]), value);
+    }
+    g_hash_table_destroy(table);
+    return out;
+}
+
+void sidebar_model_remap(SidebarModel *model, const guint32 *remap, guint n_old) {
+    // Compaction keeps the order of ids, so rows stay sorted
+    GHashTable *levels = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, level_free);
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, model->levels);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        g_hash_table_iter_steal(&it);
+        FileId folder = GPOINTER_TO_UINT(key);
+        Level *level = value;
+        if (folder != FILE_INDEX_ROOT) folder = folder < n_old ? remap[folder] : FILE_INDEX_NONE;
+        if (folder == FILE_INDEX_NONE) {
+            level_free(level);
+            continue;
+        }
+
+        guint kept = 0;
+        for (guint i = 0; i < level->rows->len; i++) {
+            FileId id = g_array_index(level->rows, FileId, i);
+            if (id < n_old && remap[id] != FILE_INDEX_NONE) g_array_index(level->rows, FileId, kept++) = remap[id];
+        }
+        g_array_set_size(level->rows, kept);
+        g_hash_table_insert(levels, GUINT_TO_POINTER(folder), level);
+    }
+    g_hash_table_destroy(model->levels);
+    model->levels = levels;
+    model->unsaved = remap_ids(model->unsaved, remap, n_old);
+
+    if (model->visible) {
+        guint n_ids = file_index_get_count(model->index);
+        guint32 *visible = g_new0(guint32, FILE_INDEX_BITSET_WORDS(n_ids));
+        for (FileId id = 0; id < MIN(n_old, model->n_visible); id++) {
+            if (FILE_INDEX_BIT_TEST(model->visible, id) && remap[id] != FILE_INDEX_NONE) FILE_INDEX_BIT_SET(visible, remap[id]);
+        }
+        g_free(model->visible);
+        model->visible = visible;
+        model->n_visible = n_ids;
+    }
+    model->stamp++;
+}
+
+void sidebar_model_set_git(SidebarModel *model, FileId id, int own_status, int below_status) {
+    if (file_index_set_git(model->index, id, own_status, below_status)) emit_changed(model, id);
+}
+
+void sidebar_model_set_unsaved(SidebarModel *model, FileId id, gboolean unsaved) {
+    if (g_hash_table_contains(model->unsaved, GUINT_TO_POINTER(id)) == !!unsaved) return;
+    if (unsaved) g_hash_table_add(model->unsaved, GUINT_TO_POINTER(id));
+    else g_hash_table_remove(model->unsaved, GUINT_TO_POINTER(id));
+    emit_changed(model, id);
+}
+
+void sidebar_model_subtree_changed(SidebarModel *model, FileId id) {
+    // Collected first: drawing a row may read new levels
+    GArray *folders = g_array_new(FALSE, FALSE, sizeof(FileId));
+    SubtreeMatch match = { model, id };
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, model->levels);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        FileId folder = GPOINTER_TO_UINT(key);
+        if (folder != FILE_INDEX_ROOT && level_is_under(key, value, &match)) g_array_append_val(folders, folder);
+    }
+
+    for (guint i = 0; i < folders->len; i++) {
+        Level *level = lookup_level(model, g_array_index(folders, FileId, i));
+        for (guint j = 0; level && j < level->rows->len; j++) emit_changed(model, g_array_index(level->rows, FileId, j));
+    }
+    g_array_free(folders, TRUE);
+}
+
+SidebarRowKind sidebar_model_get_kind(SidebarModel *model, GtkTreeIter *iter) {
+    if (is_loading_row(iter)) return SIDEBAR_ROW_LOADING;
+    return is_dir(model, iter_id(model, iter)) ? SIDEBAR_ROW_DIR : SIDEBAR_ROW_FILE;
+}
+
+FileId sidebar_model_get_id(SidebarModel *model, GtkTreeIter *iter) {
+    return iter_id(model, iter);
+}
+
+char* sidebar_model_get_path(SidebarModel *model, GtkTreeIter *iter) {
+    if (is_loading_row(iter)) return NULL;
+    GString *path = g_string_new(NULL);
+    file_index_get_path(model->index, iter_id(model, iter), path);
+    return g_string_free(path, FALSE);
+}
+
+gboolean sidebar_model_lookup_id(SidebarModel *model, FileId id, GtkTreeIter *iter) {
+    GtkTreePath *path = file_index_is_live(model->index, id) ? row_path(model, id, -1, TRUE) : NULL;
+    if (!path) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    set_id_iter(model, iter, id, FALSE, gtk_tree_path_get_indices(path)[gtk_tree_path_get_depth(path) - 1]);
+    gtk_tree_path_free(path);
+    return TRUE;
+}
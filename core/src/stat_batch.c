@@ -0,0 +1,289 @@
+#include "stat_batch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/stat.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#define STAT_RING_ENTRIES 128
+#define STAT_URING_MIN 4          // Smaller batches are cheaper as plain stat calls
+#define STAT_CHUNK_SIZE 256       // Requests per fallback pool job
+#define STAT_MAX_THREADS 4
+
+// IORING_OP_STATX, sqe->statx_flags and the opcode probe all arrived with the
+// 5.6 headers, which are the first to define IO_URING_OP_SUPPORTED; older
+// headers fall back to plain stat calls
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register) && \
+    defined(IO_URING_OP_SUPPORTED)
+#define HAVE_IO_URING 1
+#endif
+
+// ---- io_uring ----
+
+#ifdef HAVE_IO_URING
+
+// One ring per thread, set up on first use and torn down when the thread exits
+typedef struct {
+    int fd;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned entries;
+} StatRing;
+
+static gboolean uring_usable;
+
+static void ring_free(gpointer data) {
+    StatRing *ring = (StatRing *)data;
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sq_ptr) munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->fd >= 0) close(ring->fd);
+    g_free(ring);
+}
+
+static GPrivate thread_ring = G_PRIVATE_INIT(ring_free);
+
+static StatRing* ring_new() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    StatRing *ring = g_new0(StatRing, 1);
+    ring->fd = syscall(__NR_io_uring_setup, STAT_RING_ENTRIES, &p);
+    if (ring->fd < 0) {
+        g_free(ring);
+        return NULL;
+    }
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    gboolean single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) ring->sq_len = ring->cq_len = MAX(ring->sq_len, ring->cq_len);
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        ring_free(ring);
+        return NULL;
+    }
+    ring->cq_ptr = single ? ring->sq_ptr
+                          : mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ptr == MAP_FAILED) {
+        ring->cq_ptr = NULL;
+        ring_free(ring);
+        return NULL;
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        ring_free(ring);
+        return NULL;
+    }
+
+    char *sq = (char *)ring->sq_ptr;
+    char *cq = (char *)ring->cq_ptr;
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring->entries = p.sq_entries;
+    return ring;
+}
+
+// io_uring can be missing, blocked by a seccomp filter or too old for statx (before 5.6)
+static gpointer probe_uring(gpointer data) {
+    StatRing *ring = ring_new();
+    if (!ring) return NULL;
+
+    gsize probe_len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = g_malloc0(probe_len);
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+        probe->last_op >= IORING_OP_STATX &&
+        (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED)) {
+        uring_usable = TRUE;
+    }
+    g_free(probe);
+    ring_free(ring);
+    return NULL;
+}
+
+static void fill_from_statx(StatRequest *req, const struct statx *stx) {
+    req->error = 0;
+    req->mode = stx->stx_mode;
+    req->dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    req->ino = stx->stx_ino;
+    req->size = stx->stx_size;
+    req->mtime = (gint64)stx->stx_mtime.tv_sec * 1000000000 + stx->stx_mtime.tv_nsec;
+    req->ctime = (gint64)stx->stx_ctime.tv_sec * 1000000000 + stx->stx_ctime.tv_nsec;
+}
+
+// Returns how many leading requests were answered; the rest need the fallback
+static guint run_uring(StatRequest *requests, guint n) {
+    StatRing *ring = g_private_get(&thread_ring);
+    if (!ring) {
+        ring = ring_new();
+        if (!ring) return 0;
+        g_private_set(&thread_ring, ring);
+    }
+
+    struct statx *bufs = g_new(struct statx, MIN(n, ring->entries));
+    guint done = 0;
+    while (done < n) {
+        guint count = MIN(n - done, ring->entries);
+
+        unsigned tail = *ring->sq_tail;
+        for (guint i = 0; i < count; i++) {
+            unsigned idx = tail & *ring->sq_mask;
+            struct io_uring_sqe *sqe = &ring->sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = requests[done + i].dir_fd;
+            sqe->addr = (guint64)(guintptr)requests[done + i].path;
+            sqe->len = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME | STATX_CTIME;
+            sqe->off = (guint64)(guintptr)&bufs[i];
+            sqe->statx_flags = requests[done + i].nofollow ? AT_SYMLINK_NOFOLLOW : 0;
+            sqe->user_data = i;
+            ring->sq_array[idx] = idx;
+            tail++;
+        }
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+        guint submitted = 0, completed = 0;
+        while (completed < count) {
+            int ret = syscall(__NR_io_uring_enter, ring->fd, count - submitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (ret < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+                // Requests still in flight may write into bufs, so it can only be freed if none are
+                if (submitted == completed) g_free(bufs);
+                g_private_replace(&thread_ring, NULL);
+                return done;
+            }
+            submitted += ret;
+
+            unsigned head = *ring->cq_head;
+            while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                StatRequest *req = &requests[done + cqe->user_data];
+                if (cqe->res < 0) req->error = -cqe->res;
+                else fill_from_statx(req, &bufs[cqe->user_data]);
+                head++;
+                completed++;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+        done += count;
+    }
+    g_free(bufs);
+    return done;
+}
+
+#endif // HAVE_IO_URING
+
+// ---- Fallback ----
+
+typedef struct {
+    GMutex lock;
+    GCond cond;
+    guint remaining;
+} StatWait;
+
+typedef struct {
+    StatRequest *requests;
+    guint n;
+    StatWait *wait;
+} StatChunk;
+
+static void run_plain(StatRequest *requests, guint n) {
+    for (guint i = 0; i < n; i++) {
+        StatRequest *req = &requests[i];
+        struct stat st;
+        if (fstatat(req->dir_fd, req->path, &st, req->nofollow ? AT_SYMLINK_NOFOLLOW : 0) != 0) {
+            req->error = errno;
+            continue;
+        }
+        req->error = 0;
+        req->mode = st.st_mode;
+        req->dev = st.st_dev;
+        req->ino = st.st_ino;
+        req->size = st.st_size;
+        req->mtime = (gint64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        req->ctime = (gint64)st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+    }
+}
+
+static void chunk_worker(gpointer data, gpointer pool_data) {
+    StatChunk *chunk = (StatChunk *)data;
+    run_plain(chunk->requests, chunk->n);
+
+    g_mutex_lock(&chunk->wait->lock);
+    if (--chunk->wait->remaining == 0) g_cond_signal(&chunk->wait->cond);
+    g_mutex_unlock(&chunk->wait->lock);
+    g_free(chunk);
+}
+
+static gpointer create_pool(gpointer data) {
+    return g_thread_pool_new(chunk_worker, NULL, STAT_MAX_THREADS, FALSE, NULL);
+}
+
+// Spread the requests over the pool; the calling thread takes the first chunk itself
+static void run_parallel(StatRequest *requests, guint n) {
+    static GOnce pool_once = G_ONCE_INIT;
+    GThreadPool *pool = g_once(&pool_once, create_pool, NULL);
+
+    StatWait wait;
+    g_mutex_init(&wait.lock);
+    g_cond_init(&wait.cond);
+    wait.remaining = (n - 1) / STAT_CHUNK_SIZE; // Chunks after the first
+
+    for (guint start = STAT_CHUNK_SIZE; start < n; start += STAT_CHUNK_SIZE) {
+        StatChunk *chunk = g_new(StatChunk, 1);
+        chunk->requests = requests + start;
+        chunk->n = MIN(STAT_CHUNK_SIZE, n - start);
+        chunk->wait = &wait;
+        g_thread_pool_push(pool, chunk, NULL);
+    }
+    run_plain(requests, MIN(STAT_CHUNK_SIZE, n));
+
+    g_mutex_lock(&wait.lock);
+    while (wait.remaining > 0) g_cond_wait(&wait.cond, &wait.lock);
+    g_mutex_unlock(&wait.lock);
+    g_mutex_clear(&wait.lock);
+    g_cond_clear(&wait.cond);
+}
+
+void stat_batch_run(StatRequest *requests, guint n) {
+    guint done = 0;
+#ifdef HAVE_IO_URING
+    static GOnce probe_once = G_ONCE_INIT;
+    g_once(&probe_once, probe_uring, NULL);
+    if (uring_usable && n >= STAT_URING_MIN) done = run_uring(requests, n);
+#endif
+    if (n - done > STAT_CHUNK_SIZE) run_parallel(requests + done, n - done);
+    else run_plain(requests + done, n - done);
+}
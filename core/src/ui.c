@@ -3,6 +3,7 @@
 #include "sidebar.h"
 #include "search.h"
 #include "file_ops.h"
+#include "git_gutter.h"
 #include <string.h>
 
 // Instantiate globals defined as extern in app_state.h
@@ -11,11 +12,11 @@ GtkWidget *sidebar;
 GtkWidget *status_bar;
 GtkSourceView *source_view;
 GtkSourceBuffer *text_buffer;
-GtkTreeStore *tree_store;
+SidebarModel *tree_model;
 GtkWidget *tree_view;
 GtkSourceStyleSchemeManager *theme_manager;
 GtkTreeRowReference *current_file_row_ref = NULL;
-GList *file_list = NULL;
+FileIndex *file_index = NULL;
 GtkCssProvider *app_css_provider = NULL;
 GtkWidget *editor_stack;
 GtkWidget *welcome_screen;
@@ -34,14 +35,28 @@ char current_folder[1024] = "";
 char *last_saved_content = NULL;
 
 static GtkWidget *sidebar_scrolled_window;
+static GtkWidget *sidebar_filter;
 static gboolean sidebar_visible = TRUE;
+static char *status_notice = NULL; // Shown next to the branch until cleared
+
+void set_status_notice(const char *notice) {
+    g_free(status_notice);
+    status_notice = notice ? g_strdup(notice) : NULL;
+    update_advanced_status_bar();
+}
 
 void update_advanced_status_bar() {
     if (!status_left_label || !status_right_label) return;
 
-    // LEFT: Git Branch
+    // LEFT: Git Branch, and any standing notice
     const char *branch = get_git_branch();
-    gtk_label_set_text(GTK_LABEL(status_left_label), branch);
+    if (status_notice) {
+        char *left = g_strdup_printf("%s | %s", branch, status_notice);
+        gtk_label_set_text(GTK_LABEL(status_left_label), left);
+        g_free(left);
+    } else {
+        gtk_label_set_text(GTK_LABEL(status_left_label), branch);
+    }
 
     // RIGHT: Line count | Encoding | Language
     int line_count = 1;
@@ -178,6 +193,7 @@ static void move_cursor_right() {
 static void toggle_sidebar() {
     sidebar_visible = !sidebar_visible;
     gtk_widget_set_visible(sidebar_scrolled_window, sidebar_visible);
+    gtk_widget_set_visible(sidebar_filter, sidebar_visible);
 }
 
 void show_empty_state() {
@@ -250,7 +266,11 @@ static gboolean on_key_press(GtkWidget *widget, GdkEventKey *event, gpointer use
                 ctrl_k_pending = FALSE;
                 return TRUE;
             }
-            case GDK_KEY_b: toggle_sidebar(); ctrl_k_pending = FALSE; return TRUE;
+            case GDK_KEY_b:
+                if (shift) toggle_git_blame();
+                else toggle_sidebar();
+                ctrl_k_pending = FALSE;
+                return TRUE;
             case GDK_KEY_s: save_file(); ctrl_k_pending = FALSE; return TRUE;
             case GDK_KEY_m: switch_theme(); ctrl_k_pending = FALSE; return TRUE;
             case GDK_KEY_p: show_search_popup(); ctrl_k_pending = FALSE; return TRUE;
@@ -734,6 +754,14 @@ void create_main_window() {
     
     gtk_box_pack_start(GTK_BOX(sidebar_vbox), sidebar_header, FALSE, FALSE, 0);
 
+    // Filter box narrowing the tree in place
+    sidebar_filter = create_sidebar_filter();
+    gtk_widget_set_margin_start(sidebar_filter, 10);
+    gtk_widget_set_margin_end(sidebar_filter, 10);
+    gtk_widget_set_margin_top(sidebar_filter, 6);
+    gtk_widget_set_margin_bottom(sidebar_filter, 6);
+    gtk_box_pack_start(GTK_BOX(sidebar_vbox), sidebar_filter, FALSE, FALSE, 0);
+
     sidebar_scrolled_window = gtk_scrolled_window_new(NULL, NULL);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(sidebar_scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
     gtk_widget_set_name(sidebar_scrolled_window, "sidebar-scrolledwindow");
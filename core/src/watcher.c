@@ -0,0 +1,248 @@
+#include "watcher.h"
+#include "crawler.h"
+#include <glib-unix.h>
+#include <sys/inotify.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Structural changes feed the tree and the file index; finished writes only
+// matter to listeners that want content changes (git decorations)
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK)
+#define WATCH_WRITE_MASK IN_CLOSE_WRITE
+// Share of max_user_watches past which the workspace is reported as close to the limit
+#define WATCH_LIMIT_WARN_PERCENT 90
+
+struct _Watcher {
+    int fd;
+    guint source_id;
+    GPtrArray *roots;       // Trees watched, each with its subfolders
+    GHashTable *wd_paths;   // Watch descriptor -> folder path (owned)
+    GHashTable *path_wds;   // Folder path (borrowed from wd_paths) -> watch descriptor
+    Crawler *crawler;       // Walks folders so their subfolders get watched too
+    IgnoreMatcher *ignore;  // Ignored folders are not watched; NULL watches every listed folder
+    guint max_watches;      // max_user_watches when the watcher started, 0 if unknown
+    gboolean near_reported;
+    gboolean limit_reported;
+
+    WatchChangeFunc on_change;
+    WatchChangeFunc on_write;
+    WatchRescanFunc on_rescan;
+    WatchLimitFunc on_limit;
+    gpointer user_data;
+};
+
+guint watcher_get_max_watches() {
+    char *contents = NULL;
+    guint max = 0;
+    if (g_file_get_contents("/proc/sys/fs/inotify/max_user_watches", &contents, NULL, NULL)) {
+        max = (guint)g_ascii_strtoull(contents, NULL, 10);
+        g_free(contents);
+    }
+    return max;
+}
+
+guint watcher_get_watch_count(Watcher *watcher) {
+    return watcher ? g_hash_table_size(watcher->wd_paths) : 0;
+}
+
+static void forget_wd(Watcher *watcher, int wd);
+
+// Returns TRUE if the folder's children should be walked
+static gboolean watch_dir(Watcher *watcher, const char *path) {
+    int wd = inotify_add_watch(watcher->fd, path, WATCH_MASK | (watcher->on_write ? WATCH_WRITE_MASK : 0));
+    if (wd < 0) {
+        if (errno == ENOSPC && !watcher->limit_reported) {
+            watcher->limit_reported = TRUE;
+            if (watcher->on_limit) {
+                watcher->on_limit(watcher, watcher_get_watch_count(watcher), watcher->max_watches, TRUE, watcher->user_data);
+            }
+        }
+        return FALSE;
+    }
+
+    // The same inode under another path is an alias (symlink). Events are
+    // reported under one path only, so the folder's real path wins over an
+    // alias that happened to be walked first.
+    const char *known = g_hash_table_lookup(watcher->wd_paths, GINT_TO_POINTER(wd));
+    if (known) {
+        if (strcmp(known, path) == 0) return TRUE;
+        char *real = realpath(path, NULL);
+        gboolean is_real = real && strcmp(real, path) == 0;
+        free(real);
+        if (!is_real) return FALSE;
+        forget_wd(watcher, wd);
+    }
+
+    char *owned = g_strdup(path);
+    g_hash_table_insert(watcher->wd_paths, GINT_TO_POINTER(wd), owned);
+    g_hash_table_insert(watcher->path_wds, owned, GINT_TO_POINTER(wd));
+
+    guint count = watcher_get_watch_count(watcher);
+    if (!watcher->near_reported && watcher->max_watches > 0 &&
+        (guint64)count * 100 >= (guint64)watcher->max_watches * WATCH_LIMIT_WARN_PERCENT) {
+        watcher->near_reported = TRUE;
+        if (watcher->on_limit) watcher->on_limit(watcher, count, watcher->max_watches, FALSE, watcher->user_data);
+    }
+    return TRUE;
+}
+
+static void watch_tree(Watcher *watcher, const char *path) {
+    if (watch_dir(watcher, path)) crawler_queue_dir(watcher->crawler, path, NULL);
+}
+
+static void forget_wd(Watcher *watcher, int wd) {
+    const char *path = g_hash_table_lookup(watcher->wd_paths, GINT_TO_POINTER(wd));
+    if (!path) return;
+    g_hash_table_remove(watcher->path_wds, path);
+    g_hash_table_remove(watcher->wd_paths, GINT_TO_POINTER(wd)); // Frees path
+}
+
+// A folder moved away: its watches would keep reporting under the old name
+static void unwatch_tree(Watcher *watcher, const char *path) {
+    size_t len = strlen(path);
+    GArray *stale = g_array_new(FALSE, FALSE, sizeof(int));
+    GHashTableIter it;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&it, watcher->path_wds);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        const char *dir = (const char *)key;
+        if (strncmp(dir, path, len) == 0 && (dir[len] == '\0' || dir[len] == '/')) {
+            int wd = GPOINTER_TO_INT(value);
+            g_array_append_val(stale, wd);
+        }
+    }
+    for (guint i = 0; i < stale->len; i++) {
+        int wd = g_array_index(stale, int, i);
+        inotify_rm_watch(watcher->fd, wd);
+        forget_wd(watcher, wd);
+    }
+    g_array_free(stale, TRUE);
+}
+
+// The kernel does not say which folders the dropped events were for, so
+// nothing short of every watched tree is known to be current
+static void handle_overflow(Watcher *watcher) {
+    for (guint i = 0; i < watcher->roots->len; i++) {
+        const char *root = g_ptr_array_index(watcher->roots, i);
+        // Folders created while events were being dropped have no watch yet
+        watch_tree(watcher, root);
+        watcher->on_rescan(watcher, root, watcher->user_data);
+    }
+}
+
+static void handle_event(Watcher *watcher, const struct inotify_event *ev) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        handle_overflow(watcher);
+        return;
+    }
+
+    const char *dir = g_hash_table_lookup(watcher->wd_paths, GINT_TO_POINTER(ev->wd));
+    if (!dir) return;
+    if (ev->mask & IN_IGNORED) {
+        // Folder deleted or unmounted; the kernel already dropped the watch
+        forget_wd(watcher, ev->wd);
+        return;
+    }
+    if (ev->len == 0) return;
+
+    char *path = g_build_filename(dir, ev->name, NULL);
+
+    if (ev->mask & IN_CLOSE_WRITE) {
+        watcher->on_write(watcher, path, watcher->user_data);
+        g_free(path);
+        return;
+    }
+
+    if (ev->mask & IN_ISDIR) {
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+            if (crawler_is_listed(ev->name, TRUE) &&
+                !(watcher->ignore && ignore_matcher_is_ignored(watcher->ignore, path, TRUE))) {
+                watch_tree(watcher, path);
+            }
+        } else if (ev->mask & IN_MOVED_FROM) {
+            unwatch_tree(watcher, path);
+        }
+    }
+
+    watcher->on_change(watcher, path, watcher->user_data);
+    g_free(path);
+}
+
+static gboolean on_inotify_readable(gint fd, GIOCondition condition, gpointer user_data) {
+    Watcher *watcher = (Watcher *)user_data;
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0) break; // EAGAIN once the queue is drained
+
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            handle_event(watcher, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_walk_entry(Crawler *crawler, CrawlBatch *batch, CrawlEntry *entry, gpointer user_data) {
+    if (!entry->is_dir || entry->is_excluded) return;
+
+    char *path = g_build_filename(batch->path, entry->name, NULL);
+    watch_tree((Watcher *)user_data, path);
+    g_free(path);
+}
+
+static void on_walk_finished(Crawler *crawler, gpointer user_data) {
+    Watcher *watcher = (Watcher *)user_data;
+    g_debug("Watching %u folders (max_user_watches %u)",
+            watcher_get_watch_count(watcher), watcher->max_watches);
+}
+
+Watcher* watcher_new(const char *root, IgnoreMatcher *ignore, WatchChangeFunc on_change, WatchChangeFunc on_write,
+                     WatchRescanFunc on_rescan, WatchLimitFunc on_limit, gpointer user_data) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    Watcher *watcher = g_new0(Watcher, 1);
+    watcher->fd = fd;
+    watcher->roots = g_ptr_array_new_with_free_func(g_free);
+    watcher->ignore = ignore ? ignore_matcher_ref(ignore) : NULL;
+    watcher->wd_paths = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    watcher->path_wds = g_hash_table_new(g_str_hash, g_str_equal);
+    watcher->on_change = on_change;
+    watcher->on_write = on_write;
+    watcher->on_rescan = on_rescan;
+    watcher->on_limit = on_limit;
+    watcher->user_data = user_data;
+    watcher->max_watches = watcher_get_max_watches();
+
+    watcher->source_id = g_unix_fd_add(fd, G_IO_IN, on_inotify_readable, watcher);
+    watcher->crawler = crawler_new(on_walk_entry, NULL, on_walk_finished, NULL, watcher);
+    if (ignore) crawler_set_ignore(watcher->crawler, ignore);
+    if (root) watcher_add_root(watcher, root);
+    return watcher;
+}
+
+// Another tree on the same inotify instance, so a handful of small trees
+// (the refs of each repository) do not each use up one of max_user_instances
+void watcher_add_root(Watcher *watcher, const char *root) {
+    g_ptr_array_add(watcher->roots, g_strdup(root));
+    watch_tree(watcher, root);
+}
+
+void watcher_destroy(Watcher *watcher) {
+    if (!watcher) return;
+    g_source_remove(watcher->source_id);
+    crawler_destroy(watcher->crawler);
+    close(watcher->fd); // Drops every watch at once
+
+    g_hash_table_destroy(watcher->path_wds);
+    g_hash_table_destroy(watcher->wd_paths);
+    ignore_matcher_unref(watcher->ignore);
+    g_ptr_array_unref(watcher->roots);
+    g_free(watcher);
+}